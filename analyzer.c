@@ -0,0 +1,656 @@
+#include "analyzer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ANALYZER_DATA_PER_LINE  8
+
+static void
+Analyzer__issue__(Analyzer* self, Analyzer_Issue_Kind kind, u16 addr, u16 opcode);
+
+static void
+Analyzer__queue__(Analyzer* self, u16* worklist, size_t* count, u32 addr, bool leader, const Analyzer_Instruction* from);
+
+static u8
+Analyzer__successors__(const Analyzer* self, const Analyzer_Instruction* instruction, u32 successors[2]);
+
+static bool
+Analyzer__build_blocks__(Analyzer* self);
+
+static bool
+Analyzer__is_error__(Analyzer_Issue_Kind kind);
+
+static const char*
+Analyzer__issue_message__(Analyzer_Issue_Kind kind);
+
+Analyzer
+Analyzer_init(const u8* program, size_t program_size, Cpu_Mode mode)
+{
+    Analyzer self = {};
+
+    if(!program || program_size == 0 || program_size > Cpu_max_program_size(mode))
+    {
+        fputs("Error: Analyzer: program is NULL or has bad size\n", stderr);
+        self.valid = false;
+        return self;
+    }
+
+    self.mode = mode;
+    self.program_end = CPU_PROGRAM_ADDR + program_size;
+    self.memory = calloc(CPU_MEMORY_SIZE, sizeof(u8));
+    self.map = calloc(CPU_MEMORY_SIZE, sizeof(u8));
+
+    // every address is queued at most once
+    u16* worklist = malloc(CPU_MEMORY_SIZE * sizeof(u16));
+    size_t count = 0;
+
+    if(!self.memory || !self.map || !worklist)
+    {
+        free(worklist);
+        Analyzer_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+
+    memcpy(&self.memory[CPU_PROGRAM_ADDR], program, program_size);
+
+    Analyzer__queue__(&self, worklist, &count, CPU_PROGRAM_ADDR, true, NULL);
+
+    while(count > 0)
+    {
+        u16 addr = worklist[--count];
+        Analyzer_Instruction instruction = Analyzer_decode(self.memory, addr, mode);
+
+        // decoding bytes that another instruction already owns: overlapping code
+        bool overlap = self.map[addr] & ANALYZER_BYTE_OPERAND;
+        for(u8 offset = 1; offset < instruction.size; offset++)
+        {
+            overlap |= self.map[(u16)(addr + offset)] & ANALYZER_BYTE_CODE;
+        }
+
+        if(overlap)
+        {
+            Analyzer__issue__(&self, ANALYZER_ISSUE_OVERLAP, addr, instruction.opcode);
+        }
+
+        self.map[addr] |= ANALYZER_BYTE_CODE;
+        for(u8 offset = 1; offset < instruction.size; offset++)
+        {
+            self.map[(u16)(addr + offset)] |= ANALYZER_BYTE_OPERAND;
+        }
+        self.instructions++;
+
+        // I pointed at an address, most likely sprite data
+        if((instruction.opcode & 0xF000) == 0xA000)
+        {
+            self.map[instruction.target] |= ANALYZER_BYTE_DATA_REF;
+        }
+        else if(instruction.size == 4)
+        {
+            self.map[instruction.operand] |= ANALYZER_BYTE_DATA_REF;
+        }
+
+        switch(instruction.flow)
+        {
+            case ANALYZER_FLOW_INVALID:
+                Analyzer__issue__(&self, ANALYZER_ISSUE_INVALID_OPCODE, addr, instruction.opcode);
+                break;
+            case ANALYZER_FLOW_COMPUTED:
+                Analyzer__issue__(&self, ANALYZER_ISSUE_COMPUTED_JUMP, addr, instruction.opcode);
+                break;
+            default:
+                break;
+        }
+
+        u32 successors[2];
+        u8 successors_count = Analyzer__successors__(&self, &instruction, successors);
+
+        for(u8 iii = 0; iii < successors_count; iii++)
+        {
+            bool leader = instruction.flow != ANALYZER_FLOW_NEXT;
+            Analyzer__queue__(&self, worklist, &count, successors[iii], leader, &instruction);
+        }
+    }
+
+    free(worklist);
+
+    for(u32 addr = CPU_PROGRAM_ADDR; addr < self.program_end; addr++)
+    {
+        if(self.map[addr] & (ANALYZER_BYTE_CODE | ANALYZER_BYTE_OPERAND)) self.code_bytes++;
+        else self.data_bytes++;
+    }
+
+    if(!Analyzer__build_blocks__(&self))
+    {
+        Analyzer_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+
+    self.valid = true;
+    return self;
+}
+
+Analyzer_Instruction
+Analyzer_decode(const u8* memory, u16 addr, Cpu_Mode mode)
+{
+    Analyzer_Instruction instruction = {};
+
+    const bool schip = mode >= CPU_MODE_SCHIP;
+    const bool xochip = mode == CPU_MODE_XOCHIP;
+    const u16 opcode = (memory[addr] << 8) | memory[(u16)(addr + 1)];
+    const u8 x = (opcode & 0x0F00) >> 8;
+    const u8 n = opcode & 0xF;
+    const u8 kk = opcode & 0xFF;
+
+    instruction.addr = addr;
+    instruction.opcode = opcode;
+    instruction.size = 2;
+    instruction.flow = ANALYZER_FLOW_NEXT;
+    instruction.target = opcode & 0xFFF;
+
+    bool valid = true;
+
+    switch(opcode >> 12)
+    {
+        case 0x0:
+            if(opcode == 0x00EE) instruction.flow = ANALYZER_FLOW_RETURN;
+            else if(schip && opcode == 0x00FD) instruction.flow = ANALYZER_FLOW_EXIT;
+            else valid = opcode == 0x00E0 ||
+                         (schip && (opcode & 0xFFF0) == 0x00C0) ||
+                         (xochip && (opcode & 0xFFF0) == 0x00D0) ||
+                         (schip && opcode >= 0x00FB && opcode <= 0x00FF);
+            break;
+        case 0x1:
+            instruction.flow = ANALYZER_FLOW_JUMP;
+            break;
+        case 0x2:
+            instruction.flow = ANALYZER_FLOW_CALL;
+            break;
+        case 0x3:
+        case 0x4:
+            instruction.flow = ANALYZER_FLOW_SKIP;
+            break;
+        case 0x5:
+            if(n == 0x0) instruction.flow = ANALYZER_FLOW_SKIP;
+            else valid = xochip && (n == 0x2 || n == 0x3);
+            break;
+        case 0x8:
+            valid = n <= 0x7 || n == 0xE;
+            break;
+        case 0x9:
+            if(n == 0x0) instruction.flow = ANALYZER_FLOW_SKIP;
+            else valid = false;
+            break;
+        case 0xB:
+            instruction.flow = ANALYZER_FLOW_COMPUTED;
+            break;
+        case 0xE:
+            if(kk == 0x9E || kk == 0xA1) instruction.flow = ANALYZER_FLOW_SKIP;
+            else valid = false;
+            break;
+        case 0xF:
+            switch(kk)
+            {
+                case 0x07: case 0x0A: case 0x15: case 0x18:
+                case 0x1E: case 0x29: case 0x33: case 0x55: case 0x65:
+                    break;
+                case 0x30:
+                    valid = schip;
+                    break;
+                case 0x75:
+                case 0x85:
+                    valid = xochip || (schip && x < 8);
+                    break;
+                case 0x00:
+                    valid = xochip && x == 0;
+                    if(valid)
+                    {
+                        instruction.size = 4;
+                        instruction.operand = (memory[(u16)(addr + 2)] << 8) | memory[(u16)(addr + 3)];
+                    }
+                    break;
+                case 0x02:
+                    valid = xochip && x == 0;
+                    break;
+                case 0x01:
+                case 0x3A:
+                    valid = xochip;
+                    break;
+                default:
+                    valid = false;
+                    break;
+            }
+            break;
+        default:
+            // 6xkk 7xkk Annn Cxkk Dxyn
+            break;
+    }
+
+    if(!valid)
+    {
+        instruction.flow = ANALYZER_FLOW_INVALID;
+    }
+
+    return instruction;
+}
+
+void
+Analyzer_format(const Analyzer_Instruction* instruction, char* buffer, size_t size)
+{
+    static const char* const ALU[16] = {
+        [0x0] = "LD", [0x1] = "OR", [0x2] = "AND", [0x3] = "XOR",
+        [0x4] = "ADD", [0x5] = "SUB", [0x6] = "SHR", [0x7] = "SUBN", [0xE] = "SHL",
+    };
+
+    const u16 opcode = instruction->opcode;
+    const u8 x = (opcode & 0x0F00) >> 8;
+    const u8 y = (opcode & 0x00F0) >> 4;
+    const u8 n = opcode & 0xF;
+    const u8 kk = opcode & 0xFF;
+    const u16 nnn = opcode & 0xFFF;
+
+    if(instruction->flow == ANALYZER_FLOW_INVALID)
+    {
+        snprintf(buffer, size, "???");
+        return;
+    }
+
+    switch(opcode >> 12)
+    {
+        case 0x0:
+            switch(opcode)
+            {
+                case 0x00E0: snprintf(buffer, size, "CLS"); break;
+                case 0x00EE: snprintf(buffer, size, "RET"); break;
+                case 0x00FB: snprintf(buffer, size, "SCR"); break;
+                case 0x00FC: snprintf(buffer, size, "SCL"); break;
+                case 0x00FD: snprintf(buffer, size, "EXIT"); break;
+                case 0x00FE: snprintf(buffer, size, "LOW"); break;
+                case 0x00FF: snprintf(buffer, size, "HIGH"); break;
+                default:
+                    snprintf(buffer, size, "%s %u", (opcode & 0xF0) == 0xC0 ? "SCD" : "SCU", n);
+                    break;
+            }
+            break;
+        case 0x1: snprintf(buffer, size, "JP 0x%03X", nnn); break;
+        case 0x2: snprintf(buffer, size, "CALL 0x%03X", nnn); break;
+        case 0x3: snprintf(buffer, size, "SE V%X, 0x%02X", x, kk); break;
+        case 0x4: snprintf(buffer, size, "SNE V%X, 0x%02X", x, kk); break;
+        case 0x5:
+            if(n == 0x0) snprintf(buffer, size, "SE V%X, V%X", x, y);
+            else snprintf(buffer, size, "%s V%X-V%X", n == 0x2 ? "SAVE" : "LOAD", x, y);
+            break;
+        case 0x6: snprintf(buffer, size, "LD V%X, 0x%02X", x, kk); break;
+        case 0x7: snprintf(buffer, size, "ADD V%X, 0x%02X", x, kk); break;
+        case 0x8: snprintf(buffer, size, "%s V%X, V%X", ALU[n], x, y); break;
+        case 0x9: snprintf(buffer, size, "SNE V%X, V%X", x, y); break;
+        case 0xA: snprintf(buffer, size, "LD I, 0x%03X", nnn); break;
+        case 0xB: snprintf(buffer, size, "JP V0, 0x%03X", nnn); break;
+        case 0xC: snprintf(buffer, size, "RND V%X, 0x%02X", x, kk); break;
+        case 0xD: snprintf(buffer, size, "DRW V%X, V%X, %u", x, y, n); break;
+        case 0xE: snprintf(buffer, size, "%s V%X", kk == 0x9E ? "SKP" : "SKNP", x); break;
+        case 0xF:
+            switch(kk)
+            {
+                case 0x00: snprintf(buffer, size, "LD I, 0x%04X", instruction->operand); break;
+                case 0x01: snprintf(buffer, size, "PLANE %u", x); break;
+                case 0x02: snprintf(buffer, size, "AUDIO"); break;
+                case 0x07: snprintf(buffer, size, "LD V%X, DT", x); break;
+                case 0x0A: snprintf(buffer, size, "LD V%X, K", x); break;
+                case 0x15: snprintf(buffer, size, "LD DT, V%X", x); break;
+                case 0x18: snprintf(buffer, size, "LD ST, V%X", x); break;
+                case 0x1E: snprintf(buffer, size, "ADD I, V%X", x); break;
+                case 0x29: snprintf(buffer, size, "LD F, V%X", x); break;
+                case 0x30: snprintf(buffer, size, "LD HF, V%X", x); break;
+                case 0x33: snprintf(buffer, size, "LD B, V%X", x); break;
+                case 0x3A: snprintf(buffer, size, "PITCH V%X", x); break;
+                case 0x55: snprintf(buffer, size, "LD [I], V%X", x); break;
+                case 0x65: snprintf(buffer, size, "LD V%X, [I]", x); break;
+                case 0x75: snprintf(buffer, size, "LD R, V%X", x); break;
+                case 0x85: snprintf(buffer, size, "LD V%X, R", x); break;
+            }
+            break;
+    }
+}
+
+bool
+Analyzer_is_code(const Analyzer* self, u16 addr)
+{
+    return self && self->valid && (self->map[addr] & ANALYZER_BYTE_CODE);
+}
+
+const Analyzer_Block*
+Analyzer_block_at(const Analyzer* self, u16 addr)
+{
+    if(!self || !self->valid)
+    {
+        return NULL;
+    }
+
+    size_t low = 0;
+    size_t high = self->blocks_count;
+
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if(self->blocks[middle].start < addr) low = middle + 1;
+        else high = middle;
+    }
+
+    if(low < self->blocks_count && self->blocks[low].start == addr)
+    {
+        return &self->blocks[low];
+    }
+
+    return NULL;
+}
+
+void
+Analyzer_report(const Analyzer* self, FILE* out)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    for(size_t iii = 0; iii < self->issues_count; iii++)
+    {
+        const Analyzer_Issue* issue = &self->issues[iii];
+        Analyzer_Instruction instruction = Analyzer_decode(self->memory, issue->addr, self->mode);
+
+        char mnemonic[32];
+        Analyzer_format(&instruction, mnemonic, sizeof(mnemonic));
+
+        fprintf(out, "%s: 0x%04X %04X %-16s %s\n",
+            Analyzer__is_error__(issue->kind) ? "Error" : "Warning",
+            issue->addr,
+            issue->opcode,
+            mnemonic,
+            Analyzer__issue_message__(issue->kind)
+        );
+    }
+}
+
+void
+Analyzer_dump(const Analyzer* self, FILE* out)
+{
+    static const char* const MODES[] = {
+        [CPU_MODE_CHIP8] = "chip8",
+        [CPU_MODE_SCHIP] = "schip",
+        [CPU_MODE_XOCHIP] = "xochip",
+    };
+
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    fprintf(out, "; %s program 0x%04X-0x%04X: %u instructions, %u code bytes, %u data bytes\n",
+        MODES[self->mode],
+        CPU_PROGRAM_ADDR,
+        self->program_end - 1,
+        self->instructions,
+        self->code_bytes,
+        self->data_bytes
+    );
+    fprintf(out, "; %zu blocks, %zu issues (%u errors)\n", self->blocks_count, self->issues_count, self->errors);
+
+    u32 addr = CPU_PROGRAM_ADDR;
+    while(addr < self->program_end)
+    {
+        const u8 flags = self->map[addr];
+
+        if(flags & ANALYZER_BYTE_CODE)
+        {
+            const Analyzer_Block* block = Analyzer_block_at(self, addr);
+            if(block)
+            {
+                fprintf(out, "\nblock_%04X:", addr);
+                if(block->successors_count > 0) fprintf(out, "%*s; ->", 24, "");
+                for(u8 iii = 0; iii < block->successors_count; iii++)
+                {
+                    fprintf(out, " 0x%04X", block->successors[iii]);
+                }
+                fputc('\n', out);
+            }
+
+            Analyzer_Instruction instruction = Analyzer_decode(self->memory, addr, self->mode);
+
+            char mnemonic[32];
+            Analyzer_format(&instruction, mnemonic, sizeof(mnemonic));
+
+            if(instruction.size == 4) fprintf(out, "    0x%04X  %04X %04X  %s\n", addr, instruction.opcode, instruction.operand, mnemonic);
+            else fprintf(out, "    0x%04X  %04X       %s\n", addr, instruction.opcode, mnemonic);
+
+            addr += instruction.size;
+            continue;
+        }
+
+        if(flags & ANALYZER_BYTE_OPERAND)
+        {
+            // the tail of an overlapping instruction, already printed
+            addr++;
+            continue;
+        }
+
+        // a row of data, cut where code or a referenced address starts
+        if(flags & ANALYZER_BYTE_DATA_REF)
+        {
+            fprintf(out, "\ndata_%04X:\n", addr);
+        }
+        fprintf(out, "    0x%04X  db", addr);
+
+        u32 row = 0;
+        do
+        {
+            fprintf(out, " 0x%02X", self->memory[addr]);
+            addr++;
+            row++;
+        }
+        while(addr < self->program_end && row < ANALYZER_DATA_PER_LINE &&
+              !(self->map[addr] & (ANALYZER_BYTE_CODE | ANALYZER_BYTE_OPERAND | ANALYZER_BYTE_DATA_REF)));
+
+        fputc('\n', out);
+    }
+
+    if(self->issues_count > 0)
+    {
+        fputc('\n', out);
+        Analyzer_report(self, out);
+    }
+}
+
+void
+Analyzer_deinit(Analyzer* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    free(self->memory);
+    free(self->map);
+    free(self->blocks);
+    free(self->issues);
+
+    self->memory = NULL;
+    self->map = NULL;
+    self->blocks = NULL;
+    self->issues = NULL;
+    self->valid = false;
+}
+
+
+// private functions
+void
+Analyzer__issue__(Analyzer* self, Analyzer_Issue_Kind kind, u16 addr, u16 opcode)
+{
+    if(self->issues_count == self->issues_capacity)
+    {
+        size_t capacity = self->issues_capacity ? self->issues_capacity * 2 : 16;
+        Analyzer_Issue* issues = realloc(self->issues, capacity * sizeof(Analyzer_Issue));
+        if(!issues)
+        {
+            return;
+        }
+
+        self->issues = issues;
+        self->issues_capacity = capacity;
+    }
+
+    self->issues[self->issues_count++] = (Analyzer_Issue) {
+        .kind = kind,
+        .addr = addr,
+        .opcode = opcode,
+    };
+
+    if(Analyzer__is_error__(kind))
+    {
+        self->errors++;
+    }
+}
+
+void
+Analyzer__queue__(Analyzer* self, u16* worklist, size_t* count, u32 addr, bool leader, const Analyzer_Instruction* from)
+{
+    if(addr < CPU_PROGRAM_ADDR || addr >= self->program_end)
+    {
+        Analyzer__issue__(self, ANALYZER_ISSUE_OUTSIDE_ROM, from->addr, from->opcode);
+        return;
+    }
+
+    if(leader)
+    {
+        self->map[addr] |= ANALYZER_BYTE_BLOCK_START;
+    }
+
+    if(self->map[addr] & ANALYZER_BYTE_QUEUED)
+    {
+        return;
+    }
+
+    self->map[addr] |= ANALYZER_BYTE_QUEUED;
+    worklist[(*count)++] = addr;
+}
+
+u8
+Analyzer__successors__(const Analyzer* self, const Analyzer_Instruction* instruction, u32 successors[2])
+{
+    const u32 next = instruction->addr + instruction->size;
+
+    switch(instruction->flow)
+    {
+        case ANALYZER_FLOW_NEXT:
+            successors[0] = next;
+            return 1;
+        case ANALYZER_FLOW_JUMP:
+            successors[0] = instruction->target;
+            return 1;
+        case ANALYZER_FLOW_CALL:
+            successors[0] = instruction->target;
+            successors[1] = next;
+            return 2;
+        case ANALYZER_FLOW_SKIP:
+        {
+            // the skipped instruction is 4 bytes long if it is `F000 nnnn`
+            Analyzer_Instruction skipped = Analyzer_decode(self->memory, (u16)next, self->mode);
+            successors[0] = next;
+            successors[1] = next + skipped.size;
+            return 2;
+        }
+        default:
+            return 0;
+    }
+}
+
+bool
+Analyzer__build_blocks__(Analyzer* self)
+{
+    size_t capacity = 0;
+    Analyzer_Block* open = NULL;
+
+    for(u32 addr = CPU_PROGRAM_ADDR; addr < self->program_end; addr++)
+    {
+        const u8 flags = self->map[addr];
+
+        if(!(flags & ANALYZER_BYTE_CODE))
+        {
+            continue;
+        }
+
+        // a jump target or code that doesn't follow the open block splits it
+        if(open && ((flags & ANALYZER_BYTE_BLOCK_START) || open->end != addr))
+        {
+            if(open->end == addr)
+            {
+                open->successors[open->successors_count++] = addr;
+            }
+            open = NULL;
+        }
+
+        if(!open)
+        {
+            if(self->blocks_count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 64;
+                Analyzer_Block* blocks = realloc(self->blocks, capacity * sizeof(Analyzer_Block));
+                if(!blocks)
+                {
+                    return false;
+                }
+                self->blocks = blocks;
+            }
+
+            open = &self->blocks[self->blocks_count++];
+            *open = (Analyzer_Block) {
+                .start = addr,
+                .end = addr,
+                .exit = ANALYZER_FLOW_NEXT,
+            };
+        }
+
+        Analyzer_Instruction instruction = Analyzer_decode(self->memory, addr, self->mode);
+        open->end = addr + instruction.size;
+        open->instructions++;
+
+        if(instruction.flow != ANALYZER_FLOW_NEXT)
+        {
+            u32 successors[2];
+            u8 successors_count = Analyzer__successors__(self, &instruction, successors);
+
+            open->exit = instruction.flow;
+            for(u8 iii = 0; iii < successors_count; iii++)
+            {
+                if(successors[iii] < self->program_end && (self->map[successors[iii]] & ANALYZER_BYTE_CODE))
+                {
+                    open->successors[open->successors_count++] = successors[iii];
+                }
+            }
+            open = NULL;
+        }
+    }
+
+    return true;
+}
+
+bool
+Analyzer__is_error__(Analyzer_Issue_Kind kind)
+{
+    return kind == ANALYZER_ISSUE_INVALID_OPCODE || kind == ANALYZER_ISSUE_OUTSIDE_ROM;
+}
+
+const char*
+Analyzer__issue_message__(Analyzer_Issue_Kind kind)
+{
+    switch(kind)
+    {
+        case ANALYZER_ISSUE_INVALID_OPCODE: return "invalid opcode";
+        case ANALYZER_ISSUE_OUTSIDE_ROM:    return "control flow leaves the program";
+        case ANALYZER_ISSUE_COMPUTED_JUMP:  return "computed jump, the code behind it is not analyzed";
+        case ANALYZER_ISSUE_OVERLAP:        return "decoded at two alignments";
+    }
+
+    return "";
+}
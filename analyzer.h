@@ -0,0 +1,114 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include "utils/type_alias.h"
+#include "cpu.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// where the control goes after an instruction
+typedef enum {
+    ANALYZER_FLOW_NEXT,         // falls through to the next instruction
+    ANALYZER_FLOW_JUMP,         // 1nnn
+    ANALYZER_FLOW_CALL,         // 2nnn, comes back to the next instruction
+    ANALYZER_FLOW_RETURN,       // 00EE
+    ANALYZER_FLOW_SKIP,         // 3xkk 4xkk 5xy0 9xy0 Ex9E ExA1
+    ANALYZER_FLOW_COMPUTED,     // Bnnn, the target is only known at runtime
+    ANALYZER_FLOW_EXIT,         // 00FD
+    ANALYZER_FLOW_INVALID,      // not an instruction of the mode
+} Analyzer_Flow;
+
+typedef struct {
+    u16 addr;
+    u16 opcode;
+    u16 operand;        // XO-CHIP `F000 nnnn` second word
+    u8 size;            // 2, or 4 for `F000 nnnn`
+    Analyzer_Flow flow;
+    u16 target;         // 1nnn/2nnn target, Bnnn base
+} Analyzer_Instruction;
+
+// per address flags of Analyzer.map
+#define ANALYZER_BYTE_CODE          (1 << 0)    // first byte of a reachable instruction
+#define ANALYZER_BYTE_OPERAND       (1 << 1)    // other bytes of a reachable instruction
+#define ANALYZER_BYTE_BLOCK_START   (1 << 2)    // a basic block starts here
+#define ANALYZER_BYTE_DATA_REF      (1 << 3)    // I is pointed here by Annn or F000 nnnn
+#define ANALYZER_BYTE_QUEUED        (1 << 4)    // internal: already on the worklist
+
+// straight line code, entered at `start` only
+typedef struct {
+    u16 start;
+    u16 end;            // one past the last byte of the last instruction
+    u16 instructions;
+    Analyzer_Flow exit; // flow of the last instruction
+    u16 successors[2];
+    u8 successors_count;
+} Analyzer_Block;
+
+typedef enum {
+    ANALYZER_ISSUE_INVALID_OPCODE,  // error: the interpreter would fault or ignore it
+    ANALYZER_ISSUE_OUTSIDE_ROM,     // error: control flow leaves the loaded program
+    ANALYZER_ISSUE_COMPUTED_JUMP,   // warning: Bnnn, the code behind it isn't followed
+    ANALYZER_ISSUE_OVERLAP,         // warning: the same bytes decoded at two alignments
+} Analyzer_Issue_Kind;
+
+typedef struct {
+    Analyzer_Issue_Kind kind;
+    u16 addr;
+    u16 opcode;
+} Analyzer_Issue;
+
+// Static analysis of a ROM: every instruction reachable from 0x200 through
+// the jumps, calls, returns and skips is decoded, the reached bytes are code
+// and the rest of the program is data. Computed jumps (Bnnn) are not
+// followed, what they reach stays data.
+typedef struct {
+    Cpu_Mode mode;
+    u8* memory;             // CPU_MEMORY_SIZE bytes, the program at CPU_PROGRAM_ADDR
+    u8* map;                // CPU_MEMORY_SIZE ANALYZER_BYTE_* flags
+    u32 program_end;        // one past the last program byte
+
+    Analyzer_Block* blocks; // sorted by start
+    size_t blocks_count;
+    Analyzer_Issue* issues;
+    size_t issues_count;
+    size_t issues_capacity;
+
+    u32 instructions;
+    u32 code_bytes;
+    u32 data_bytes;
+    u32 errors;             // issues that are errors
+    bool valid;
+} Analyzer;
+
+Analyzer
+Analyzer_init(const u8* program, size_t program_size, Cpu_Mode mode);
+
+/// decodes the instruction at `addr` as `mode` runs it
+Analyzer_Instruction
+Analyzer_decode(const u8* memory, u16 addr, Cpu_Mode mode);
+
+/// writes the mnemonic of `instruction` (e.g. "DRW V1, V2, 5") to `buffer`
+void
+Analyzer_format(const Analyzer_Instruction* instruction, char* buffer, size_t size);
+
+bool
+Analyzer_is_code(const Analyzer* self, u16 addr);
+
+/// the block starting at `addr`, NULL if no block starts there
+const Analyzer_Block*
+Analyzer_block_at(const Analyzer* self, u16 addr);
+
+/// one line per issue
+void
+Analyzer_report(const Analyzer* self, FILE* out);
+
+/// disassembly of the code blocks, data as bytes, then the issues
+void
+Analyzer_dump(const Analyzer* self, FILE* out);
+
+void
+Analyzer_deinit(Analyzer* self);
+
+#endif // ANALYZER_H
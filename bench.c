@@ -0,0 +1,385 @@
+#include "upscaler.h"
+#include "renderer_frame.h"
+#include "env.h"
+#include "cpu.h"
+#include "keyboard.h"
+#include "speaker.h"
+#include "renderer.h"
+#include "utils/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#define BENCH_FRAMES    200
+#define BENCH_ENV_NS    (2 * CLOCK_NS_PER_SEC)  // per configuration
+#define BENCH_FUSION_FRAMES 3600
+#define BENCH_FUSION_SPEED  1000                // instructions per frame, the interpreter dominates
+#define BENCH_FUSION_REPEATS 5                  // the best run of each counts
+
+static void
+Bench__random_frame__(Renderer_Frame* frame, u32* seed);
+
+// average time per frame in microseconds
+static f64
+Bench__upscaler_run__(i32 scale, bool hires, Upscaler_Filter filter, Upscaler_Kernel kernel, bool full_redraw);
+
+static void
+Bench__upscaler__(void);
+
+// frames per second of all the environments together
+static f64
+Bench__env_run__(const u8* program, size_t program_size, u32 count, u32 threads);
+
+static bool
+Bench__env__(const char* rom_path);
+
+// instructions per second of the interpreter on one machine, with the
+// fusion on or off. `hashes` gets the state hash of every frame
+static f64
+Bench__fusion_run__(const u8* program, size_t program_size, Cpu_Mode mode, bool fusion, u64* hashes, FILE* stats);
+
+static bool
+Bench__fusion__(const char* rom_path, const char* mode);
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s upscaler | env <rom> | fusion <rom> [chip8|schip|xochip]\n", argv[0]);
+        return 1;
+    }
+
+    if(strcmp(argv[1], "upscaler") == 0)
+    {
+        Bench__upscaler__();
+        return 0;
+    }
+
+    if(strcmp(argv[1], "env") == 0 && argc == 3)
+    {
+        return Bench__env__(argv[2]) ? 0 : 1;
+    }
+
+    if(strcmp(argv[1], "fusion") == 0 && (argc == 3 || argc == 4))
+    {
+        return Bench__fusion__(argv[2], argc == 4 ? argv[3] : "chip8") ? 0 : 1;
+    }
+
+    fprintf(stderr, "%s: unknown benchmark %s\n", argv[0], argv[1]);
+    return 1;
+}
+
+void
+Bench__upscaler__(void)
+{
+    const i32 scales[] = { 10, 20, 30, 60 };     // 60 -> 3840x1920
+    const Upscaler_Filter filters[] = { UPSCALER_FILTER_NONE, UPSCALER_FILTER_SCALE2X };
+    const Upscaler_Kernel kernels[] = { UPSCALER_KERNEL_SCALAR, UPSCALER_KERNEL_SSE2, UPSCALER_KERNEL_AVX2 };
+
+    puts("scale  size       source  filter   kernel  full_us   typical_us");
+
+    for(size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); ++s)
+    {
+        for(int hires = 0; hires <= 1; ++hires)
+        {
+            for(size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); ++f)
+            {
+                for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+                {
+                    f64 full = Bench__upscaler_run__(scales[s], hires, filters[f], kernels[k], true);
+                    f64 typical = Bench__upscaler_run__(scales[s], hires, filters[f], kernels[k], false);
+
+                    printf("%-6d %4dx%-5d %-7s %-8s %-7s %-9.1f %.1f\n",
+                        scales[s],
+                        CANVAS_COLS * scales[s], CANVAS_ROWS * scales[s],
+                        hires ? "128x64" : "64x32",
+                        filters[f] == UPSCALER_FILTER_NONE ? "none" : "scale2x",
+                        Upscaler_kernel_name(kernels[k]),
+                        full,
+                        typical
+                    );
+                }
+            }
+        }
+    }
+}
+
+f64
+Bench__upscaler_run__(i32 scale, bool hires, Upscaler_Filter filter, Upscaler_Kernel kernel, bool full_redraw)
+{
+    Upscaler upscaler = Upscaler_init(CANVAS_COLS * scale, CANVAS_ROWS * scale, filter);
+    if(!upscaler.valid)
+    {
+        return 0;
+    }
+
+    Upscaler_set_kernel(&upscaler, kernel);
+
+    u32 seed = 0xC8;
+    Renderer_Frame frame = { .hires = hires };
+    const i32 cols = Renderer_Frame_cols(&frame);
+    const i32 rows = Renderer_Frame_rows(&frame);
+
+    Bench__random_frame__(&frame, &seed);
+    Upscaler_run(&upscaler, &frame.planes[0][0][0], cols, rows);
+
+    u64 start = Clock_now_ns();
+
+    for(int iii = 0; iii < BENCH_FRAMES; ++iii)
+    {
+        if(full_redraw)
+        {
+            Bench__random_frame__(&frame, &seed);
+        }
+        else
+        {
+            // a sprite moving over a static background touches a few rows
+            frame.planes[0][(iii * 3) % rows][0] ^= 0xFF00000000ULL;
+            frame.planes[0][(iii * 3 + 1) % rows][0] ^= 0xFF00000000ULL;
+        }
+
+        Upscaler_run(&upscaler, &frame.planes[0][0][0], cols, rows);
+    }
+
+    u64 elapsed = Clock_now_ns() - start;
+    Upscaler_deinit(&upscaler);
+
+    return (f64)elapsed / BENCH_FRAMES / CLOCK_NS_PER_US;
+}
+
+bool
+Bench__env__(const char* rom_path)
+{
+    FILE* file = fopen(rom_path, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Error: couldn't open %s\n", rom_path);
+        return false;
+    }
+
+    static u8 program[CPU_MEMORY_SIZE];
+    const size_t program_size = fread(program, 1, sizeof(program), file);
+    fclose(file);
+
+    const u32 counts[] = { 64, 1024, 4096 };
+    const u32 cpus = (u32)SDL_GetCPUCount();
+
+    puts("envs   threads  frames_per_s");
+
+    for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+    {
+        // 1, 2, 4... and all the CPUs
+        for(u32 threads = 1;; threads *= 2)
+        {
+            if(threads > cpus)
+            {
+                threads = cpus;
+            }
+
+            printf("%-6u %-8u %.0f\n", counts[c], threads, Bench__env_run__(program, program_size, counts[c], threads));
+
+            if(threads == cpus)
+            {
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+f64
+Bench__env_run__(const u8* program, size_t program_size, u32 count, u32 threads)
+{
+    Env_Options options = {
+        .count = count,
+        .speed = 15,
+        .mode = CPU_MODE_CHIP8,
+        .quirks = Cpu_default_quirks(CPU_MODE_CHIP8),
+        .seed = 1,
+        .threads = threads,
+        .max_frames = 60 * 60,
+    };
+
+    Env env = Env_init(program, program_size, options);
+    if(!env.valid || !Env_start(&env))
+    {
+        Env_deinit(&env);
+        return 0;
+    }
+
+    u16* actions = calloc(count, sizeof(u16));
+    u8* observations = malloc((size_t)count * ENV_OBSERVATION_SIZE);
+    f32* rewards = malloc(count * sizeof(f32));
+    u8* dones = malloc(count);
+
+    Env_reset(&env, observations);
+
+    // random keys, held for a few frames
+    u32 seed = 0xC8;
+    u64 steps = 0;
+    const u64 start = Clock_now_ns();
+    u64 elapsed = 0;
+    while(elapsed < BENCH_ENV_NS)
+    {
+        for(u32 iii = 0; iii < count; iii += 8)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            actions[iii] = (u16)(1 << (seed & 0xF));
+        }
+
+        Env_step(&env, actions, observations, rewards, dones);
+        steps++;
+        elapsed = Clock_now_ns() - start;
+    }
+
+    free(actions);
+    free(observations);
+    free(rewards);
+    free(dones);
+    Env_deinit(&env);
+
+    return (f64)(steps * count) * CLOCK_NS_PER_SEC / elapsed;
+}
+
+bool
+Bench__fusion__(const char* rom_path, const char* mode_name)
+{
+    Cpu_Mode mode = CPU_MODE_CHIP8;
+    if(strcmp(mode_name, "schip") == 0) mode = CPU_MODE_SCHIP;
+    else if(strcmp(mode_name, "xochip") == 0) mode = CPU_MODE_XOCHIP;
+    else if(strcmp(mode_name, "chip8") != 0)
+    {
+        fprintf(stderr, "Error: unknown mode %s\n", mode_name);
+        return false;
+    }
+
+    FILE* file = fopen(rom_path, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Error: couldn't open %s\n", rom_path);
+        return false;
+    }
+
+    static u8 program[CPU_MEMORY_SIZE];
+    const size_t program_size = fread(program, 1, sizeof(program), file);
+    fclose(file);
+
+    static u64 plain_hashes[BENCH_FUSION_FRAMES];
+    static u64 fused_hashes[BENCH_FUSION_FRAMES];
+    // alternated, so both see the same machine load
+    f64 plain = 0;
+    f64 fused = 0;
+    for(u32 repeat = 0; repeat < BENCH_FUSION_REPEATS; repeat++)
+    {
+        const bool last = repeat + 1 == BENCH_FUSION_REPEATS;
+        const f64 plain_run = Bench__fusion_run__(program, program_size, mode, false, plain_hashes, NULL);
+        const f64 fused_run = Bench__fusion_run__(program, program_size, mode, true, fused_hashes, last ? stdout : NULL);
+        plain = plain_run > plain ? plain_run : plain;
+        fused = fused_run > fused ? fused_run : fused;
+    }
+
+    printf("plain  %.1f M instructions/s\n", plain / 1e6);
+    printf("fused  %.1f M instructions/s (%+.1f%%)\n", fused / 1e6, plain > 0 ? 100.0 * (fused / plain - 1) : 0);
+
+    for(u32 frame = 0; frame < BENCH_FUSION_FRAMES; frame++)
+    {
+        if(plain_hashes[frame] != fused_hashes[frame])
+        {
+            printf("the states differ from frame %u\n", frame);
+            return false;
+        }
+    }
+
+    printf("same states on the %u frames\n", BENCH_FUSION_FRAMES);
+    return true;
+}
+
+f64
+Bench__fusion_run__(const u8* program, size_t program_size, Cpu_Mode mode, bool fusion, u64* hashes, FILE* stats)
+{
+    Keyboard keyboard = Keyboard_init();
+    Speaker speaker = Speaker_init_silent();
+    Renderer renderer = Renderer_init();
+    Cpu cpu = Cpu_init(&renderer, &keyboard, &speaker, BENCH_FUSION_SPEED, mode, Cpu_default_quirks(mode));
+    if(!cpu.valid)
+    {
+        return 0;
+    }
+
+    Cpu_seed(&cpu, 1);
+    Cpu_load_program(&cpu, (u8*)program, program_size);
+    Cpu_set_fusion(&cpu, fusion);
+
+    // the same random keys for both runs, held for a few frames
+    u32 seed = 0xC8;
+    u64 instructions = 0;
+    u64 elapsed = 0;
+    memset(hashes, 0, BENCH_FUSION_FRAMES * sizeof(u64));
+    for(u32 frame = 0; frame < BENCH_FUSION_FRAMES && !cpu.exited; frame++)
+    {
+        if(frame % 8 == 0)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            Keyboard_set_keys(&keyboard, (u16)(1 << (seed & 0xF)));
+        }
+
+        const u64 start = Clock_now_ns();
+        const u64 interpreted = cpu.interpreted;
+        const bool ok = Cpu_run_frame(&cpu);
+        elapsed += Clock_now_ns() - start;
+        instructions += cpu.interpreted - interpreted;
+
+        hashes[frame] = Cpu_state_hash(&cpu);
+        if(!ok)
+        {
+            break;
+        }
+    }
+
+    if(stats)
+    {
+        Cpu_print_fusion_stats(&cpu, stats);
+    }
+
+    Cpu_deinit(&cpu);
+    Renderer_deinit(&renderer);
+    Keyboard_deinit(&keyboard);
+    return elapsed ? (f64)instructions * CLOCK_NS_PER_SEC / elapsed : 0;
+}
+
+void
+Bench__random_frame__(Renderer_Frame* frame, u32* seed)
+{
+    const i32 cols = Renderer_Frame_cols(frame);
+    const i32 rows = Renderer_Frame_rows(frame);
+
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        for(int row = 0; row < rows; ++row)
+        {
+            for(int word = 0; word < cols / 64; ++word)
+            {
+                u64 bits = 0;
+
+                for(int part = 0; part < 4; ++part)
+                {
+                    // xorshift32
+                    *seed ^= *seed << 13;
+                    *seed ^= *seed >> 17;
+                    *seed ^= *seed << 5;
+                    bits = (bits << 16) | (*seed & 0xFFFF);
+                }
+
+                frame->planes[plane][row][word] = bits;
+            }
+        }
+    }
+}
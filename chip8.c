@@ -1,36 +1,88 @@
 #include "chip8.h"
+#include "utils/clock.h"
 
-#include <sys/time.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <signal.h>
+
+// the effective speed is measured over that, and shown in the window title
+#define CHIP8_SPEED_REPORT_NS   (500 * CLOCK_NS_PER_MS)
+
+// --bench-startup gives up on the window or the audio after that
+#define CHIP8_BENCH_STARTUP_TIMEOUT_NS  (5 * CLOCK_NS_PER_SEC)
+
+// idle, the loop still wakes up that often without any event
+#define CHIP8_IDLE_WAIT_MS      1000
+
+// the steps of the '=' and '-' hotkeys
+static const f64 CHIP8_SPEED_STEPS[] = { 0.25, 0.5, 1, 2, 4, 8, 16, CHIP8_SPEED_UNCAPPED };
+#define CHIP8_SPEED_STEPS_COUNT (sizeof(CHIP8_SPEED_STEPS) / sizeof(CHIP8_SPEED_STEPS[0]))
+
+// the one ^C stops, a signal handler only gets globals
+static Debugger* Chip8__interrupted__ = NULL;
 
 typedef struct {
     u8* data;
     size_t size;
 } Chip8__Rom__;
 
-static Chip8__Rom__
-Chip8__load_rom__(Chip8* self, String rom_path);
-
-static u64
-__time_ms__(void);
+static bool
+Chip8__load_rom__(String rom_path, Chip8__Rom__* rom);
 
 static void
 Chip8__on_quit__(void* arg);
 
+static u16
+Chip8__local_keys__(Chip8* self);
+
+static bool
+Chip8__netplay_cycle__(Chip8* self);
+
+static bool
+Chip8__cycle__(Chip8* self);
+
+static bool
+Chip8__run_frame__(Chip8* self);
+
+static void
+Chip8__on_interrupt__(int signal);
+
+static void
+Chip8__hotkeys__(Chip8* self);
+
+static void
+Chip8__apply_speed__(Chip8* self);
+
+static void
+Chip8__measure_speed__(Chip8* self);
+
+static bool
+Chip8__idle__(const Chip8* self);
+
+static bool
+Chip8__start_devices__(Chip8* self);
+
+static bool
+Chip8__startup_done__(const Chip8* self);
+
+static void
+Chip8__wait_event__(Chip8* self);
+
 Chip8
-Chip8_init(String rom_path, u8 screen_scale, u8 speed)
+Chip8_init(String rom_path, Chip8_Options options)
 {
     Chip8 chip8 = {};
 
+    chip8.start_ns = options.start_ns ? options.start_ns : Clock_now_ns();
+    chip8.bench_startup = options.bench_startup;
     chip8.fps = 60;
-    chip8.fps_interval = 1000 / chip8.fps;
+    chip8.jitter_report_path = options.jitter_report_path;
+    chip8.headless = options.headless;
+    chip8.max_frames = options.max_frames;
+    chip8.verify_hash = options.verify_hash;
+    chip8.frames = 0;
     chip8.is_running = true;
 
-    u64 start_time = __time_ms__();
-    chip8.past_time = chip8.start_time;
-    chip8.now = chip8.start_time;
-
     chip8.keyboard = malloc(sizeof(Keyboard));
     chip8.renderer = malloc(sizeof(Renderer));
     chip8.speaker = malloc(sizeof(Speaker));
@@ -41,28 +93,481 @@ Chip8_init(String rom_path, u8 screen_scale, u8 speed)
         return chip8;
     }
 
+    // analyzed before anything is opened, so a bad ROM is refused right away
+    Chip8__Rom__ rom = {};
+    if(!Chip8__load_rom__(rom_path, &rom))
+    {
+        chip8.valid = false;
+        return chip8;
+    }
+
+    chip8.analysis = Analyzer_init(rom.data, rom.size, options.mode);
+    if(!chip8.analysis.valid)
+    {
+        free(rom.data);
+        chip8.valid = false;
+        return chip8;
+    }
+
+    Analyzer_report(&chip8.analysis, stderr);
+    if(options.strict && chip8.analysis.errors > 0)
+    {
+        fprintf(stderr, "Error: %s: %u errors found by the static analysis\n", rom_path.data, chip8.analysis.errors);
+        free(rom.data);
+        chip8.valid = false;
+        return chip8;
+    }
+
     *chip8.keyboard = Keyboard_init();
-    *chip8.renderer = Renderer_init(screen_scale);
-    *chip8.speaker = Speaker_init();
-    chip8.cpu = Cpu_init(chip8.renderer, chip8.keyboard, chip8.speaker, speed);
 
-    Chip8__Rom__ rom = Chip8__load_rom__(&chip8, rom_path);
+    // hires pixels are half the lores ones, so the scale has to stay even
+    if(options.mode != CPU_MODE_CHIP8 && options.screen_scale % 2)
+    {
+        options.screen_scale++;
+    }
+
+    if(chip8.headless)
+    {
+        *chip8.renderer = Renderer_init();
+        *chip8.speaker = Speaker_init_silent();
+    }
+    else
+    {
+        // a wall of one, the window opens after the first frame
+        chip8.display = malloc(sizeof(Display));
+        if(!chip8.display)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        *chip8.display = Display_init(1, options.screen_scale, options.vsync, options.filter);
+        *chip8.renderer = Renderer_init();
+        Renderer_set_display(chip8.renderer, chip8.display, 0);
+        *chip8.speaker = Speaker_init(options.audio_buffer, chip8.fps);
+    }
+
+    if(options.wav_path && !Speaker_record(chip8.speaker, options.wav_path, chip8.fps))
+    {
+        chip8.valid = false;
+        return chip8;
+    }
+
+    if(options.record_path)
+    {
+        FrameSink_Format format;
+        if(!FrameSink_format_from_path(options.record_path, &format))
+        {
+            fprintf(stderr, "Error: unknown recording format %s\n", options.record_path);
+            chip8.valid = false;
+            return chip8;
+        }
+
+        chip8.sink = malloc(sizeof(FrameSink));
+        if(!chip8.sink)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        *chip8.sink = FrameSink_init(
+            options.record_path,
+            format,
+            options.screen_scale,
+            options.record_every ? options.record_every : 1
+        );
+
+        if(!FrameSink_start(chip8.sink))
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        Renderer_set_sink(chip8.renderer, chip8.sink);
+    }
+
+    if(options.stream_path)
+    {
+        chip8.server = malloc(sizeof(FrameServer));
+        if(!chip8.server)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        *chip8.server = FrameServer_init(options.stream_path);
+        if(!chip8.server->valid)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        Renderer_set_server(chip8.renderer, chip8.server);
+    }
+
+    chip8.cpu = Cpu_init(chip8.renderer, chip8.keyboard, chip8.speaker, options.speed, options.mode, options.quirks);
 
     Cpu_load_program(&chip8.cpu, rom.data, rom.size);
     free(rom.data);
 
+    if(options.seed)
+    {
+        Cpu_seed(&chip8.cpu, options.seed);
+    }
+
+    if(options.no_fusion)
+    {
+        Cpu_set_fusion(&chip8.cpu, false);
+    }
+
+    if(options.replay_path)
+    {
+        chip8.replay = Replay_load(options.replay_path);
+        if(!chip8.replay.valid)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+    }
+
+    if(options.compiled)
+    {
+        Cpu_attach_compiled(&chip8.cpu, options.compiled);
+    }
+
+    if(options.export_name)
+    {
+        chip8.state_export = StateExport_create(options.export_name);
+        if(!chip8.state_export.valid)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+    }
+
+    if(options.netplay_path)
+    {
+        chip8.netplay = malloc(sizeof(Netplay));
+        if(!chip8.netplay)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        *chip8.netplay = Netplay_init(options.netplay_role, options.netplay_path, &chip8.cpu, options.netplay_report_path);
+        if(!chip8.netplay->valid)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+    }
+
+    if(options.debug)
+    {
+        if(chip8.netplay)
+        {
+            fputs("Error: the debugger doesn't work with netplay\n", stderr);
+            chip8.valid = false;
+            return chip8;
+        }
+
+        chip8.debugger = malloc(sizeof(Debugger));
+        if(!chip8.debugger)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        *chip8.debugger = Debugger_init();
+        if(!chip8.debugger->valid)
+        {
+            chip8.valid = false;
+            return chip8;
+        }
+
+        Debugger_attach(chip8.debugger, &chip8.cpu);
+        Debugger_interrupt(chip8.debugger);
+        Chip8__interrupted__ = chip8.debugger;
+        signal(SIGINT, Chip8__on_interrupt__);
+    }
+
+    // created last, so the first deadline doesn't include the startup time.
+    // presentation runs on the render thread, so the emulation is always
+    // paced here even with vsync
+    chip8.pacer = Pacer_init(chip8.fps);
+    chip8.speed = 1;
+    chip8.effective_speed = 1;
+    chip8.speed_since_ns = Clock_now_ns();
+
     chip8.valid = true;
+    if(options.speed_multiplier != 0 && !Chip8_set_speed(&chip8, options.speed_multiplier))
+    {
+        chip8.valid = false;
+    }
     return chip8;
 }
 
-void
+bool
+Chip8_disassemble(String rom_path, Chip8_Options options)
+{
+    Chip8__Rom__ rom = {};
+    if(!Chip8__load_rom__(rom_path, &rom))
+    {
+        return false;
+    }
+
+    Analyzer analysis = Analyzer_init(rom.data, rom.size, options.mode);
+    free(rom.data);
+
+    if(!analysis.valid)
+    {
+        return false;
+    }
+
+    Analyzer_dump(&analysis, stdout);
+
+    bool ok = analysis.errors == 0;
+    Analyzer_deinit(&analysis);
+    return ok;
+}
+
+bool
+Chip8_lockstep(String rom_path, Chip8_Options options)
+{
+    Chip8__Rom__ rom = {};
+    if(!Chip8__load_rom__(rom_path, &rom))
+    {
+        return false;
+    }
+
+    // the blocks tell where a block granularity step ends
+    Analyzer analysis = Analyzer_init(rom.data, rom.size, options.mode);
+    if(!analysis.valid)
+    {
+        free(rom.data);
+        return false;
+    }
+
+    Replay replay = {};
+    if(options.replay_path)
+    {
+        replay = Replay_load(options.replay_path);
+        if(!replay.valid)
+        {
+            Analyzer_deinit(&analysis);
+            free(rom.data);
+            return false;
+        }
+    }
+
+    Lockstep_Options lockstep = {
+        .granularity = options.lockstep,
+        .frames = options.max_frames ? options.max_frames : 60 * 60,
+        .speed = options.speed,
+        .mode = options.mode,
+        .quirks = options.quirks,
+        .seed = options.seed,
+        .compiled = options.compiled,
+        .replay = replay.valid ? &replay : NULL,
+    };
+
+    bool agree = Lockstep_run(rom.data, rom.size, &analysis, lockstep, stdout);
+
+    Replay_deinit(&replay);
+    Analyzer_deinit(&analysis);
+    free(rom.data);
+    return agree;
+}
+
+bool
+Chip8_wall(String rom_path, Chip8_Options options)
+{
+    Chip8__Rom__ rom = {};
+    if(!Chip8__load_rom__(rom_path, &rom))
+    {
+        return false;
+    }
+
+    // hires pixels are half the lores ones, so the scale has to stay even
+    if(options.mode != CPU_MODE_CHIP8 && options.screen_scale % 2)
+    {
+        options.screen_scale++;
+    }
+
+    Wall_Options wall_options = {
+        .count = options.wall,
+        .speed = options.speed,
+        .mode = options.mode,
+        .quirks = options.quirks,
+        .seed = options.seed,
+        .scale = options.screen_scale,
+        .vsync = options.vsync,
+        .filter = options.filter,
+        .fps = 60,
+        .max_frames = options.max_frames,
+        .compiled = options.compiled,
+        .no_fusion = options.no_fusion,
+    };
+
+    Wall wall = Wall_init(rom.data, rom.size, wall_options);
+    free(rom.data);
+    if(!wall.valid)
+    {
+        return false;
+    }
+
+    bool ok = Wall_run(&wall);
+
+    Wall_deinit(&wall);
+    SDL_Quit();
+    return ok;
+}
+
+u64
+Chip8_state_hash(const Chip8* self)
+{
+    return Cpu_state_hash(&self->cpu);
+}
+
+bool
+Chip8_set_speed(Chip8* self, f64 multiplier)
+{
+    if(!self || !self->valid)
+    {
+        return false;
+    }
+
+    if(self->netplay && multiplier != 1)
+    {
+        fputs("Error: netplay only runs at 1x\n", stderr);
+        return false;
+    }
+
+    self->speed = multiplier < CHIP8_SPEED_MIN ? CHIP8_SPEED_MIN : multiplier;
+    Chip8__apply_speed__(self);
+    return true;
+}
+
+f64
+Chip8_effective_speed(const Chip8* self)
+{
+    return self->effective_speed;
+}
+
+bool
 Chip8_mainloop(Chip8* self)
 {
+    self->first_instruction_ns = Clock_now_ns();
+
     while(!self->keyboard->quit_pressed)
     {
-        Cpu_cycle(&self->cpu);
-        SDL_Delay(self->fps_interval);
+        if((self->replay.valid || self->server) && !self->netplay)
+        {
+            Keyboard_set_keys(self->keyboard, Chip8__local_keys__(self));
+        }
+
+        bool ok = self->netplay ? Chip8__netplay_cycle__(self) : Chip8__cycle__(self);
+        if(!ok)
+        {
+            // netplay also stops when the other player leaves or desyncs
+            if(self->cpu.error != CPU_NO_ERROR)
+            {
+                fprintf(
+                    stderr,
+                    "Error: CPU: %s at 0x%03X (opcode %04X) after %llu frames\n",
+                    Cpu_error_name(self->cpu.error),
+                    self->cpu.fault_pc,
+                    self->cpu.fault_opcode,
+                    (unsigned long long)self->frames
+                );
+            }
+            return false;
+        }
+        self->frames++;
+        Chip8__measure_speed__(self);
+
+        if(!self->devices_started && !Chip8__start_devices__(self))
+        {
+            return false;
+        }
+
+        if(self->bench_startup && Chip8__startup_done__(self))
+        {
+            break;
+        }
+
+        if(self->state_export.valid)
+        {
+            StateExport_publish(&self->state_export, &self->cpu, self->frames);
+        }
+
+        if(self->verify_hash && Chip8_state_hash(self) != Cpu_state_hash_full(&self->cpu))
+        {
+            fprintf(stderr, "Error: the state hash went wrong in frame %llu\n", (unsigned long long)self->frames);
+            return false;
+        }
+
+        if(self->cpu.exited)
+        {
+            break;
+        }
+
+        // nothing but a reset gets out of a jump to itself, without a
+        // window nobody can quit, so stop here
+        if(self->cpu.halted && self->headless)
+        {
+            fprintf(stderr, "halted: jump to itself at 0x%03X after %llu frames\n", self->cpu.pc, (unsigned long long)self->frames);
+            break;
+        }
+
+        if(self->max_frames && self->frames >= self->max_frames)
+        {
+            break;
+        }
+
+        if(self->headless)
+        {
+            continue;
+        }
+
+        if(Chip8__idle__(self))
+        {
+            Chip8__wait_event__(self);
+        }
+        else
+        {
+            Pacer_wait(&self->pacer);
+        }
+    }
+
+    if(self->server)
+    {
+        FrameServer_print_stats(self->server, stderr);
+    }
+
+    Speaker_print_stats(self->speaker, stderr);
+
+    if(self->netplay)
+    {
+        // the last frames may have run with guessed keys
+        bool ok = Netplay_finish(self->netplay, &self->cpu);
+        Netplay_print_stats(self->netplay, stderr);
+        if(!ok)
+        {
+            return false;
+        }
+        Cpu_present(&self->cpu);
     }
+
+    if(self->verify_hash)
+    {
+        printf("state hash %016llX after %llu frames, checked every frame\n",
+            (unsigned long long)Chip8_state_hash(self),
+            (unsigned long long)self->frames
+        );
+    }
+
+    return true;
 }
 
 void
@@ -73,9 +578,56 @@ Chip8_deinit(Chip8* self)
         return;
     }
 
+    if(self->jitter_report_path)
+    {
+        Pacer_export(&self->pacer, self->jitter_report_path);
+    }
+    Pacer_deinit(&self->pacer);
+
     Keyboard_deinit(self->keyboard);
+    if(self->display)
+    {
+        // first, its thread reads the frames of the renderer
+        Display_deinit(self->display);
+        free(self->display);
+    }
     Renderer_deinit(self->renderer);
+
+    if(self->sink)
+    {
+        // after the renderer, so no frame is pushed while it drains
+        FrameSink_deinit(self->sink);
+        free(self->sink);
+    }
+
+    if(self->server)
+    {
+        FrameServer_deinit(self->server);
+        free(self->server);
+    }
+
+    if(self->netplay)
+    {
+        Netplay_deinit(self->netplay);
+        free(self->netplay);
+    }
+
+    if(self->state_export.valid)
+    {
+        StateExport_deinit(&self->state_export);
+    }
+
+    if(self->debugger)
+    {
+        signal(SIGINT, SIG_DFL);
+        Chip8__interrupted__ = NULL;
+        Debugger_deinit(self->debugger);
+        free(self->debugger);
+    }
+
     Speaker_deinit(self->speaker);
+    Analyzer_deinit(&self->analysis);
+    Replay_deinit(&self->replay);
 
     free(self->keyboard);
     free(self->renderer);
@@ -87,15 +639,6 @@ Chip8_deinit(Chip8* self)
 
 
 // Private functions
-static u64
-__time_ms__(void)
-{
-    struct timeval tv;
-
-    gettimeofday(&tv, NULL);
-    return (((u64)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
-}
-
 void
 Chip8__on_quit__(void* arg)
 {
@@ -106,45 +649,327 @@ Chip8__on_quit__(void* arg)
     ((Chip8*)arg)->is_running = false;
 }
 
-Chip8__Rom__
-Chip8__load_rom__(Chip8* self, String rom_path)
+u16
+Chip8__local_keys__(Chip8* self)
 {
-    Chip8__Rom__ rom = {};
+    u16 keys = self->replay.valid ? Replay_keys(&self->replay, self->frames) : Keyboard_keys(self->keyboard);
+
+    // the viewers press and release keys like a second keyboard would
+    if(self->server)
+    {
+        const u16 viewer_keys = FrameServer_keys(self->server);
+        keys = (keys & ~(self->viewer_keys & ~viewer_keys)) | viewer_keys;
+        self->viewer_keys = viewer_keys;
+    }
+
+    return keys;
+}
+
+bool
+Chip8__netplay_cycle__(Chip8* self)
+{
+    // the window keyboard only gives the local keys, the cpu gets both
+    // players' from Netplay
+    Keyboard_run(self->keyboard);
+
+    if(!Netplay_advance(self->netplay, &self->cpu, Chip8__local_keys__(self)))
+    {
+        return false;
+    }
+
+    Cpu_present(&self->cpu);
+    return true;
+}
+
+bool
+Chip8__cycle__(Chip8* self)
+{
+    bool ok = Chip8__run_frame__(self);
 
+    Keyboard_run(self->keyboard);
+    Chip8__hotkeys__(self);
+
+    // faster than the display: one frame per refresh is shown, the others
+    // only go to the recording
+    if(!self->headless && (self->pacer.speed <= 0 || self->pacer.speed > 1))
+    {
+        const u64 now = Clock_now_ns();
+        if(now < self->present_ns)
+        {
+            Cpu_present_sound(&self->cpu);
+            Renderer_skip(self->renderer);
+            return ok;
+        }
+
+        self->present_ns += self->pacer.base_period_ns;
+        if(self->present_ns < now)
+        {
+            self->present_ns = now + self->pacer.base_period_ns;
+        }
+    }
+
+    Cpu_present(&self->cpu);
+    return ok;
+}
+
+// the instrumented loop of the debugger only while it has something to do
+bool
+Chip8__run_frame__(Chip8* self)
+{
+    if(!self->debugger || !Debugger_armed(self->debugger))
+    {
+        return Cpu_run_frame(&self->cpu);
+    }
+
+    while(Debugger_run_frame(self->debugger, &self->cpu) != DEBUGGER_FRAME_DONE)
+    {
+        // no frame comes while in the console, the audio would only run dry
+        const bool muted = self->speaker->muted;
+        Speaker_mute(self->speaker, true);
+        const bool ok = Debugger_console(self->debugger, &self->cpu, stdin, stdout);
+        Speaker_mute(self->speaker, muted);
+        if(!ok)
+        {
+            self->keyboard->quit_pressed = true;
+            break;
+        }
+
+        // the time spent in the console isn't late
+        Pacer_set_speed(&self->pacer, self->pacer.speed);
+    }
+
+    return self->cpu.error == CPU_NO_ERROR;
+}
+
+void
+Chip8__on_interrupt__(int signal)
+{
+    (void)signal;
+    if(Chip8__interrupted__)
+    {
+        Debugger_interrupt(Chip8__interrupted__);
+    }
+}
+
+void
+Chip8__hotkeys__(Chip8* self)
+{
+    const Keyboard_Hotkeys hotkeys = Keyboard_hotkeys(self->keyboard);
+    if(self->netplay)
+    {
+        return;
+    }
+
+    if(hotkeys.speed_reset)
+    {
+        Chip8_set_speed(self, 1);
+    }
+
+    if(hotkeys.speed_steps != 0)
+    {
+        // from the step at or below the current speed
+        i32 step = 0;
+        while(step + 1 < (i32)CHIP8_SPEED_STEPS_COUNT && CHIP8_SPEED_STEPS[step + 1] <= self->speed)
+        {
+            step++;
+        }
+
+        step += hotkeys.speed_steps;
+        if(step < 0) step = 0;
+        if(step >= (i32)CHIP8_SPEED_STEPS_COUNT) step = CHIP8_SPEED_STEPS_COUNT - 1;
+        Chip8_set_speed(self, CHIP8_SPEED_STEPS[step]);
+    }
+
+    if(hotkeys.fast_forward != self->fast_forward)
+    {
+        self->fast_forward = hotkeys.fast_forward;
+        Chip8__apply_speed__(self);
+    }
+}
+
+void
+Chip8__apply_speed__(Chip8* self)
+{
+    const f64 speed = self->fast_forward ? CHIP8_SPEED_UNCAPPED : self->speed;
+
+    Pacer_set_speed(&self->pacer, isinf(speed) ? 0 : speed);
+    Speaker_set_speed(self->speaker, speed);
+    Speaker_mute(self->speaker, speed > 1);
+    self->present_ns = Clock_now_ns();
+
+    // the measure restarts with the new speed
+    self->speed_since_ns = Clock_now_ns();
+    self->speed_since_frames = self->frames;
+}
+
+void
+Chip8__measure_speed__(Chip8* self)
+{
+    const u64 now = Clock_now_ns();
+    if(now - self->speed_since_ns < CHIP8_SPEED_REPORT_NS)
+    {
+        return;
+    }
+
+    const f64 seconds = (f64)(now - self->speed_since_ns) / CLOCK_NS_PER_SEC;
+    self->effective_speed = (f64)(self->frames - self->speed_since_frames) / self->fps / seconds;
+    self->speed_since_ns = now;
+    self->speed_since_frames = self->frames;
+
+    const f64 speed = self->fast_forward ? CHIP8_SPEED_UNCAPPED : self->speed;
+    char title[64];
+    if(isinf(speed))
+    {
+        snprintf(title, sizeof(title), "Chip 8 - uncapped (%.2fx)", self->effective_speed);
+    }
+    else
+    {
+        snprintf(title, sizeof(title), "Chip 8 - %gx (%.2fx)", speed, self->effective_speed);
+    }
+    Display_set_title(self->display, title);
+}
+
+// waiting for a key (Fx0A), or in a jump to itself with the timers
+// stopped: nothing changes until an event comes. Whatever needs every frame
+// (the other player, the viewers, a recording, a replay...) keeps the loop
+// running
+bool
+Chip8__idle__(const Chip8* self)
+{
+    const Cpu* cpu = &self->cpu;
+
+    if(self->netplay || self->server || self->sink || self->replay.valid ||
+       self->debugger || self->max_frames || cpu->sound_timer > 0)
+    {
+        return false;
+    }
+
+    // the timers don't run while paused
+    return cpu->paused || (cpu->halted && cpu->delay_timer == 0);
+}
+
+// sleeps in SDL instead of running empty frames, a key comes back right away
+void
+Chip8__wait_event__(Chip8* self)
+{
+    const bool muted = self->speaker->muted;
+    Speaker_mute(self->speaker, true);
+
+    Keyboard_wait(self->keyboard, CHIP8_IDLE_WAIT_MS);
+
+    // the time spent waiting isn't late
+    Speaker_mute(self->speaker, muted);
+    Chip8__apply_speed__(self);
+}
+
+// after the first frame, so the program runs before anything is opened.
+// The window opens here, the audio on its own thread: the video subsystem
+// is up before that one starts, they are never initialized at once
+bool
+Chip8__start_devices__(Chip8* self)
+{
+    self->devices_started = true;
+
+    if(self->display && !Display_start(self->display))
+    {
+        fputs("Error: the window couldn't be opened\n", stderr);
+        return false;
+    }
+
+    // without a device the sound just stays off
+    Speaker_start(self->speaker);
+
+    // the time spent opening isn't late
+    Chip8__apply_speed__(self);
+    return true;
+}
+
+// --bench-startup: the first frame is on the screen and the audio device
+// is open (or failed), prints the times
+bool
+Chip8__startup_done__(const Chip8* self)
+{
+    // headless, the first frame is done when this is first called
+    const u64 frame_ns = self->display ? atomic_load(&self->display->first_present_ns) : Clock_now_ns();
+    const u64 audio_ns = atomic_load(&self->speaker->ready_ns);
+    const bool audio_done = self->speaker->silent || audio_ns || atomic_load(&self->speaker->failed);
+    const bool timeout = Clock_now_ns() - self->start_ns > CHIP8_BENCH_STARTUP_TIMEOUT_NS;
+    if(!(frame_ns && audio_done) && !timeout)
+    {
+        return false;
+    }
+
+    printf("startup: first instruction after %.3f ms", (f64)(self->first_instruction_ns - self->start_ns) / CLOCK_NS_PER_MS);
+    if(frame_ns)
+    {
+        printf(", first frame after %.3f ms", (f64)(frame_ns - self->start_ns) / CLOCK_NS_PER_MS);
+    }
+    else
+    {
+        printf(", no frame shown");
+    }
+    if(audio_ns)
+    {
+        printf(", audio ready after %.3f ms", (f64)(audio_ns - self->start_ns) / CLOCK_NS_PER_MS);
+    }
+    else
+    {
+        printf(", no audio device");
+    }
+    printf(" (%llu frames)\n", (unsigned long long)self->frames);
+
+    return true;
+}
+
+// prints why and returns false if the ROM can't be read, `rom->data` is
+// malloc'd
+bool
+Chip8__load_rom__(String rom_path, Chip8__Rom__* rom)
+{
     if(rom_path.len == 0)
     {
-        fputs("Error: CPU: error loading rom_file", stderr);
-        abort();
+        fputs("Error: CPU: error loading rom_file\n", stderr);
+        return false;
     }
 
     FILE* rom_file = fopen(rom_path.data, "rb");
     if(!rom_file)
     {
         fprintf(stderr, "Couldn't open %s\n", rom_path.data);
-        abort();
+        return false;
     }
 
     // obtain file size:
     fseek (rom_file , 0 , SEEK_END);
-    rom.size = ftell (rom_file);
+    long size = ftell (rom_file);
     rewind (rom_file);
 
     // allocate memory to contain the whole file:
-    rom.data = (u8*) malloc (sizeof(char) * rom.size);
-    if (rom.data == NULL)
+    rom->data = size >= 0 ? (u8*) malloc (sizeof(char) * (size > 0 ? size : 1)) : NULL;
+    if (rom->data == NULL)
     {
-        fputs("Couldn't allocate memory for the program", stderr);
-        abort();
+        fputs("Couldn't allocate memory for the program\n", stderr);
+        fclose(rom_file);
+        return false;
     }
 
-    rom.size = fread(
-        rom.data,
+    rom->size = fread(
+        rom->data,
         sizeof(u8),
-        rom.size,
+        size,
         rom_file
     );
 
+    bool ok = !ferror(rom_file);
     fclose(rom_file);
 
-    return rom;
+    if(!ok)
+    {
+        fprintf(stderr, "Couldn't read %s\n", rom_path.data);
+        free(rom->data);
+        rom->data = NULL;
+        return false;
+    }
+
+    return true;
 }
\ No newline at end of file
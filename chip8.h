@@ -4,31 +4,164 @@
 #include "utils/type_alias.h"
 
 #include <stdbool.h>
+#include <math.h>
 
 #include "cpu.h"
 #include "keyboard.h"
 #include "speaker.h"
 #include "renderer.h"
+#include "pacer.h"
+#include "analyzer.h"
+#include "replay.h"
+#include "lockstep.h"
+#include "wall.h"
+#include "netplay.h"
+#include "stateexport.h"
+#include "debugger.h"
 #include "utils/string.h"
 
+// Chip8_set_speed: no frame pacing at all
+#define CHIP8_SPEED_UNCAPPED    INFINITY
+#define CHIP8_SPEED_MIN         0.25
+
+typedef struct {
+    u8 screen_scale;
+    // instructions per frame
+    u32 speed;
+    Cpu_Mode mode;
+    Cpu_Quirks quirks;
+    bool vsync;
+    Upscaler_Filter filter;
+    // if set, the frame time jitter histogram is written there on deinit
+    const char* jitter_report_path;
+    // no window, no audio and no frame pacing, runs as fast as it can
+    bool headless;
+    // stop after that many frames, 0 runs until quit
+    u64 max_frames;
+    // if set, the frames are recorded there (video or snapshots, see FrameSink)
+    const char* record_path;
+    // snapshots: keep one frame every `record_every` frames
+    u32 record_every;
+    // refuse the ROM when the static analysis finds errors, instead of warning
+    bool strict;
+    // the ROM translated to C by chip8-recompile, NULL to interpret it
+    const Cpu_Compiled* compiled;
+    // interpret one instruction at a time, without the fused sequences
+    // (see Cpu_set_fusion)
+    bool no_fusion;
+    // seed of the random numbers (Cxkk), 0 for a different run every time
+    u32 seed;
+    // if set, the keys are played back from there (see Replay)
+    const char* replay_path;
+    // Chip8_lockstep: how often the engines are compared
+    Lockstep_Granularity lockstep;
+    // Chip8_wall: how many instances share the window
+    u32 wall;
+    // recompute the state hash from scratch every frame and check it
+    bool verify_hash;
+    // if set, the game is shared with another instance over this Unix socket
+    const char* netplay_path;
+    Netplay_Role netplay_role;
+    // netplay: if set, the resimulation cost of every frame is written there
+    const char* netplay_report_path;
+    // if set, the frames are streamed there and the viewers' keys are
+    // pressed (see FrameServer)
+    const char* stream_path;
+    // if set, the state is exported every frame to that shared memory object
+    const char* export_name;
+    // multiplier of the frame rate at start, 0 for 1x (see Chip8_set_speed)
+    f64 speed_multiplier;
+    // stop before the first instruction in the debugger console (stdin),
+    // ^C stops again
+    bool debug;
+    // samples the audio device asks for at once, 0 for AUDIO_BUFFER
+    u32 audio_buffer;
+    // if set, the sound is also written there as a WAV file, in emulated
+    // time (see Speaker_record)
+    const char* wav_path;
+    // Clock_now_ns when the process started, the startup times count from
+    // there, 0 for Chip8_init
+    u64 start_ns;
+    // stop once the first frame is shown and the audio is ready, and print
+    // how long it took
+    bool bench_startup;
+} Chip8_Options;
+
 typedef struct {
     u8 fps;
-    u32 fps_interval;
-    u64 start_time;
-    u64 past_time;
-    u64 now;
+    Pacer pacer;
+    const char* jitter_report_path;
+    bool headless;
+    u64 frames;
+    u64 max_frames;
+    FrameSink* sink;
+    FrameServer* server;
+    u16 viewer_keys;        // held by the stream viewers, last frame
+    StateExport state_export;   // valid when exported
+    Analyzer analysis;
+    Replay replay;          // valid when the keys are played back
+    bool verify_hash;
+    Netplay* netplay;       // NULL when playing alone
+    Debugger* debugger;     // NULL unless debugging
+    f64 speed;              // multiplier of the frame rate, see Chip8_set_speed
+    bool fast_forward;      // tab held: uncapped until it's released
+    u64 present_ns;         // faster than 1x: when the next frame is shown
+    u64 speed_since_ns;     // the effective speed is measured from there
+    u64 speed_since_frames;
+    f64 effective_speed;    // measured, see Chip8_effective_speed
+    bool devices_started;   // the window and the audio, after the first frame
+    bool bench_startup;
+    u64 start_ns;
+    u64 first_instruction_ns;
     bool valid;
     bool is_running;
     Cpu cpu;
     Keyboard* keyboard;
     Renderer* renderer;
+    Display* display;       // the window, NULL when headless
     Speaker* speaker;
 } Chip8;
 
 Chip8
-Chip8_init(String rom_path, u8 screen_scale, u8 speed);
+Chip8_init(String rom_path, Chip8_Options options);
 
-void
+/// prints the static analysis of the ROM (see Analyzer_dump) to stdout
+/// @return: false if the ROM can't be loaded or has errors
+bool
+Chip8_disassemble(String rom_path, Chip8_Options options);
+
+/// runs the interpreter and the compiled engine side by side (see
+/// Lockstep_run) for max_frames frames, or a minute if 0
+/// @return: false if the ROM can't be loaded or they diverge
+bool
+Chip8_lockstep(String rom_path, Chip8_Options options);
+
+/// runs options.wall instances of the ROM side by side in one window (see
+/// Wall_run), until quit or until they all stopped
+/// @return: false if the ROM can't be loaded, the window can't be opened
+/// or an instance faulted
+bool
+Chip8_wall(String rom_path, Chip8_Options options);
+
+/// fingerprint of the machine state (see Cpu_state_hash), O(1)
+u64
+Chip8_state_hash(const Chip8* self);
+
+/// runs `multiplier` times faster than real time, from CHIP8_SPEED_MIN to
+/// CHIP8_SPEED_UNCAPPED. Faster than 1x, the window and the stream only get
+/// a frame per display refresh and the sound is muted; a recording still
+/// gets every frame. Also on the keyboard: '=' and '-' step through 0.25x to
+/// uncapped, '0' goes back to 1x and tab fast-forwards while held
+/// @return: false with netplay, which only runs at 1x
+bool
+Chip8_set_speed(Chip8* self, f64 multiplier);
+
+/// the multiplier actually reached, measured over the last half second
+f64
+Chip8_effective_speed(const Chip8* self);
+
+/// @return: false if the program stopped on a CPU fault
+bool
 Chip8_mainloop(Chip8* self);
 
 void
@@ -1,28 +1,50 @@
 #include "cpu.h"
+#include "utils/hash.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
 
-#define CHIP8_MEM           4096
+#define CHIP8_MEM           CPU_MEMORY_SIZE
+#define CHIP8_MEM_MASK      (CHIP8_MEM - 1)
 #define CHIP8_REGS          16
-#define CHIP8_INIT_PC_ADDR  0x200
+#define CHIP8_INIT_PC_ADDR  CPU_PROGRAM_ADDR
 #define CHIP8_MAX_ROM_SIZE  0xDFF
+#define XOCHIP_MAX_ROM_SIZE (CHIP8_MEM - CHIP8_INIT_PC_ADDR)
 #define CHIP8_INSTERUCTIONS 16
 #define CHIP8_SPRITES_SIZE  80
-#define CHIP8_STACK_SIZE    16
+#define CHIP8_STACK_SIZE    CPU_STACK_SIZE
+#define SCHIP_SPRITES_ADDR  CHIP8_SPRITES_SIZE
+#define SCHIP_SPRITES_SIZE  160
+#define SCHIP_FLAGS_COUNT   8
 
 #define BITS_PER_BYTE       8
 
-static bool
-Cpu__execute__(Cpu* self, u16 opcode);
-
 static void
 Cpu__update_timers__(Cpu* self);
 
+
 static void
-Cpu__play_sound__(Cpu* self);
+Cpu__skip__(Cpu* self);
+
+static void
+Cpu__write__(Cpu* self, u32 addr, u8 value);
+
+static u32
+Cpu__random__(Cpu* self);
+
+static u64
+Cpu__hash_memory__(const Cpu* self);
+
+static u64
+Cpu__state_hash__(const Cpu* self, u64 memory_hash, u64 display_hash);
+
+static Cpu_Fusion
+Cpu__fuse__(const Cpu* self, u16 pc);
+
+static inline __attribute__((always_inline)) u32
+Cpu__run_fused__(Cpu* self, Cpu_Fusion fusion);
 
 static bool
 Cpu__on_0x0(Cpu* self, u16 opcode);
@@ -48,8 +70,8 @@ Cpu__on_0x6(Cpu* self, u16 opcode);
 static bool
 Cpu__on_0x7(Cpu* self, u16 opcode);
 
-static bool
-Cpu__on_0x8(Cpu* self, u16 opcode);
+static inline __attribute__((always_inline)) bool
+Cpu__alu__(Cpu* self, u16 opcode, const bool shift_vy, const bool vf_reset);
 
 static bool
 Cpu__on_0x9(Cpu* self, u16 opcode);
@@ -57,26 +79,84 @@ Cpu__on_0x9(Cpu* self, u16 opcode);
 static bool
 Cpu__on_0xA(Cpu* self, u16 opcode);
 
-static bool
-Cpu__on_0xB(Cpu* self, u16 opcode);
+static inline __attribute__((always_inline)) bool
+Cpu__jump_offset__(Cpu* self, u16 opcode, const bool jump_vx);
 
 static bool
 Cpu__on_0xC(Cpu* self, u16 opcode);
 
-static bool
-Cpu__on_0xD(Cpu* self, u16 opcode);
+static inline __attribute__((always_inline)) bool
+Cpu__draw__(Cpu* self, u16 opcode, const bool wrap);
 
 static bool
 Cpu__on_0xE(Cpu* self, u16 opcode);
 
-static bool
-Cpu__on_0xF(Cpu* self, u16 opcode);
+static inline __attribute__((always_inline)) bool
+Cpu__misc__(Cpu* self, u16 opcode, const bool load_store_i);
 
 static void
 Cpu__on_pause(Cpu* self, u8 key);
 
+// the quirks dependent handlers of each profile, with the quirks as constants
+#define CPU_QUIRKS_HANDLERS(NAME, name, SHIFT_VY, LOAD_STORE_I, JUMP_VX, VF_RESET, WRAP)    \
+    static bool                                                                         \
+    Cpu__on_0x8_##name(Cpu* self, u16 opcode)                                           \
+    {                                                                                   \
+        return Cpu__alu__(self, opcode, SHIFT_VY, VF_RESET);                            \
+    }                                                                                   \
+    static bool                                                                         \
+    Cpu__on_0xB_##name(Cpu* self, u16 opcode)                                           \
+    {                                                                                   \
+        return Cpu__jump_offset__(self, opcode, JUMP_VX);                               \
+    }                                                                                   \
+    static bool                                                                         \
+    Cpu__on_0xD_##name(Cpu* self, u16 opcode)                                           \
+    {                                                                                   \
+        return Cpu__draw__(self, opcode, WRAP);                                         \
+    }                                                                                   \
+    static bool                                                                         \
+    Cpu__on_0xF_##name(Cpu* self, u16 opcode)                                           \
+    {                                                                                   \
+        return Cpu__misc__(self, opcode, LOAD_STORE_I);                                 \
+    }
+
+CPU_QUIRKS_PROFILES(CPU_QUIRKS_HANDLERS)
+#undef CPU_QUIRKS_HANDLERS
+
+typedef struct {
+    Cpu_Quirk_Set set;
+    bool (*on_0x8)(Cpu* self, u16 opcode);
+    bool (*on_0xB)(Cpu* self, u16 opcode);
+    bool (*on_0xD)(Cpu* self, u16 opcode);
+    bool (*on_0xF)(Cpu* self, u16 opcode);
+} Cpu__Quirks_Profile__;
+
+static const Cpu__Quirks_Profile__ CPU__QUIRKS_PROFILES__[CPU_QUIRKS_COUNT] = {
+#define CPU_QUIRKS_PROFILE(NAME, name, SHIFT_VY, LOAD_STORE_I, JUMP_VX, VF_RESET, WRAP)     \
+    [CPU_QUIRKS_##NAME] = {                                                             \
+        .set = { #name, SHIFT_VY, LOAD_STORE_I, JUMP_VX, VF_RESET, WRAP },              \
+        .on_0x8 = Cpu__on_0x8_##name,                                                   \
+        .on_0xB = Cpu__on_0xB_##name,                                                   \
+        .on_0xD = Cpu__on_0xD_##name,                                                   \
+        .on_0xF = Cpu__on_0xF_##name,                                                   \
+    },
+    CPU_QUIRKS_PROFILES(CPU_QUIRKS_PROFILE)
+#undef CPU_QUIRKS_PROFILE
+};
+
+typedef struct {
+    const char* name;
+    u32 instructions;
+} Cpu__Fusion_Info__;
+
+static const Cpu__Fusion_Info__ CPU__FUSIONS__[CPU_FUSION_COUNT] = {
+#define CPU_FUSIONS_INFO(NAME, name, INSTRUCTIONS) [CPU_FUSION_##NAME] = { name, INSTRUCTIONS },
+    CPU_FUSIONS(CPU_FUSIONS_INFO)
+#undef CPU_FUSIONS_INFO
+};
+
 Cpu
-Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u8 speed)
+Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u32 speed, Cpu_Mode mode, Cpu_Quirks quirks)
 {
     Cpu cpu = {};
 
@@ -89,15 +169,17 @@ Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u8 speed)
         return cpu;
     }
 
-    cpu.memory = malloc(CHIP8_MEM);
+    cpu.memory = calloc(CHIP8_MEM, sizeof(u8));
     cpu.registers = calloc(CHIP8_REGS, sizeof(u8));
     cpu.instructions = calloc(CHIP8_INSTERUCTIONS, sizeof(Cpu_Instruction));
-    cpu.stack = Stack_construct(CHIP8_STACK_SIZE, true);
-    if(!cpu.memory || !cpu.registers || !cpu.instructions || !cpu.stack.valid)
+    cpu.stack = Stack_construct(CHIP8_STACK_SIZE, false);
+    cpu.fusion = malloc(CHIP8_MEM);
+    if(!cpu.memory || !cpu.registers || !cpu.instructions || !cpu.stack.valid || !cpu.fusion)
     {
         cpu.valid = false;
         return cpu;
     }
+    memset(cpu.fusion, CPU_FUSION_UNKNOWN, CHIP8_MEM);
 
     cpu.i = 0;
     cpu.delay_timer = 0;
@@ -105,6 +187,17 @@ Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u8 speed)
     cpu.pc = CHIP8_INIT_PC_ADDR; // program counter
     cpu.paused = false;
     cpu.speed = speed;
+    cpu.mode = mode;
+    cpu.quirks = quirks < CPU_QUIRKS_COUNT ? quirks : CPU_QUIRKS_MODERN;
+    cpu.pitch = 64;     // 4000Hz playback of the audio pattern
+    cpu.exited = false;
+    cpu.halted = false;
+    cpu.idle.valid = false;
+    cpu.effects = 0;
+    cpu.idle_skipped = 0;
+    cpu.sound_on = false;
+    cpu.sound_at = CPU_SOUND_UNCHANGED;
+    Cpu_seed(&cpu, (u32)time(NULL));
 
     // set sprites (screen) in memory starting from address 0x0
     memcpy(
@@ -130,7 +223,34 @@ Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u8 speed)
         CHIP8_SPRITES_SIZE
     );
 
-    // Cpu instructions handlers
+    // SUPER-CHIP/XO-CHIP big (8x10) sprites right after them
+    memcpy(
+        &cpu.memory[SCHIP_SPRITES_ADDR],
+        (u8[]) {
+            0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+            0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+            0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+            0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+            0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+            0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+            0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+            0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+        },
+        SCHIP_SPRITES_SIZE
+    );
+
+    cpu.memory_hash = Cpu__hash_memory__(&cpu);
+
+    // Cpu instructions handlers, specialized for the quirks profile
+    const Cpu__Quirks_Profile__* profile = &CPU__QUIRKS_PROFILES__[cpu.quirks];
     memcpy(
         cpu.instructions,
         (bool (*[])(Cpu*, u16)) {
@@ -142,14 +262,14 @@ Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u8 speed)
             Cpu__on_0x5,
             Cpu__on_0x6,
             Cpu__on_0x7,
-            Cpu__on_0x8,
+            profile->on_0x8,
             Cpu__on_0x9,
             Cpu__on_0xA,
-            Cpu__on_0xB,
+            profile->on_0xB,
             Cpu__on_0xC,
-            Cpu__on_0xD,
+            profile->on_0xD,
             Cpu__on_0xE,
-            Cpu__on_0xF
+            profile->on_0xF
         },
         CHIP8_INSTERUCTIONS * sizeof(Cpu_Instruction)
     );
@@ -157,13 +277,159 @@ Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u8 speed)
     cpu.renderer = renderer;
     cpu.keyboard = keyboard;
     cpu.speaker = speaker;
+    cpu.compiled = NULL;
     cpu.current_instruction = 0;
     cpu.error = CPU_NO_ERROR;
+    cpu.fault_pc = 0;
+    cpu.fault_opcode = 0;
     cpu.has_valid_rom = false;
     cpu.valid = true;
     return cpu;
 }
 
+const Cpu_Quirk_Set*
+Cpu_quirk_set(Cpu_Quirks quirks)
+{
+    return &CPU__QUIRKS_PROFILES__[quirks < CPU_QUIRKS_COUNT ? quirks : CPU_QUIRKS_MODERN].set;
+}
+
+bool
+Cpu_quirks_from_name(const char* name, Cpu_Quirks* quirks)
+{
+    for(u32 iii = 0; iii < CPU_QUIRKS_COUNT; iii++)
+    {
+        if(strcmp(name, CPU__QUIRKS_PROFILES__[iii].set.name) == 0)
+        {
+            *quirks = iii;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Cpu_Quirks
+Cpu_default_quirks(Cpu_Mode mode)
+{
+    switch(mode)
+    {
+        case CPU_MODE_SCHIP:    return CPU_QUIRKS_SCHIP;
+        case CPU_MODE_XOCHIP:   return CPU_QUIRKS_XOCHIP;
+        default:                return CPU_QUIRKS_MODERN;
+    }
+}
+
+void
+Cpu_seed(Cpu* self, u32 seed)
+{
+    // xorshift never leaves 0
+    self->rng = seed ? seed : 0x2545F491;
+}
+
+const char*
+Cpu_error_name(Cpu_Error error)
+{
+    switch(error)
+    {
+        case CPU_NO_ERROR:                  return "no error";
+        case CPU_ERROR_INVALID_SELF:        return "invalid cpu";
+        case CPU_ERROR_INVALID_INSTRUCTION: return "invalid instruction";
+        case CPU_ERROR_INVALID_PROGRAM:     return "invalid program";
+        case CPU_ERROR_STACK_OVERFLOW:      return "stack overflow";
+        case CPU_ERROR_STACK_UNDERFLOW:     return "stack underflow";
+    }
+
+    return "unknown error";
+}
+
+u64
+Cpu_state_hash(const Cpu* self)
+{
+    return Cpu__state_hash__(self, self->memory_hash, Renderer_hash(self->renderer));
+}
+
+u64
+Cpu_state_hash_full(const Cpu* self)
+{
+    return Cpu__state_hash__(self, Cpu__hash_memory__(self), Renderer_hash_full(self->renderer));
+}
+
+void
+Cpu_save_state(const Cpu* self, Cpu_State* state)
+{
+    memcpy(state->memory, self->memory, CHIP8_MEM);
+    state->memory_hash = self->memory_hash;
+    memcpy(state->registers, self->registers, CHIP8_REGS);
+    state->i = self->i;
+    state->delay_timer = self->delay_timer;
+    state->sound_timer = self->sound_timer;
+    state->pc = self->pc;
+
+    state->stack_depth = self->stack.data + self->stack.size - self->stack.stack_ptr;
+    memcpy(state->stack, self->stack.stack_ptr, state->stack_depth * sizeof(Stack_Type));
+
+    state->paused = self->paused;
+    state->current_instruction = self->current_instruction;
+    memcpy(state->flags, self->flags, CPU_FLAGS_COUNT);
+    memcpy(state->audio_pattern, self->audio_pattern, CPU_AUDIO_PATTERN);
+    state->pitch = self->pitch;
+    state->exited = self->exited;
+    state->halted = self->halted;
+    state->rng = self->rng;
+
+    memcpy(&state->display, self->renderer->display, sizeof(Renderer_Frame));
+    state->planes = self->renderer->planes;
+}
+
+void
+Cpu_load_state(Cpu* self, const Cpu_State* state)
+{
+    memcpy(self->memory, state->memory, CHIP8_MEM);
+    self->memory_hash = state->memory_hash;
+    if(self->fusion)
+    {
+        memset(self->fusion, CPU_FUSION_UNKNOWN, CHIP8_MEM);
+    }
+    memcpy(self->registers, state->registers, CHIP8_REGS);
+    self->i = state->i;
+    self->delay_timer = state->delay_timer;
+    self->sound_timer = state->sound_timer;
+    self->pc = state->pc;
+
+    self->stack.stack_ptr = self->stack.data + self->stack.size - state->stack_depth;
+    memcpy(self->stack.stack_ptr, state->stack, state->stack_depth * sizeof(Stack_Type));
+
+    self->paused = state->paused;
+    self->current_instruction = state->current_instruction;
+    memcpy(self->flags, state->flags, CPU_FLAGS_COUNT);
+    memcpy(self->audio_pattern, state->audio_pattern, CPU_AUDIO_PATTERN);
+    self->pitch = state->pitch;
+    self->exited = state->exited;
+    self->halted = state->halted;
+    self->rng = state->rng;
+    self->idle.valid = false;
+    self->sound_on = self->sound_timer > 0;
+    self->frame_executed = 0;    // the states are saved between frames
+
+    Renderer_load_display(self->renderer, &state->display, state->planes);
+
+    // the key handler is the only state outside the machine
+    if(self->paused)
+    {
+        Keyboard_register(self->keyboard, (void (*)(void *, u8))Cpu__on_pause, self);
+    }
+    else
+    {
+        Keyboard_register(self->keyboard, NULL, NULL);
+    }
+}
+
+size_t
+Cpu_max_program_size(Cpu_Mode mode)
+{
+    return mode == CPU_MODE_XOCHIP ? XOCHIP_MAX_ROM_SIZE : CHIP8_MAX_ROM_SIZE;
+}
+
 void
 Cpu_load_program(Cpu* self, u8* program, size_t program_size)
 {
@@ -173,7 +439,7 @@ Cpu_load_program(Cpu* self, u8* program, size_t program_size)
         return;
     }
 
-    if(!program || program_size == 0 || program_size > CHIP8_MAX_ROM_SIZE)
+    if(!program || program_size == 0 || program_size > Cpu_max_program_size(self->mode))
     {
         fputs("Error: CPU: program is NULL or has bad size", stderr);
         self->error = CPU_ERROR_INVALID_PROGRAM;
@@ -181,44 +447,270 @@ Cpu_load_program(Cpu* self, u8* program, size_t program_size)
     }
 
     memcpy(&self->memory[CHIP8_INIT_PC_ADDR], program, program_size);
+    self->program_size = program_size;
+    self->memory_hash = Cpu__hash_memory__(self);
+    if(self->fusion)
+    {
+        memset(self->fusion, CPU_FUSION_UNKNOWN, CHIP8_MEM);
+    }
 
     self->has_valid_rom = true;
     self->error = CPU_NO_ERROR;
 }
 
+bool
+Cpu_attach_compiled(Cpu* self, const Cpu_Compiled* compiled)
+{
+    if(!self || !self->valid || !compiled)
+    {
+        return false;
+    }
+
+    if(compiled->mode != self->mode ||
+       compiled->quirks != self->quirks ||
+       compiled->program_size != self->program_size ||
+       memcmp(&self->memory[CHIP8_INIT_PC_ADDR], compiled->program, compiled->program_size) != 0)
+    {
+        fputs("Warning: CPU: the compiled program doesn't match the ROM, mode or quirks, interpreting it\n", stderr);
+        return false;
+    }
+
+    self->compiled = compiled;
+    return true;
+}
+
 void
-Cpu_cycle(Cpu* self)
+Cpu_set_watch(Cpu* self, const u8* pages, Cpu_Watch on_watch, void* arg)
+{
+    self->watched_pages = pages;
+    self->on_watch = on_watch;
+    self->watch_arg = arg;
+}
+
+bool
+Cpu_set_fusion(Cpu* self, bool enabled)
+{
+    if(!self || !self->valid)
+    {
+        return false;
+    }
+
+    if(!enabled)
+    {
+        free(self->fusion);
+        self->fusion = NULL;
+        return true;
+    }
+
+    if(!self->fusion)
+    {
+        // decoded again as the program runs
+        self->fusion = malloc(CHIP8_MEM);
+        if(!self->fusion)
+        {
+            return false;
+        }
+        memset(self->fusion, CPU_FUSION_UNKNOWN, CHIP8_MEM);
+    }
+    return true;
+}
+
+void
+Cpu_print_fusion_stats(const Cpu* self, FILE* out)
+{
+    u64 fused = 0;
+    for(u32 fusion = CPU_FUSION_NONE + 1; fusion < CPU_FUSION_COUNT; fusion++)
+    {
+        fused += self->fused[fusion];
+    }
+
+    const f64 total = self->interpreted ? (f64)self->interpreted : 1;
+    fprintf(out, "fusion: %llu of %llu interpreted instructions fused (%.1f%%)\n",
+        (unsigned long long)fused,
+        (unsigned long long)self->interpreted,
+        100.0 * fused / total
+    );
+
+    for(u32 fusion = CPU_FUSION_NONE + 1; fusion < CPU_FUSION_COUNT; fusion++)
+    {
+        if(self->fused[fusion])
+        {
+            fprintf(out, "  %-16s %5.1f%%\n", CPU__FUSIONS__[fusion].name, 100.0 * self->fused[fusion] / total);
+        }
+    }
+}
+
+u32
+Cpu_run(Cpu* self, u32 budget)
 {
     if(!self || !self->valid)
     {
         self->error = CPU_ERROR_INVALID_SELF;
-        return;
+        return 0;
     }
 
-    for(int iii = 0; iii < self->speed; iii++)
+    // once paused by Fx0A, only a key (handled by Keyboard_run) resumes
+    const u32 frame_start = self->frame_executed;
+    u32 executed = 0;
+    u32 interpreted = 0;
+    u8* const fusions = self->fusion;
+    self->error = CPU_NO_ERROR;
+    self->idle.valid = false;
+    while(executed < budget && !self->exited && !self->paused)
     {
-        if(!self->paused)
+        if(self->compiled)
         {
-            u16 opcode = ((self->memory[self->pc] << BITS_PER_BYTE) | self->memory[self->pc + 1]);
-            if(!Cpu__execute__(self, opcode))
+            // both count from 0, a loop can't be measured across them
+            self->frame_executed = frame_start + executed;
+            executed += self->compiled->run(self, budget - executed);
+            self->idle.valid = false;
+            if(executed >= budget || self->exited || self->paused)
             {
-                fprintf(stderr, "Error: Cpu: wrong opcode %x\n", opcode);
-                abort();
+                break;
             }
         }
+
+        // the interpreter runs where the compiled code can't go
+        u16 pc = self->pc;
+        if(fusions && fusions[pc] != CPU_FUSION_NONE)
+        {
+            // decoded on the first visit, a jump into the middle of a
+            // sequence finds the entry of its own address
+            Cpu_Fusion fusion = fusions[pc];
+            if(fusion == CPU_FUSION_UNKNOWN)
+            {
+                fusion = Cpu__fuse__(self, pc);
+                fusions[pc] = fusion;
+            }
+
+            // only whole sequences, the budget ends where it would have
+            if(fusion != CPU_FUSION_NONE && CPU__FUSIONS__[fusion].instructions <= budget - executed)
+            {
+                const u32 ran = Cpu__run_fused__(self, fusion);
+                executed += ran;
+                interpreted += ran;
+                self->fused[fusion] += ran;
+
+                // the jump of a counting loop taken backwards
+                if(fusion == CPU_FUSION_LOOP && ran == 3 && self->pc <= pc + 4)
+                {
+                    executed = Cpu_idle_jump(self, pc + 4, executed, budget);
+                }
+                continue;
+            }
+        }
+
+        u16 opcode = ((self->memory[pc] << BITS_PER_BYTE) | self->memory[(pc + 1) & CHIP8_MEM_MASK]);
+        if(!Cpu_execute(self, opcode))
+        {
+            // reported by the caller, the hot path stays quiet
+            self->pc = pc;
+            self->fault_pc = pc;
+            self->fault_opcode = opcode;
+            self->interpreted += interpreted;
+            self->frame_executed = frame_start + executed;
+            return executed;
+        }
+        executed++;
+        interpreted++;
+
+        if((opcode & 0xF000) == 0x1000 && (opcode & 0xFFF) <= pc)
+        {
+            executed = Cpu_idle_jump(self, pc, executed, budget);
+        }
+        else if((opcode & 0xF0FF) == 0xF018)
+        {
+            Cpu_sound_set(self, frame_start + executed);
+        }
     }
 
+    self->interpreted += interpreted;
+    self->frame_executed = frame_start + executed;
+    return executed;
+}
+
+void
+Cpu_end_frame(Cpu* self)
+{
+    self->frame_executed = 0;
     if(!self->paused)
     {
         Cpu__update_timers__(self);
     }
+}
+
+bool
+Cpu_run_frame(Cpu* self)
+{
+    Cpu_run(self, self->speed);
+    if(self->error != CPU_NO_ERROR)
+    {
+        return false;
+    }
+
+    Cpu_end_frame(self);
+    return true;
+}
+
+bool
+Cpu_cycle(Cpu* self)
+{
+    bool ok = Cpu_run_frame(self);
 
-    
     Keyboard_run(self->keyboard);
-    Cpu__play_sound__(self);
-    Renderer_render(self->renderer);
+    Cpu_present(self);
 
-    self->error = CPU_NO_ERROR;
+    return ok;
+}
+
+void
+Cpu_sound_set(Cpu* self, u32 executed)
+{
+    const bool on = self->sound_timer > 0;
+    if(on != self->sound_on)
+    {
+        self->sound_on = on;
+        self->sound_at = executed;
+    }
+}
+
+void
+Cpu_present_sound(Cpu* self)
+{
+    // the tone switches where the last Fx18 of the frame switched it, the
+    // timer running out stops it with the end of the frame
+    if(self->sound_at != CPU_SOUND_UNCHANGED)
+    {
+        // a frame run with more than `speed` instructions switches at its end
+        const f32 at = self->sound_at < self->speed ? (f32)self->sound_at / self->speed : 1;
+        if(self->sound_on)
+        {
+            Speaker_play(self->speaker, 440, -1, at);
+        }
+        else
+        {
+            Speaker_stop(self->speaker, at);
+        }
+        self->sound_at = CPU_SOUND_UNCHANGED;
+    }
+    Speaker_end_frame(self->speaker);
+
+    self->sound_on = self->sound_timer > 0;
+    if(self->sound_on)
+    {
+        Speaker_play(self->speaker, 440, -1, 0);
+    }
+    else
+    {
+        Speaker_stop(self->speaker, 0);
+    }
+}
+
+void
+Cpu_present(Cpu* self)
+{
+    Cpu_present_sound(self);
+    Renderer_publish(self->renderer);
 }
 
 void
@@ -232,11 +724,55 @@ Cpu_deinit(Cpu* self)
     free(self->memory);
     free(self->registers);
     free(self->instructions);
+    free(self->fusion);
+    Stack_deconstruct(&self->stack);
+}
+
+u32
+Cpu_idle_jump(Cpu* self, u16 addr, u32 executed, u32 budget)
+{
+    Cpu_Idle* idle = &self->idle;
+
+    bool same = idle->valid &&
+                idle->addr == addr &&
+                idle->effects == self->effects &&
+                idle->i == self->i &&
+                idle->delay_timer == self->delay_timer &&
+                idle->sound_timer == self->sound_timer &&
+                idle->stack_ptr == self->stack.stack_ptr &&
+                memcmp(idle->registers, self->registers, CHIP8_REGS) == 0;
+
+    if(!same)
+    {
+        idle->valid = true;
+        idle->addr = addr;
+        idle->executed = executed;
+        idle->effects = self->effects;
+        idle->i = self->i;
+        idle->delay_timer = self->delay_timer;
+        idle->sound_timer = self->sound_timer;
+        idle->stack_ptr = self->stack.stack_ptr;
+        memcpy(idle->registers, self->registers, CHIP8_REGS);
+        return executed;
+    }
+
+    // whole iterations only, the rest runs so pc ends where it would have
+    u32 period = executed - idle->executed;
+    u32 skipped = (budget - executed) / period * period;
+
+    u16 target = ((self->memory[addr] << BITS_PER_BYTE) | self->memory[(addr + 1) & CHIP8_MEM_MASK]) & 0xFFF;
+    if(target == addr)
+    {
+        self->halted = true;
+    }
+
+    self->idle_skipped += skipped;
+    idle->executed = executed + skipped;
+    return executed + skipped;
 }
 
-// private functions
 bool
-Cpu__execute__(Cpu* self, u16 opcode)
+Cpu_execute(Cpu* self, u16 opcode)
 {
     // Increment the program counter to prepare it for the next instruction.
     // Each instruction is 2 bytes long, so increment it by 2.
@@ -244,18 +780,21 @@ Cpu__execute__(Cpu* self, u16 opcode)
 
     u8 instruction = ((opcode & 0xF000) >> 12);
 
+    // the handlers set a more precise error before failing
+    self->error = CPU_NO_ERROR;
     if(self->instructions[instruction].run(self, opcode))
     {
-        self->error = CPU_NO_ERROR;
         return true;
     }
-    else
+
+    if(self->error == CPU_NO_ERROR)
     {
         self->error = CPU_ERROR_INVALID_INSTRUCTION;
-        return false;
     }
+    return false;
 }
 
+// private functions
 void
 Cpu__update_timers__(Cpu* self)
 {
@@ -270,32 +809,263 @@ Cpu__update_timers__(Cpu* self)
     }
 }
 
+// skips the next instruction, on XO-CHIP `F000 nnnn` is 4 bytes long
 void
-Cpu__play_sound__(Cpu* self)
+Cpu__skip__(Cpu* self)
 {
-    if (self->sound_timer > 0)
+    if(self->mode == CPU_MODE_XOCHIP &&
+       self->memory[self->pc] == 0xF0 && self->memory[(self->pc + 1) & CHIP8_MEM_MASK] == 0x00)
     {
-        Speaker_play(self->speaker, 440, -1);
+        self->pc += 4;
+        return;
     }
-    else
+
+    self->pc += 2;
+}
+
+// every store of the program goes through here
+void
+Cpu__write__(Cpu* self, u32 addr, u8 value)
+{
+    addr &= CHIP8_MEM_MASK;
+    self->effects++;
+
+    const u8 previous = self->memory[addr];
+    if(self->watched_pages && self->watched_pages[addr >> CPU_PAGE_BITS])
+    {
+        self->on_watch(self->watch_arg, (u16)addr, previous, value);
+    }
+
+    if(value == previous)
+    {
+        return;
+    }
+
+    self->memory_hash ^= Hash_key(addr, previous) ^ Hash_key(addr, value);
+
+    // self-modifying code: the sequences reading this byte are decoded again
+    if(self->fusion)
+    {
+        for(u32 back = 0; back < CPU_FUSION_MAX_BYTES; back++)
+        {
+            self->fusion[(addr - back) & CHIP8_MEM_MASK] = CPU_FUSION_UNKNOWN;
+        }
+    }
+
+    // self-modifying code: the compiled code is stale, interpret from now on
+    if(self->compiled)
+    {
+        const u32 offset = addr - CHIP8_INIT_PC_ADDR;
+        if(addr >= CHIP8_INIT_PC_ADDR && offset < self->compiled->program_size &&
+           (self->compiled->code_map[offset >> 3] & (1 << (offset & 7))))
+        {
+            self->compiled = NULL;
+        }
+    }
+
+    self->memory[addr] = value;
+}
+
+// same keys as the updates of Cpu__write__
+u64
+Cpu__hash_memory__(const Cpu* self)
+{
+    u64 hash = 0;
+    for(u32 addr = 0; addr < CHIP8_MEM; addr++)
     {
-        Speaker_stop(self->speaker);
+        hash ^= Hash_key(addr, self->memory[addr]);
     }
+
+    return hash;
+}
+
+// the memory and the display come hashed, the rest is hashed here
+u64
+Cpu__state_hash__(const Cpu* self, u64 memory_hash, u64 display_hash)
+{
+    const u16 words[] = {
+        self->pc,
+        self->i,
+        self->delay_timer,
+        self->sound_timer,
+        self->paused,
+        self->exited,
+        self->pitch,
+    };
+
+    u64 hash = Hash_bytes(memory_hash ^ Hash_mix(display_hash), words, sizeof(words));
+    hash = Hash_bytes(hash, self->registers, CHIP8_REGS);
+    hash = Hash_bytes(hash, &self->rng, sizeof(self->rng));
+    hash = Hash_bytes(hash, self->flags, CPU_FLAGS_COUNT);
+    hash = Hash_bytes(hash, self->audio_pattern, CPU_AUDIO_PATTERN);
+
+    // the live part of the stack only
+    const Stack_Type* top = self->stack.stack_ptr;
+    const size_t depth = self->stack.data + self->stack.size - top;
+    hash = Hash_bytes(hash, &depth, sizeof(depth));
+    return Hash_bytes(hash, top, depth * sizeof(Stack_Type));
+}
+
+// the sequence starting at `pc`, if it fits in the memory without wrapping
+Cpu_Fusion
+Cpu__fuse__(const Cpu* self, u16 pc)
+{
+    if(pc > CHIP8_MEM - CPU_FUSION_MAX_BYTES)
+    {
+        return CPU_FUSION_NONE;
+    }
+
+    u16 opcodes[CPU_FUSION_MAX_BYTES / 2];
+    for(u32 iii = 0; iii < CPU_FUSION_MAX_BYTES / 2; iii++)
+    {
+        opcodes[iii] = (self->memory[pc + 2 * iii] << BITS_PER_BYTE) | self->memory[pc + 2 * iii + 1];
+    }
+
+    switch(opcodes[0] & 0xF000)
+    {
+        case 0xA000:
+            if((opcodes[1] & 0xF000) == 0xD000) return CPU_FUSION_DRAW;
+            break;
+        case 0x6000:
+        {
+            u32 loads = 1;
+            while(loads < 4 && (opcodes[loads] & 0xF000) == 0x6000)
+            {
+                loads++;
+            }
+            if(loads == 2) return CPU_FUSION_LOAD_2;
+            if(loads == 3) return CPU_FUSION_LOAD_3;
+            if(loads == 4) return CPU_FUSION_LOAD_4;
+            break;
+        }
+        case 0x7000:
+            // the skip of 3ykk lands past the 1nnn, 2 bytes in every mode
+            if((opcodes[1] & 0xF000) == 0x3000 && (opcodes[2] & 0xF000) == 0x1000) return CPU_FUSION_LOOP;
+            break;
+        case 0xF000:
+            if((opcodes[0] & 0xFF) == 0x1E && (opcodes[1] & 0xF0FF) == 0xF065) return CPU_FUSION_TABLE;
+            break;
+    }
+
+    return CPU_FUSION_NONE;
+}
+
+// the instructions of the sequence at pc, with the effects of running them
+// one by one, returns how many ran
+static inline __attribute__((always_inline)) u32
+Cpu__run_fused__(Cpu* self, Cpu_Fusion fusion)
+{
+    const u16 pc = self->pc;
+    const u8* code = &self->memory[pc];
+
+    switch(fusion)
+    {
+        case CPU_FUSION_DRAW:
+            self->i = ((code[0] & 0xF) << BITS_PER_BYTE) | code[1];
+            self->pc = pc + 4;
+            self->instructions[0xD].run(self, (code[2] << BITS_PER_BYTE) | code[3]);
+            return 2;
+        case CPU_FUSION_LOAD_2:
+        case CPU_FUSION_LOAD_3:
+        case CPU_FUSION_LOAD_4:
+        {
+            // in order, the last load of a register wins
+            const u32 loads = CPU__FUSIONS__[fusion].instructions;
+            for(u32 load = 0; load < loads; load++)
+            {
+                self->registers[code[2 * load] & 0xF] = code[2 * load + 1];
+            }
+            self->pc = pc + 2 * loads;
+            return loads;
+        }
+        case CPU_FUSION_LOOP:
+            self->registers[code[0] & 0xF] += code[1];
+            if(self->registers[code[2] & 0xF] == code[3])
+            {
+                // skips the jump
+                self->pc = pc + 6;
+                return 2;
+            }
+            self->pc = ((code[4] & 0xF) << BITS_PER_BYTE) | code[5];
+            return 3;
+        case CPU_FUSION_TABLE:
+            // the Fy65 of the profile, which knows where it leaves I
+            self->i += self->registers[code[0] & 0xF];
+            self->pc = pc + 4;
+            self->instructions[0xF].run(self, (code[2] << BITS_PER_BYTE) | code[3]);
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+// xorshift32, the state is part of the machine so runs are reproducible
+u32
+Cpu__random__(Cpu* self)
+{
+    u32 x = self->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    self->rng = x;
+    return x;
 }
 
 bool
 Cpu__on_0x0(Cpu* self, u16 opcode)
 {
 
+    const bool schip = self->mode >= CPU_MODE_SCHIP;
+
+    // everything here but 00EE draws or stops
+    if(opcode != 0x00EE)
+    {
+        self->effects++;
+    }
+
+    // 00Cn: scroll down n rows, 00Dn: scroll up n rows (XO-CHIP)
+    if(schip && (opcode & 0xFFF0) == 0x00C0)
+    {
+        Renderer_scroll_down(self->renderer, opcode & 0xF);
+        return true;
+    }
+
+    if(self->mode == CPU_MODE_XOCHIP && (opcode & 0xFFF0) == 0x00D0)
+    {
+        Renderer_scroll_up(self->renderer, opcode & 0xF);
+        return true;
+    }
+
     switch (opcode)
     {
         case 0x00E0:
             Renderer_clear(self->renderer);
             break;
+        case 0x00FB:
+            if(!schip) return false;
+            Renderer_scroll_right(self->renderer);
+            break;
+        case 0x00FC:
+            if(!schip) return false;
+            Renderer_scroll_left(self->renderer);
+            break;
+        case 0x00FD:
+            if(!schip) return false;
+            self->exited = true;
+            break;
+        case 0x00FE:
+        case 0x00FF:
+            if(!schip) return false;
+            Renderer_set_hires(self->renderer, opcode == 0x00FF);
+            break;
         case 0x00EE:
         {
             u16 pop = Stack_pop(&self->stack);
-            if(self->error != CPU_NO_ERROR) return false;
+            if(self->stack.error != STACK_NO_ERROR)
+            {
+                self->error = CPU_ERROR_STACK_UNDERFLOW;
+                return false;
+            }
             self->pc = pop; 
             break;
         }
@@ -319,7 +1089,11 @@ Cpu__on_0x2(Cpu* self, u16 opcode)
 {
 
     Stack_push(&self->stack, self->pc);
-    if(self->error != STACK_NO_ERROR) return false;
+    if(self->stack.error != STACK_NO_ERROR)
+    {
+        self->error = CPU_ERROR_STACK_OVERFLOW;
+        return false;
+    }
 
     self->pc = (opcode & 0xFFF);
     return true;
@@ -332,7 +1106,7 @@ Cpu__on_0x3(Cpu* self, u16 opcode)
 
     if (self->registers[x] == (opcode & 0xFF))
     {
-        self->pc += 2;
+        Cpu__skip__(self);
     }
 
     return true;
@@ -345,7 +1119,7 @@ Cpu__on_0x4(Cpu* self, u16 opcode)
 
     if (self->registers[x] != (opcode & 0xFF))
     {
-        self->pc += 2;
+        Cpu__skip__(self);
     }
 
     return true;
@@ -357,10 +1131,34 @@ Cpu__on_0x5(Cpu* self, u16 opcode)
     u8 x = (opcode & 0x0F00) >> 8;
     u8 y = (opcode & 0x00F0) >> 4;
 
-    if (self->registers[x] == self->registers[y])
+    switch(opcode & 0xF)
     {
-        self->pc += 2;
+        case 0x0:
+            if (self->registers[x] == self->registers[y])
+            {
+                Cpu__skip__(self);
+            }
+            break;
+        case 0x2:
+        case 0x3:
+        {
+            // XO-CHIP: save/load vx..vy (in either order) at I, I is unchanged
+            if(self->mode != CPU_MODE_XOCHIP) return false;
+
+            i8 step = x <= y ? 1 : -1;
+            for(u8 offset = 0, reg = x; ; offset++, reg += step)
+            {
+                if((opcode & 0xF) == 0x2) Cpu__write__(self, self->i + offset, self->registers[reg]);
+                else self->registers[reg] = self->memory[(self->i + offset) & CHIP8_MEM_MASK];
+
+                if(reg == y) break;
+            }
+            break;
+        }
+        default:
+            return false;
     }
+
     return true;
 }
 
@@ -382,8 +1180,8 @@ Cpu__on_0x7(Cpu* self, u16 opcode)
     return true;
 }
 
-bool
-Cpu__on_0x8(Cpu* self, u16 opcode)
+static inline __attribute__((always_inline)) bool
+Cpu__alu__(Cpu* self, u16 opcode, const bool shift_vy, const bool vf_reset)
 {
     u8 x = (opcode & 0x0F00) >> 8;
     u8 y = (opcode & 0x00F0) >> 4;
@@ -395,57 +1193,54 @@ Cpu__on_0x8(Cpu* self, u16 opcode)
             break;
         case 0x1:
             self->registers[x] |= self->registers[y];
+            if(vf_reset) self->registers[0xF] = 0;
             break;
         case 0x2:
             self->registers[x] &= self->registers[y];
+            if(vf_reset) self->registers[0xF] = 0;
             break;
         case 0x3:
             self->registers[x] ^= self->registers[y];
+            if(vf_reset) self->registers[0xF] = 0;
             break;
         case 0x4:
             {
-                u16 sum = (self->registers[x] += self->registers[y]);
-
-                self->registers[0xF] = 0;
-
-                if (sum > 0xFF) {
-                    self->registers[0xF] = 1;
-                }
-
+                // the result first: VF is written last, and wins when x is F
+                u16 sum = self->registers[x] + self->registers[y];
                 self->registers[x] = (u8)sum;
+                self->registers[0xF] = sum > 0xFF;
                 break;
             }
         case 0x5:
             {
-                self->registers[0xF] = 0;
-
-                if (self->registers[x] > self->registers[y]) 
-                {
-                    self->registers[0xF] = 1;
-                }
-
+                u8 no_borrow = self->registers[x] >= self->registers[y];
                 self->registers[x] -= self->registers[y];
+                self->registers[0xF] = no_borrow;
                 break;
             }
         case 0x6:
-            self->registers[0xF] = (self->registers[x] & 0x1);
-            self->registers[x] >>= 1;
-            break;
+            {
+                u8 source = self->registers[shift_vy ? y : x];
+                self->registers[x] = source >> 1;
+                self->registers[0xF] = source & 0x1;
+                break;
+            }
         case 0x7:
             {
-                self->registers[0xF] = 0;
-
-                if (self->registers[y] > self->registers[x]) {
-                    self->registers[0xF] = 1;
-                }
-
+                u8 no_borrow = self->registers[y] >= self->registers[x];
                 self->registers[x] = self->registers[y] - self->registers[x];
+                self->registers[0xF] = no_borrow;
                 break;
             }
         case 0xE:
-            self->registers[0xF] = (self->registers[x] & 0x80);
-            self->registers[x] <<= 1;
-            break;
+            {
+                u8 source = self->registers[shift_vy ? y : x];
+                self->registers[x] = source << 1;
+                self->registers[0xF] = source >> 7;
+                break;
+            }
+        default:
+            return false;
     }
 
     return true;
@@ -457,9 +1252,14 @@ Cpu__on_0x9(Cpu* self, u16 opcode)
     u8 x = (opcode & 0x0F00) >> 8;
     u8 y = (opcode & 0x00F0) >> 4;
 
+    if ((opcode & 0xF) != 0)
+    {
+        return false;
+    }
+
     if (self->registers[x] != self->registers[y])
     {
-        self->pc += 2;
+        Cpu__skip__(self);
     }
 
     return true;
@@ -473,11 +1273,12 @@ Cpu__on_0xA(Cpu* self, u16 opcode)
     return true;
 }
 
-bool
-Cpu__on_0xB(Cpu* self, u16 opcode)
+static inline __attribute__((always_inline)) bool
+Cpu__jump_offset__(Cpu* self, u16 opcode, const bool jump_vx)
 {
+    u8 x = (opcode & 0x0F00) >> 8;
 
-    self->pc = (opcode & 0xFFF) + self->registers[0];
+    self->pc = (opcode & 0xFFF) + self->registers[jump_vx ? x : 0];
     return true;
 }
 
@@ -485,48 +1286,48 @@ bool
 Cpu__on_0xC(Cpu* self, u16 opcode)
 {
 
-    time_t t1;
-    srand((u32)time(&t1));
-    u32 rand_num = rand() % 0xFF;
+    self->effects++;
 
     u8 x = (opcode & 0x0F00) >> 8;
-    self->registers[x] = rand_num & (opcode & 0xFF);
+    self->registers[x] = (Cpu__random__(self) >> 24) & (opcode & 0xFF);
 
     return true;
 }
 
-bool
-Cpu__on_0xD(Cpu* self, u16 opcode)
+static inline __attribute__((always_inline)) bool
+Cpu__draw__(Cpu* self, u16 opcode, const bool wrap)
 {
-    u8 width = 8;
     u8 height = (opcode & 0xF);
     u8 x = (opcode & 0x0F00) >> 8;
     u8 y = (opcode & 0x00F0) >> 4;
 
-    self->registers[0xF] = 0;
-
-    for (u8 row = 0; row < height; row++)
-    {
-        u8 sprite = self->memory[self->i + row];
+    // Dxy0 draws a 16x16 sprite on SUPER-CHIP/XO-CHIP
+    bool wide = height == 0 && self->mode >= CPU_MODE_SCHIP;
+    u32 size = wide ? 32 : height;
 
-        for (u8 col = 0; col < width; col++)
-        {
-            // If the bit (sprite) is not 0, render/erase the pixel
-            if ((sprite & 0x80) > 0)
-            {
-                // If setPixel returns 1, which means a pixel was erased, set VF to 1
-                if (Renderer_toggle_pixel(self->renderer, self->registers[x] + col, self->registers[y] + row))
-                {
-                    self->registers[0xF] = 1;
-                }
-            }
+    // every selected XO-CHIP plane takes its own copy of the sprite data
+    u8 planes = self->renderer->planes;
+    u32 copies = (planes & 1) + ((planes >> 1) & 1);
 
-            // Shift the sprite left 1. This will move the next next col/bit of the sprite into the first position.
-            // Ex. 10010000 << 1 will become 0010000
-            sprite <<= 1;
-        }
+    u8 sprite[RENDERER_SPRITE_MAX_BYTES];
+    for (u32 offset = 0; offset < size * copies; offset++)
+    {
+        sprite[offset] = self->memory[(self->i + offset) & CHIP8_MEM_MASK];
     }
 
+    self->effects++;
+
+    // If a pixel was erased, set VF to 1
+    self->registers[0xF] = Renderer_draw_sprite(
+        self->renderer,
+        sprite,
+        height,
+        wide,
+        self->registers[x],
+        self->registers[y],
+        wrap
+    );
+
     return true;
 }
 
@@ -538,29 +1339,56 @@ Cpu__on_0xE(Cpu* self, u16 opcode)
     switch (opcode & 0xFF)
     {
         case 0x9E:
-            if (keyboard_is_pressed(self->keyboard, self->registers[x]))
+            if (keyboard_is_pressed(self->keyboard, self->registers[x] & 0xF))
             {
-                self->pc += 2;
+                Cpu__skip__(self);
             }
+            break;
         case 0xA1:
-            if (!keyboard_is_pressed(self->keyboard, self->registers[x]))
+            if (!keyboard_is_pressed(self->keyboard, self->registers[x] & 0xF))
             {
-                self->pc += 2;
+                Cpu__skip__(self);
             }
+            break;
+        default:
+            return false;
     }
 
     return true;
 }
 
-bool
-Cpu__on_0xF(Cpu* self, u16 opcode)
+static inline __attribute__((always_inline)) bool
+Cpu__misc__(Cpu* self, u16 opcode, const bool load_store_i)
 {
     u8 x = (opcode & 0x0F00) >> 8;
-    u8 y = (opcode & 0x00F0) >> 4;
+    const bool schip = self->mode >= CPU_MODE_SCHIP;
+    const bool xochip = self->mode == CPU_MODE_XOCHIP;
     self->current_instruction = opcode;
 
     switch (opcode & 0xFF)
     {
+        case 0x00:
+            // F000 nnnn: I = nnnn (XO-CHIP)
+            if(!xochip || x != 0) return false;
+            self->i = (self->memory[self->pc & CHIP8_MEM_MASK] << BITS_PER_BYTE) |
+                       self->memory[(self->pc + 1) & CHIP8_MEM_MASK];
+            self->pc += 2;
+            break;
+        case 0x01:
+            // Fn01: select the planes n (XO-CHIP)
+            if(!xochip) return false;
+            Renderer_select_planes(self->renderer, x);
+            self->effects++;
+            break;
+        case 0x02:
+            // F002: load the 16 bytes audio pattern from I (XO-CHIP)
+            if(!xochip || x != 0) return false;
+            for (u8 offset = 0; offset < CPU_AUDIO_PATTERN; offset++)
+            {
+                self->audio_pattern[offset] = self->memory[(self->i + offset) & CHIP8_MEM_MASK];
+            }
+            self->effects++;
+            break;
         case 0x07:
             self->registers[x] = self->delay_timer;
             break;
@@ -581,29 +1409,55 @@ Cpu__on_0xF(Cpu* self, u16 opcode)
             // location of sprite
             self->i = self->registers[x] * 5;
             break;
+        case 0x30:
+            // location of the big sprite (SUPER-CHIP)
+            if(!schip) return false;
+            self->i = SCHIP_SPRITES_ADDR + (self->registers[x] & 0xF) * 10;
+            break;
         case 0x33:
             // Get the hundreds digit and place it in I.
-            self->memory[self->i] = self->registers[x] / 100;
+            Cpu__write__(self, self->i, self->registers[x] / 100);
 
             // Get tens digit and place it in I+1. Gets a value between 0 and 99,
             // then divides by 10 to give us a value between 0 and 9.
-            self->memory[self->i + 1] = (self->registers[x] % 100) / 10;
+            Cpu__write__(self, self->i + 1, (self->registers[x] % 100) / 10);
 
             // Get the value of the ones (last) digit and place it in I+2.
-            self->memory[self->i + 2] = self->registers[x] % 10;
+            Cpu__write__(self, self->i + 2, self->registers[x] % 10);
+            break;
+        case 0x3A:
+            // audio pattern playback rate (XO-CHIP)
+            if(!xochip) return false;
+            self->pitch = self->registers[x];
+            self->effects++;
             break;
         case 0x55:
             for (u8 registerIndex = 0; registerIndex <= x; registerIndex++)
             {
-                self->memory[self->i + registerIndex] = self->registers[registerIndex];
+                Cpu__write__(self, self->i + registerIndex, self->registers[registerIndex]);
             }
+            if(load_store_i) self->i += x + 1;
             break;
         case 0x65:
             for (u8 registerIndex = 0; registerIndex <= x; registerIndex++)
             {
-                self->registers[registerIndex] = self->memory[self->i + registerIndex];
+                self->registers[registerIndex] = self->memory[(self->i + registerIndex) & CHIP8_MEM_MASK];
             }
+            if(load_store_i) self->i += x + 1;
             break;
+        case 0x75:
+        case 0x85:
+            // save/load the RPL user flags (SUPER-CHIP has 8, XO-CHIP 16)
+            if(!schip || (!xochip && x >= SCHIP_FLAGS_COUNT)) return false;
+            for (u8 registerIndex = 0; registerIndex <= x; registerIndex++)
+            {
+                if((opcode & 0xFF) == 0x75) self->flags[registerIndex] = self->registers[registerIndex];
+                else self->registers[registerIndex] = self->flags[registerIndex];
+            }
+            self->effects++;
+            break;
+        default:
+            return false;
     }
 
     return true;
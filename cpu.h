@@ -9,20 +9,150 @@
 #include "speaker.h"
 
 #include <stdbool.h>
+#include <stdio.h>
 
 typedef enum {
     CPU_NO_ERROR,
     CPU_ERROR_INVALID_SELF,
     CPU_ERROR_INVALID_INSTRUCTION,
     CPU_ERROR_INVALID_PROGRAM,
+    CPU_ERROR_STACK_OVERFLOW,   // 2nnn with the 16 levels in use
+    CPU_ERROR_STACK_UNDERFLOW,  // 00EE outside a subroutine
 } Cpu_Error;
 
+typedef enum {
+    CPU_MODE_CHIP8,
+    CPU_MODE_SCHIP,     // SUPER-CHIP 1.1: hires, scrolling, 16x16 sprites, big font, flags
+    CPU_MODE_XOCHIP,    // XO-CHIP: SUPER-CHIP + 64K memory, bit planes, long I, audio pattern
+} Cpu_Mode;
+
+// The CHIP-8 variants disagree on a few instructions, a profile picks one
+// behavior for each. The interpreter handlers touched by them are generated
+// once per profile, picking a profile costs nothing per instruction.
+//  shift_vy:       8xy6/8xyE shift Vy into Vx, instead of shifting Vx
+//  load_store_i:   Fx55/Fx65 leave I past the last register
+//  jump_vx:        Bxnn jumps to xnn + Vx, instead of nnn + V0
+//  vf_reset:       8xy1/8xy2/8xy3 clear VF
+//  wrap:           sprites wrap around the edges, instead of being clipped
+#define CPU_QUIRKS_PROFILES(X)                                                  \
+    /*  profile         shift_vy  load_store_i  jump_vx  vf_reset  wrap   */    \
+    X(MODERN,  modern,  false,    false,        false,   false,    true)        \
+    X(VIP,     vip,     true,     true,         false,   true,     false)       \
+    X(SCHIP,   schip,   false,    false,        true,    false,    false)       \
+    X(XOCHIP,  xochip,  true,     true,         false,   false,    true)
+
+typedef enum {
+#define CPU_QUIRKS_ENUM(NAME, name, ...) CPU_QUIRKS_##NAME,
+    CPU_QUIRKS_PROFILES(CPU_QUIRKS_ENUM)
+#undef CPU_QUIRKS_ENUM
+    CPU_QUIRKS_COUNT
+} Cpu_Quirks;
+
+typedef struct {
+    const char* name;
+    bool shift_vy;
+    bool load_store_i;
+    bool jump_vx;
+    bool vf_reset;
+    bool wrap;
+} Cpu_Quirk_Set;
+
+#define CPU_MEMORY_SIZE     0x10000     // XO-CHIP, the other modes use the first 4K
+#define CPU_PROGRAM_ADDR    0x200
+#define CPU_FLAGS_COUNT     16
+#define CPU_AUDIO_PATTERN   16
+#define CPU_STACK_SIZE      16
+#define CPU_PAGE_BITS       8           // watched pages, see Cpu_set_watch
+#define CPU_PAGES           (CPU_MEMORY_SIZE >> CPU_PAGE_BITS)
+#define CPU_SOUND_UNCHANGED UINT32_MAX  // Cpu.sound_at: no Fx18 switched the tone
+#define CPU_FUSION_MAX_BYTES 8          // the longest fused sequence, 4 instructions
+
+// Sequences of instructions the interpreter runs as one operation, decoded
+// once per address (see Cpu_run). None of them stores to memory or can fault.
+//  DRAW:       Annn Dxyn, points I at a sprite and draws it
+//  LOAD_n:     n 6xkk in a row, initializing registers
+//  LOOP:       7xkk 3ykk 1nnn, the step and the test of a counting loop
+//  TABLE:      Fx1E Fy65, indexes a table and loads from it
+#define CPU_FUSIONS(X)                                      \
+    /*  fusion   name                instructions */        \
+    X(DRAW,      "Annn Dxyn",        2)                     \
+    X(LOAD_2,    "6xkk 6xkk",        2)                     \
+    X(LOAD_3,    "6xkk x3",          3)                     \
+    X(LOAD_4,    "6xkk x4",          4)                     \
+    X(LOOP,      "7xkk 3ykk 1nnn",   3)                     \
+    X(TABLE,     "Fx1E Fy65",        2)
+
+typedef enum {
+    CPU_FUSION_NONE,        // runs alone
+#define CPU_FUSIONS_ENUM(NAME, ...) CPU_FUSION_##NAME,
+    CPU_FUSIONS(CPU_FUSIONS_ENUM)
+#undef CPU_FUSIONS_ENUM
+    CPU_FUSION_COUNT,
+    CPU_FUSION_UNKNOWN = 0xFF,  // not decoded yet, or the memory changed since
+} Cpu_Fusion;
+
 typedef struct Cpu Cpu;
 
 typedef struct {
     bool (*run)(Cpu* cpu, u16 opcode);
 } Cpu_Instruction;
 
+/// a store to a watched page, before the memory changes
+typedef void (*Cpu_Watch)(void* arg, u16 addr, u8 previous, u8 value);
+
+// A ROM translated to C ahead of time by chip8-recompile. `run` executes up
+// to `budget` instructions from the current pc and returns how many it ran,
+// it returns early where it can't go (computed targets, code it never saw)
+// and the interpreter takes over from there.
+typedef struct {
+    Cpu_Mode mode;
+    Cpu_Quirks quirks;
+    const u8* program;          // the ROM it was generated from
+    u32 program_size;
+    const u8* code_map;         // one bit per program byte, set on compiled code
+    u32 (*run)(Cpu* cpu, u32 budget);
+} Cpu_Compiled;
+
+// State at the last backward jump of the frame. Reaching the same jump again
+// in the same state, with no store, draw or random number in between, means
+// the loop repeats unchanged until the timers or the keys change, which
+// only happens between frames (see Cpu_idle_jump).
+typedef struct {
+    bool valid;
+    u16 addr;
+    u32 executed;
+    u64 effects;
+    u8 registers[16];
+    u16 i;
+    u16 delay_timer;
+    u16 sound_timer;
+    Stack_Type* stack_ptr;
+} Cpu_Idle;
+
+// Everything a program can change, to go back in time (see Cpu_save_state).
+// The memory is copied whole, the I register reaches past 4K in every mode.
+typedef struct {
+    u8 memory[CPU_MEMORY_SIZE];
+    u64 memory_hash;
+    u8 registers[16];
+    u16 i;
+    u16 delay_timer;
+    u16 sound_timer;
+    u16 pc;
+    Stack_Type stack[CPU_STACK_SIZE];   // the live entries, top first
+    u8 stack_depth;
+    bool paused;
+    u16 current_instruction;            // the Fx0A waiting for a key
+    u8 flags[CPU_FLAGS_COUNT];
+    u8 audio_pattern[CPU_AUDIO_PATTERN];
+    u8 pitch;
+    bool exited;
+    bool halted;
+    u32 rng;
+    Renderer_Frame display;
+    u8 planes;
+} Cpu_State;
+
 typedef struct Cpu {
     struct {
         u8* memory;
@@ -33,29 +163,163 @@ typedef struct Cpu {
         u16 pc; // program counter
         Stack stack;
         bool paused;
-        u8 speed;
+        u32 speed;
+        u8 flags[CPU_FLAGS_COUNT];  // SUPER-CHIP RPL user flags (Fx75/Fx85)
+        u8 audio_pattern[CPU_AUDIO_PATTERN];    // XO-CHIP F002
+        u8 pitch;                   // XO-CHIP Fx3A
+        bool exited;                // SUPER-CHIP 00FD
+        bool halted;                // spinning on a jump to itself
+        u32 rng;                    // xorshift32 state of Cxkk
     };
 
+    Cpu_Idle idle;
+    u64 effects;            // stores, draws, random numbers... anything a loop can change
+    u64 memory_hash;        // of the memory, kept up to date by the stores (see utils/hash.h)
+    u64 idle_skipped;       // instructions skipped in idle loops
+    u8* fusion;             // a Cpu_Fusion per address, NULL when fusion is off
+    u64 interpreted;        // instructions run by the interpreter, fused ones included
+    u64 fused[CPU_FUSION_COUNT];    // instructions run in each kind of sequence
+    bool sound_on;          // the tone as the last Fx18 left it
+    u32 sound_at;           // instructions into the frame of that Fx18, CPU_SOUND_UNCHANGED if none
+    u32 frame_executed;     // instructions into the frame before the Cpu_run going on, Cpu_end_frame resets it
+
+    Cpu_Mode mode;
+    Cpu_Quirks quirks;
+
     bool valid;
     bool has_valid_rom;
+    u32 program_size;
     i32 error;
+    u16 fault_pc;           // instruction that stopped the last Cpu_cycle
+    u16 fault_opcode;
     Cpu_Instruction* instructions;
+    const Cpu_Compiled* compiled;   // NULL once the program overwrites its own code
+    const u8* watched_pages;        // CPU_PAGES flags, NULL when nothing is watched
+    Cpu_Watch on_watch;
+    void* watch_arg;
     u16 current_instruction;
     Renderer* renderer;
     Keyboard* keyboard;
     Speaker* speaker;
 } Cpu;
 
+/// @param: speed: instructions per frame
 Cpu
-Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u8 speed);
+Cpu_init(Renderer* renderer, Keyboard* keyboard, Speaker* speaker, u32 speed, Cpu_Mode mode, Cpu_Quirks quirks);
+
+const Cpu_Quirk_Set*
+Cpu_quirk_set(Cpu_Quirks quirks);
+
+/// @return: false if `name` isn't a profile
+bool
+Cpu_quirks_from_name(const char* name, Cpu_Quirks* quirks);
+
+/// the profile ROMs written for `mode` usually expect
+Cpu_Quirks
+Cpu_default_quirks(Cpu_Mode mode);
+
+/// seeds the random numbers of Cxkk, the same seed gives the same run
+void
+Cpu_seed(Cpu* self, u32 seed);
+
+const char*
+Cpu_error_name(Cpu_Error error);
+
+/// fingerprint of the whole machine: memory, display, registers, timers,
+/// stack... The memory hash follows the stores, the display rows drawn
+/// since the last call are rehashed (128 rows at most) and the rest is
+/// small enough to hash on every call
+u64
+Cpu_state_hash(const Cpu* self);
+
+/// Cpu_state_hash computed from scratch, they must always be equal
+u64
+Cpu_state_hash_full(const Cpu* self);
+
+/// copies the machine state (CPU, memory and display) into `state`
+void
+Cpu_save_state(const Cpu* self, Cpu_State* state);
+
+/// puts the machine back in `state`, a program waiting for a key (Fx0A)
+/// waits again
+void
+Cpu_load_state(Cpu* self, const Cpu_State* state);
+
+/// largest program that fits in the memory of `mode`
+size_t
+Cpu_max_program_size(Cpu_Mode mode);
 
 void
 Cpu_load_program(Cpu* self, u8* program, size_t program_size);
 
-// it will abort if invalid instruction found
+/// runs `compiled` instead of the interpreter where it can,
+/// @return: false if it wasn't generated from the loaded program
+bool
+Cpu_attach_compiled(Cpu* self, const Cpu_Compiled* compiled);
+
+/// calls `on_watch` on every store to a page flagged in `pages` (CPU_PAGES
+/// flags, CPU_PAGE_BITS per page), NULL to watch nothing. The stores to the
+/// other pages only pay for the flag lookup
+void
+Cpu_set_watch(Cpu* self, const u8* pages, Cpu_Watch on_watch, void* arg);
+
+/// fusion is on after Cpu_init, the results are the same without it,
+/// @return: false if the table can't be allocated, fusion stays off
+bool
+Cpu_set_fusion(Cpu* self, bool enabled);
+
+/// the instructions the interpreter ran fused, per sequence
 void
+Cpu_print_fusion_stats(const Cpu* self, FILE* out);
+
+/// runs up to `budget` instructions, less if the program exits, waits for a
+/// key (Fx0A) or faults (Cpu.error is set then, see Cpu_run_frame),
+/// @return: the instructions executed, idle loops skipped included
+u32
+Cpu_run(Cpu* self, u32 budget);
+
+/// what happens between two frames: the timers tick, and the next Cpu_run
+/// starts a new frame
+void
+Cpu_end_frame(Cpu* self);
+
+/// runs the instructions of one frame and ticks the timers, nothing else:
+/// no keyboard, sound or display update,
+/// @return: false on a fault, the instruction stays at pc and Cpu.error,
+/// Cpu.fault_pc and Cpu.fault_opcode tell what went wrong
+bool
+Cpu_run_frame(Cpu* self);
+
+/// Fx18 ran, `executed` instructions into the frame: the tone of the frame
+/// switches there if the sound timer started or stopped
+void
+Cpu_sound_set(Cpu* self, u32 executed);
+
+/// queues the sound of the frame, for a frame that isn't shown
+void
+Cpu_present_sound(Cpu* self);
+
+/// Cpu_present_sound, then publishes the frame
+void
+Cpu_present(Cpu* self);
+
+/// one frame: Cpu_run_frame, then the keyboard, then Cpu_present,
+/// @return: false on a fault, see Cpu_run_frame
+bool
 Cpu_cycle(Cpu* self);
 
+/// a backward jump at `addr` was taken, `executed` instructions into a
+/// `budget` instructions run,
+/// @return: `executed`, or past all the iterations of the loop that fit in
+/// the budget when the loop can't change anything before the next frame
+u32
+Cpu_idle_jump(Cpu* self, u16 addr, u32 executed, u32 budget);
+
+/// executes one instruction at pc with the interpreter,
+/// @return: false on an invalid instruction
+bool
+Cpu_execute(Cpu* self, u16 opcode);
+
 void
 Cpu_deinit(Cpu* self);
 
@@ -0,0 +1,564 @@
+#include "debugger.h"
+#include "analyzer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define DEBUGGER_DUMP_BYTES     16
+
+static Debugger_Stop
+Debugger__stop__(Debugger* self, Debugger_Stop stop);
+
+static void
+Debugger__on_watch__(void* arg, u16 addr, u8 previous, u8 value);
+
+static void
+Debugger__flag_pages__(Debugger* self);
+
+static u16
+Debugger__register__(const Cpu* cpu, u8 reg);
+
+static bool
+Debugger__condition_met__(Debugger* self, const Cpu* cpu);
+
+static bool
+Debugger__parse_register__(const char* name, u8* reg);
+
+static void
+Debugger__print_stop__(const Debugger* self, const Cpu* cpu, FILE* out);
+
+static void
+Debugger__print_instruction__(const Cpu* cpu, u16 addr, FILE* out);
+
+static void
+Debugger__print_registers__(const Debugger* self, const Cpu* cpu, FILE* out);
+
+static void
+Debugger__print_memory__(const Cpu* cpu, u16 addr, u32 count, FILE* out);
+
+static void
+Debugger__print_list__(const Debugger* self, FILE* out);
+
+static void
+Debugger__print_help__(FILE* out);
+
+Debugger
+Debugger_init(void)
+{
+    Debugger self = {};
+
+    self.breakpoints = calloc(CPU_MEMORY_SIZE / 8, 1);
+    self.watched_pages = calloc(CPU_PAGES, 1);
+    if(!self.breakpoints || !self.watched_pages)
+    {
+        Debugger_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+
+    self.valid = true;
+    return self;
+}
+
+void
+Debugger_attach(Debugger* self, Cpu* cpu)
+{
+    Cpu_set_watch(cpu, self->watched_pages, Debugger__on_watch__, self);
+}
+
+void
+Debugger_break(Debugger* self, u16 addr, bool set)
+{
+    const u8 bit = 1 << (addr & 7);
+    u8* byte = &self->breakpoints[addr >> 3];
+
+    if(set && !(*byte & bit))
+    {
+        *byte |= bit;
+        self->breakpoints_count++;
+    }
+    else if(!set && (*byte & bit))
+    {
+        *byte &= ~bit;
+        self->breakpoints_count--;
+    }
+}
+
+bool
+Debugger_watch(Debugger* self, u16 from, u16 to)
+{
+    if(self->watchpoints_count == DEBUGGER_MAX_WATCHPOINTS)
+    {
+        return false;
+    }
+
+    if(to < from)
+    {
+        const u16 swap = from;
+        from = to;
+        to = swap;
+    }
+
+    self->watchpoints[self->watchpoints_count++] = (Debugger__Watch__){ .from = from, .to = to };
+    Debugger__flag_pages__(self);
+    return true;
+}
+
+bool
+Debugger_condition(Debugger* self, const Cpu* cpu, u8 reg, bool on_change, u16 value)
+{
+    if(self->conditions_count == DEBUGGER_MAX_CONDITIONS)
+    {
+        return false;
+    }
+
+    self->conditions[self->conditions_count++] = (Debugger__Condition__){
+        .reg = reg,
+        .on_change = on_change,
+        .value = value,
+        .last = Debugger__register__(cpu, reg),
+    };
+    return true;
+}
+
+void
+Debugger_clear(Debugger* self)
+{
+    memset(self->breakpoints, 0, CPU_MEMORY_SIZE / 8);
+    self->breakpoints_count = 0;
+    self->watchpoints_count = 0;
+    self->conditions_count = 0;
+    Debugger__flag_pages__(self);
+}
+
+void
+Debugger_step(Debugger* self, u32 count)
+{
+    self->steps = count;
+}
+
+void
+Debugger_interrupt(Debugger* self)
+{
+    self->interrupt = 1;
+}
+
+bool
+Debugger_armed(const Debugger* self)
+{
+    return self->breakpoints_count || self->watchpoints_count || self->conditions_count ||
+           self->steps || self->interrupt || self->executed;
+}
+
+Debugger_Stop
+Debugger_run_frame(Debugger* self, Cpu* cpu)
+{
+    // Cpu_run_frame, one instruction at a time and without skipping the
+    // idle loops
+    cpu->error = CPU_NO_ERROR;
+    cpu->idle.valid = false;
+    while(self->executed < cpu->speed && !cpu->exited && !cpu->paused)
+    {
+        const u16 pc = cpu->pc;
+
+        if(self->interrupt)
+        {
+            self->interrupt = 0;
+            return Debugger__stop__(self, DEBUGGER_STOP_INTERRUPT);
+        }
+
+        if(!self->resume && (self->breakpoints[pc >> 3] & (1 << (pc & 7))))
+        {
+            return Debugger__stop__(self, DEBUGGER_STOP_BREAKPOINT);
+        }
+        self->resume = false;
+
+        const u16 opcode = (cpu->memory[pc] << 8) | cpu->memory[(pc + 1) & (CPU_MEMORY_SIZE - 1)];
+        if(!Cpu_execute(cpu, opcode))
+        {
+            cpu->pc = pc;
+            cpu->fault_pc = pc;
+            cpu->fault_opcode = opcode;
+            self->executed = 0;
+            return DEBUGGER_FRAME_DONE;
+        }
+        self->executed++;
+
+        if((opcode & 0xF0FF) == 0xF018)
+        {
+            Cpu_sound_set(cpu, self->executed);
+        }
+
+        // nothing else happens until the frame ends
+        if(opcode == (0x1000 | pc))
+        {
+            cpu->halted = true;
+            self->executed = cpu->speed;
+        }
+
+        if(self->watch_hit)
+        {
+            self->watch_hit = false;
+            return Debugger__stop__(self, DEBUGGER_STOP_WATCHPOINT);
+        }
+
+        if(self->conditions_count && Debugger__condition_met__(self, cpu))
+        {
+            return Debugger__stop__(self, DEBUGGER_STOP_CONDITION);
+        }
+
+        if(self->steps && --self->steps == 0)
+        {
+            return Debugger__stop__(self, DEBUGGER_STOP_STEP);
+        }
+    }
+
+    self->executed = 0;
+    Cpu_end_frame(cpu);
+    return DEBUGGER_FRAME_DONE;
+}
+
+bool
+Debugger_console(Debugger* self, Cpu* cpu, FILE* in, FILE* out)
+{
+    Debugger__print_stop__(self, cpu, out);
+
+    char line[DEBUGGER_LINE_SIZE];
+
+    for(;;)
+    {
+        fputs("(chip8) ", out);
+        fflush(out);
+
+        if(!fgets(line, sizeof(line), in))
+        {
+            fputc('\n', out);
+            return false;
+        }
+
+        // an empty line does the last command again
+        if(strspn(line, " \t\r\n") == strlen(line))
+        {
+            strcpy(line, self->last_command);
+        }
+        strcpy(self->last_command, line);
+
+        char command[16] = "";
+        char first[32] = "";
+        char second[32] = "";
+        const int words = sscanf(line, "%15s %31s %31s", command, first, second);
+        if(words <= 0)
+        {
+            continue;
+        }
+
+        const u16 a = (u16)strtoul(first, NULL, 16);
+        const u16 b = (u16)strtoul(second, NULL, 16);
+
+        if(strcmp(command, "c") == 0 || strcmp(command, "continue") == 0)
+        {
+            self->steps = 0;
+            return true;
+        }
+        else if(strcmp(command, "s") == 0 || strcmp(command, "step") == 0)
+        {
+            Debugger_step(self, words >= 2 ? (u32)strtoul(first, NULL, 10) : 1);
+            return true;
+        }
+        else if(strcmp(command, "q") == 0 || strcmp(command, "quit") == 0)
+        {
+            return false;
+        }
+        else if((strcmp(command, "b") == 0 || strcmp(command, "break") == 0) && words >= 2)
+        {
+            Debugger_break(self, a, true);
+            fprintf(out, "breakpoint at 0x%03X\n", a);
+        }
+        else if((strcmp(command, "d") == 0 || strcmp(command, "delete") == 0) && words >= 2)
+        {
+            Debugger_break(self, a, false);
+        }
+        else if((strcmp(command, "w") == 0 || strcmp(command, "watch") == 0) && words >= 2)
+        {
+            if(!Debugger_watch(self, a, words >= 3 ? b : a))
+            {
+                fprintf(out, "no more than %d watchpoints\n", DEBUGGER_MAX_WATCHPOINTS);
+            }
+        }
+        else if(strcmp(command, "cond") == 0 && words >= 2)
+        {
+            u8 reg;
+            if(!Debugger__parse_register__(first, &reg))
+            {
+                fprintf(out, "no register %s, V0 to VF or I\n", first);
+            }
+            else if(!Debugger_condition(self, cpu, reg, words < 3, b))
+            {
+                fprintf(out, "no more than %d conditions\n", DEBUGGER_MAX_CONDITIONS);
+            }
+        }
+        else if(strcmp(command, "clear") == 0)
+        {
+            Debugger_clear(self);
+        }
+        else if(strcmp(command, "l") == 0 || strcmp(command, "list") == 0)
+        {
+            Debugger__print_list__(self, out);
+        }
+        else if(strcmp(command, "r") == 0 || strcmp(command, "regs") == 0)
+        {
+            Debugger__print_registers__(self, cpu, out);
+        }
+        else if((strcmp(command, "x") == 0 || strcmp(command, "mem") == 0) && words >= 2)
+        {
+            Debugger__print_memory__(cpu, a, words >= 3 ? (u32)strtoul(second, NULL, 10) : DEBUGGER_DUMP_BYTES, out);
+        }
+        else
+        {
+            Debugger__print_help__(out);
+        }
+    }
+}
+
+void
+Debugger_deinit(Debugger* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    free(self->breakpoints);
+    free(self->watched_pages);
+
+    self->breakpoints = NULL;
+    self->watched_pages = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+Debugger_Stop
+Debugger__stop__(Debugger* self, Debugger_Stop stop)
+{
+    // only a breakpoint stops before its instruction ran, resuming runs it
+    // without stopping there again
+    self->resume = stop == DEBUGGER_STOP_BREAKPOINT;
+    self->steps = 0;
+    self->stop = stop;
+    return stop;
+}
+
+// called by the cpu on the stores to the watched pages only
+void
+Debugger__on_watch__(void* arg, u16 addr, u8 previous, u8 value)
+{
+    Debugger* self = arg;
+
+    for(u32 iii = 0; iii < self->watchpoints_count; iii++)
+    {
+        const Debugger__Watch__* watch = &self->watchpoints[iii];
+        if(addr >= watch->from && addr <= watch->to)
+        {
+            self->watch_hit = true;
+            self->watch_addr = addr;
+            self->watch_previous = previous;
+            self->watch_value = value;
+            return;
+        }
+    }
+}
+
+void
+Debugger__flag_pages__(Debugger* self)
+{
+    memset(self->watched_pages, 0, CPU_PAGES);
+    for(u32 iii = 0; iii < self->watchpoints_count; iii++)
+    {
+        const Debugger__Watch__* watch = &self->watchpoints[iii];
+        for(u32 page = watch->from >> CPU_PAGE_BITS; page <= (u32)(watch->to >> CPU_PAGE_BITS); page++)
+        {
+            self->watched_pages[page] = 1;
+        }
+    }
+}
+
+u16
+Debugger__register__(const Cpu* cpu, u8 reg)
+{
+    return reg == DEBUGGER_REGISTER_I ? cpu->i : cpu->registers[reg];
+}
+
+// a register reaching its value or changing, not staying there
+bool
+Debugger__condition_met__(Debugger* self, const Cpu* cpu)
+{
+    bool met = false;
+    for(u32 iii = 0; iii < self->conditions_count; iii++)
+    {
+        Debugger__Condition__* condition = &self->conditions[iii];
+        const u16 value = Debugger__register__(cpu, condition->reg);
+        if(value != condition->last && (condition->on_change || value == condition->value))
+        {
+            met = true;
+        }
+        condition->last = value;
+    }
+
+    return met;
+}
+
+bool
+Debugger__parse_register__(const char* name, u8* reg)
+{
+    if(tolower((unsigned char)name[0]) == 'i' && name[1] == '\0')
+    {
+        *reg = DEBUGGER_REGISTER_I;
+        return true;
+    }
+
+    if(tolower((unsigned char)name[0]) != 'v' || !isxdigit((unsigned char)name[1]) || name[2] != '\0')
+    {
+        return false;
+    }
+
+    *reg = (u8)strtoul(name + 1, NULL, 16);
+    return true;
+}
+
+void
+Debugger__print_stop__(const Debugger* self, const Cpu* cpu, FILE* out)
+{
+    switch(self->stop)
+    {
+        case DEBUGGER_STOP_BREAKPOINT:
+            fprintf(out, "breakpoint at 0x%03X\n", cpu->pc);
+            break;
+        case DEBUGGER_STOP_WATCHPOINT:
+            fprintf(out, "watchpoint: [0x%03X] %02X -> %02X\n", self->watch_addr, self->watch_previous, self->watch_value);
+            break;
+        case DEBUGGER_STOP_CONDITION:
+            fputs("condition met\n", out);
+            break;
+        case DEBUGGER_STOP_INTERRUPT:
+            fputs("interrupted\n", out);
+            break;
+        default:
+            break;
+    }
+
+    Debugger__print_instruction__(cpu, cpu->pc, out);
+}
+
+void
+Debugger__print_instruction__(const Cpu* cpu, u16 addr, FILE* out)
+{
+    const Analyzer_Instruction instruction = Analyzer_decode(cpu->memory, addr, cpu->mode);
+    char mnemonic[32];
+    Analyzer_format(&instruction, mnemonic, sizeof(mnemonic));
+
+    fprintf(out, "0x%03X: %04X  %s\n", addr, instruction.opcode, mnemonic);
+}
+
+void
+Debugger__print_registers__(const Debugger* self, const Cpu* cpu, FILE* out)
+{
+    fprintf(out, "pc 0x%03X  i 0x%03X  dt %u  st %u  %u/%u instructions into the frame%s\n",
+        cpu->pc,
+        cpu->i,
+        cpu->delay_timer,
+        cpu->sound_timer,
+        self->executed,
+        cpu->speed,
+        cpu->paused ? ", waiting for a key" : ""
+    );
+
+    for(u8 reg = 0; reg < 16; reg++)
+    {
+        fprintf(out, "V%X %02X%s", reg, cpu->registers[reg], reg % 8 == 7 ? "\n" : "  ");
+    }
+
+    const Stack* stack = &cpu->stack;
+    fputs("stack:", out);
+    for(const Stack_Type* entry = stack->stack_ptr; entry < stack->data + stack->size; entry++)
+    {
+        fprintf(out, " 0x%03X", (u16)*entry);
+    }
+    fputc('\n', out);
+}
+
+void
+Debugger__print_memory__(const Cpu* cpu, u16 addr, u32 count, FILE* out)
+{
+    for(u32 iii = 0; iii < count; iii++)
+    {
+        const u16 at = (u16)(addr + iii);
+        if(iii % DEBUGGER_DUMP_BYTES == 0)
+        {
+            fprintf(out, "%s0x%03X:", iii ? "\n" : "", at);
+        }
+        fprintf(out, " %02X", cpu->memory[at]);
+    }
+    fputc('\n', out);
+}
+
+void
+Debugger__print_list__(const Debugger* self, FILE* out)
+{
+    for(u32 addr = 0; addr < CPU_MEMORY_SIZE; addr++)
+    {
+        if(self->breakpoints[addr >> 3] & (1 << (addr & 7)))
+        {
+            fprintf(out, "break 0x%03X\n", addr);
+        }
+    }
+
+    for(u32 iii = 0; iii < self->watchpoints_count; iii++)
+    {
+        fprintf(out, "watch 0x%03X 0x%03X\n", self->watchpoints[iii].from, self->watchpoints[iii].to);
+    }
+
+    for(u32 iii = 0; iii < self->conditions_count; iii++)
+    {
+        const Debugger__Condition__* condition = &self->conditions[iii];
+        if(condition->reg == DEBUGGER_REGISTER_I)
+        {
+            fputs("cond I", out);
+        }
+        else
+        {
+            fprintf(out, "cond V%X", condition->reg);
+        }
+
+        if(condition->on_change)
+        {
+            fputs(" changes\n", out);
+        }
+        else
+        {
+            fprintf(out, " == 0x%02X\n", condition->value);
+        }
+    }
+}
+
+void
+Debugger__print_help__(FILE* out)
+{
+    fputs(
+        "numbers are hex, but the counts\n"
+        "  b, break <addr>       stop before the instruction at addr\n"
+        "  d, delete <addr>      remove that breakpoint\n"
+        "  w, watch <addr> [end] stop after a store from addr to end\n"
+        "  cond <Vx|I> [value]   stop when the register becomes value, or changes\n"
+        "  clear                 remove every breakpoint, watchpoint and condition\n"
+        "  l, list               what is set\n"
+        "  s, step [n]           run n instructions (1)\n"
+        "  c, continue           run until something stops it\n"
+        "  r, regs               registers, timers and stack\n"
+        "  x, mem <addr> [n]     n bytes of memory (16)\n"
+        "  q, quit\n"
+        "an empty line repeats the last command\n",
+        out
+    );
+}
@@ -0,0 +1,123 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "utils/type_alias.h"
+#include "cpu.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+
+#define DEBUGGER_MAX_WATCHPOINTS    16
+#define DEBUGGER_MAX_CONDITIONS     16
+#define DEBUGGER_REGISTER_I         16      // Debugger_condition: I instead of a Vx
+#define DEBUGGER_LINE_SIZE          128
+
+// why Debugger_run_frame came back
+typedef enum {
+    DEBUGGER_FRAME_DONE,        // the frame ran to its end, or faulted
+    DEBUGGER_STOP_BREAKPOINT,   // pc reached a breakpoint, not executed yet
+    DEBUGGER_STOP_WATCHPOINT,   // the last instruction stored in a watched range
+    DEBUGGER_STOP_CONDITION,    // the last instruction met a register condition
+    DEBUGGER_STOP_STEP,         // the steps asked for are done
+    DEBUGGER_STOP_INTERRUPT,    // Debugger_interrupt (^C)
+} Debugger_Stop;
+
+typedef struct {
+    u16 from;
+    u16 to;                     // included
+} Debugger__Watch__;
+
+typedef struct {
+    u8 reg;                     // V0 to VF, or DEBUGGER_REGISTER_I
+    bool on_change;             // any change, else equal to `value`
+    u16 value;
+    u16 last;                   // value after the last instruction
+} Debugger__Condition__;
+
+// Breakpoints, watchpoints, register conditions and single steps, with a
+// console on stdin to drive them.
+//
+// Nothing is checked while nothing is set: the caller keeps running
+// Cpu_run_frame as usual, and only switches to Debugger_run_frame, an
+// interpreter loop that checks everything between two instructions, while
+// Debugger_armed. The breakpoints are one bit per address, the watchpoints
+// flag their pages to the cpu (Cpu_set_watch) so only the stores to those
+// pages are compared with the ranges.
+typedef struct {
+    u8* breakpoints;            // one bit per address
+    u32 breakpoints_count;
+    u8* watched_pages;          // CPU_PAGES flags, given to the cpu
+    Debugger__Watch__ watchpoints[DEBUGGER_MAX_WATCHPOINTS];
+    u32 watchpoints_count;
+    Debugger__Condition__ conditions[DEBUGGER_MAX_CONDITIONS];
+    u32 conditions_count;
+    u32 steps;                  // instructions left to step, 0 when running
+    volatile sig_atomic_t interrupt;
+
+    u32 executed;               // into the frame stopped in
+    bool resume;                // don't stop again on the breakpoint at pc
+    bool watch_hit;
+    u16 watch_addr;
+    u8 watch_previous;
+    u8 watch_value;
+    Debugger_Stop stop;         // the last one
+    char last_command[DEBUGGER_LINE_SIZE];  // done again on an empty line
+    bool valid;
+} Debugger;
+
+Debugger
+Debugger_init(void);
+
+/// flags the watched pages to `cpu`, `self` should not move after that
+void
+Debugger_attach(Debugger* self, Cpu* cpu);
+
+/// sets or clears the breakpoint at `addr`
+void
+Debugger_break(Debugger* self, u16 addr, bool set);
+
+/// stops after any store from `from` to `to` (included), even one that
+/// doesn't change the value
+/// @return: false when DEBUGGER_MAX_WATCHPOINTS are set
+bool
+Debugger_watch(Debugger* self, u16 from, u16 to);
+
+/// stops after an instruction leaves `reg` (0 to 15 for Vx, or
+/// DEBUGGER_REGISTER_I) equal to `value`, or after any change of it
+/// @return: false when DEBUGGER_MAX_CONDITIONS are set
+bool
+Debugger_condition(Debugger* self, const Cpu* cpu, u8 reg, bool on_change, u16 value);
+
+/// removes every breakpoint, watchpoint and condition
+void
+Debugger_clear(Debugger* self);
+
+/// stops again after `count` instructions
+void
+Debugger_step(Debugger* self, u32 count);
+
+/// stops before the next instruction, safe from a signal handler
+void
+Debugger_interrupt(Debugger* self);
+
+/// anything set, or a stop asked for: Debugger_run_frame has to run the frame
+bool
+Debugger_armed(const Debugger* self);
+
+/// runs the rest of the frame one instruction at a time with the
+/// interpreter, like Cpu_run_frame, until it ends or something stops it.
+/// Called again after a stop, it goes on with the same frame
+Debugger_Stop
+Debugger_run_frame(Debugger* self, Cpu* cpu);
+
+/// tells why it stopped and reads commands from `in` until one resumes
+/// (`help` lists them)
+/// @return: false if asked to quit
+bool
+Debugger_console(Debugger* self, Cpu* cpu, FILE* in, FILE* out);
+
+void
+Debugger_deinit(Debugger* self);
+
+#endif // DEBUGGER_H
@@ -0,0 +1,366 @@
+#include "display.h"
+#include "utils/clock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL2/SDL.h>
+
+#define WINDOW_TITLE        "Chip 8"
+#define DISPLAY_TILE_GAP    2               // pixels between the tiles of a wall
+#define DISPLAY_GAP_COLOR   0xFF333333
+#define DISPLAY_WALL_HZ     60              // presentations of a wall per second at most, without vsync
+
+static int
+Display__thread__(void* arg);
+
+static bool
+Display__draw_tile__(Display* self, u32 tile);
+
+static void
+Display__present__(Display* self);
+
+Display
+Display_init(u32 count, i32 scale, bool vsync, Upscaler_Filter filter)
+{
+    Display self = {};
+
+    if(count == 0 || scale <= 0)
+    {
+        fputs("Error: Display: no tile or a bad scale\n", stderr);
+        self.valid = false;
+        return self;
+    }
+
+    self.scale = scale;
+    self.vsync = vsync;
+    self.count = count;
+    self.cols = (u32)ceil(sqrt(count));
+    self.rows = (count + self.cols - 1) / self.cols;
+    self.tile_width = CANVAS_COLS * scale;
+    self.tile_height = CANVAS_ROWS * scale;
+
+    // for some unknown reason(s) we should remove the last col/row of every
+    // tile, a single tile is the whole window, as without a wall
+    const i32 gap = count > 1 ? DISPLAY_TILE_GAP : 0;
+    self.width = self.cols * (self.tile_width - scale) + (self.cols - 1) * gap;
+    self.height = self.rows * (self.tile_height - scale) + (self.rows - 1) * gap;
+    self.pitch = self.width * sizeof(u32);
+
+    self.tiles = calloc(count, sizeof(Display__Tile__));
+    self.atlas = count > 1 ? malloc((size_t)self.pitch * self.height) : NULL;
+    self.frame_ready = SDL_CreateSemaphore(0);
+    if(!self.tiles || (count > 1 && !self.atlas) || !self.frame_ready)
+    {
+        self.valid = false;
+        return self;
+    }
+
+    for(u32 iii = 0; iii < count; iii++)
+    {
+        self.tiles[iii].upscaler = Upscaler_init(self.tile_width, self.tile_height, filter);
+        if(!self.tiles[iii].upscaler.valid)
+        {
+            self.valid = false;
+            return self;
+        }
+    }
+
+    // the gaps and the tiles that have no frame yet
+    for(i32 iii = 0; self.atlas && iii < self.width * self.height; iii++)
+    {
+        self.atlas[iii] = DISPLAY_GAP_COLOR;
+    }
+
+    atomic_init(&self.quit, false);
+    atomic_init(&self.first_present_ns, 0);
+
+    self.valid = true;
+    return self;
+}
+
+bool
+Display_attach(Display* self, u32 tile, TripleBuffer* frames)
+{
+    if(!self || !self->valid || tile >= self->count || self->thread)
+    {
+        return false;
+    }
+
+    self->tiles[tile].frames = frames;
+    return true;
+}
+
+bool
+Display_start(Display* self)
+{
+    if(!self || !self->valid)
+    {
+        return false;
+    }
+
+    const u32 WINDOW_FLAGS    = 0;
+    const u32 SDL_FLAGS       = SDL_INIT_VIDEO;
+
+    if(SDL_InitSubSystem(SDL_FLAGS) != 0)
+    {
+        fputs(SDL_GetError(), stderr);
+        return false;
+    }
+
+    self->window = SDL_CreateWindow(
+        WINDOW_TITLE,
+        SDL_WINDOWPOS_CENTERED,
+        SDL_WINDOWPOS_CENTERED,
+        self->width,
+        self->height,
+        WINDOW_FLAGS
+    );
+
+    if(!self->window)
+    {
+        fputs(SDL_GetError(), stderr);
+        return false;
+    }
+
+    self->started = SDL_CreateSemaphore(0);
+    self->thread = self->started ? SDL_CreateThread(Display__thread__, "display", self) : NULL;
+
+    if(!self->thread)
+    {
+        fputs(SDL_GetError(), stderr);
+        return false;
+    }
+
+    // the SDL renderer is created on the thread, it has to tell how it went
+    SDL_SemWait(self->started);
+    if(self->failed)
+    {
+        SDL_WaitThread(self->thread, NULL);
+        self->thread = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void
+Display_notify(Display* self)
+{
+    SDL_SemPost(self->frame_ready);
+}
+
+void
+Display_set_title(Display* self, const char* title)
+{
+    if(!self || !self->valid || !self->window)
+    {
+        return;
+    }
+
+    SDL_SetWindowTitle(self->window, title);
+}
+
+void
+Display_deinit(Display* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    if(self->thread)
+    {
+        // the render thread destroys its own SDL renderer before it returns
+        atomic_store(&self->quit, true);
+        SDL_SemPost(self->frame_ready);
+        SDL_WaitThread(self->thread, NULL);
+        self->thread = NULL;
+    }
+
+    if(self->window)
+    {
+        SDL_DestroyWindow(self->window);
+        self->window = NULL;
+    }
+
+    if(self->frame_ready)
+    {
+        SDL_DestroySemaphore(self->frame_ready);
+        self->frame_ready = NULL;
+    }
+
+    if(self->started)
+    {
+        SDL_DestroySemaphore(self->started);
+        self->started = NULL;
+    }
+
+    if(self->tiles)
+    {
+        for(u32 iii = 0; iii < self->count; iii++)
+        {
+            Upscaler_deinit(&self->tiles[iii].upscaler);
+        }
+        free(self->tiles);
+        self->tiles = NULL;
+    }
+
+    free(self->atlas);
+    self->atlas = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+int
+Display__thread__(void* arg)
+{
+    Display* self = arg;
+
+    // the SDL renderer lives on this thread only, so presentation (and vsync)
+    // never blocks the emulation threads
+    const u32 RENDERER_FLAGS = self->vsync ? SDL_RENDERER_PRESENTVSYNC : 0;
+    self->sdl_renderer = SDL_CreateRenderer(self->window, -1, RENDERER_FLAGS);
+
+    if(!self->sdl_renderer)
+    {
+        fputs(SDL_GetError(), stderr);
+        self->failed = true;
+        SDL_SemPost(self->started);
+        return -1;
+    }
+
+    // a single tile is uploaded whole, then cropped when drawn
+    self->texture = SDL_CreateTexture(
+        self->sdl_renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        self->count > 1 ? self->width : self->tile_width,
+        self->count > 1 ? self->height : self->tile_height
+    );
+
+    if(!self->texture)
+    {
+        fputs(SDL_GetError(), stderr);
+        SDL_DestroyRenderer(self->sdl_renderer);
+        self->sdl_renderer = NULL;
+        self->failed = true;
+        SDL_SemPost(self->started);
+        return -1;
+    }
+
+    SDL_SemPost(self->started);
+
+    // the tiles of a wall publish out of phase, without vsync the atlas
+    // would be uploaded on every one of them
+    const u64 period_ns = self->count > 1 && !self->vsync ? CLOCK_NS_PER_SEC / DISPLAY_WALL_HZ : 0;
+    u64 next_ns = 0;
+
+    while(true)
+    {
+        if(period_ns)
+        {
+            Clock_sleep_until_ns(next_ns);
+        }
+
+        SDL_SemWait(self->frame_ready);
+
+        if(atomic_load(&self->quit))
+        {
+            break;
+        }
+
+        // skip the frames published while we were presenting, every tile
+        // shows its last one
+        while(SDL_SemTryWait(self->frame_ready) == 0);
+
+        bool changed = false;
+        for(u32 tile = 0; tile < self->count; tile++)
+        {
+            changed |= Display__draw_tile__(self, tile);
+        }
+
+        if(changed)
+        {
+            Display__present__(self);
+            next_ns = Clock_now_ns() + period_ns;
+        }
+    }
+
+    //Destroy the renderer created above
+    SDL_DestroyTexture(self->texture);
+    SDL_DestroyRenderer(self->sdl_renderer);
+    self->texture = NULL;
+    self->sdl_renderer = NULL;
+
+    return 0;
+}
+
+// upscales the last frame of the tile into its place in the atlas,
+// returns false if it didn't publish a new one
+bool
+Display__draw_tile__(Display* self, u32 tile)
+{
+    Display__Tile__* place = &self->tiles[tile];
+    if(!place->frames || !TripleBuffer_acquire(place->frames))
+    {
+        return false;
+    }
+
+    // only the rows that changed since the last frame are upscaled again
+    const Renderer_Frame* frame = TripleBuffer_front(place->frames);
+    Upscaler_run(
+        &place->upscaler,
+        &frame->planes[0][0][0],
+        Renderer_Frame_cols(frame),
+        Renderer_Frame_rows(frame)
+    );
+
+    // a single tile is uploaded straight from its upscaler
+    if(self->count == 1)
+    {
+        return true;
+    }
+
+    // without the last col/row of the tile, as a single one
+    const i32 width = self->tile_width - self->scale;
+    const i32 height = self->tile_height - self->scale;
+    const i32 x = (tile % self->cols) * (width + DISPLAY_TILE_GAP);
+    const i32 y = (tile / self->cols) * (height + DISPLAY_TILE_GAP);
+    const u8* source = (const u8*)place->upscaler.pixels;
+    u8* target = (u8*)self->atlas + (size_t)y * self->pitch + x * sizeof(u32);
+    for(i32 line = 0; line < height; line++)
+    {
+        memcpy(target, source, width * sizeof(u32));
+        source += place->upscaler.pitch;
+        target += self->pitch;
+    }
+
+    return true;
+}
+
+// one upload and one draw for the whole atlas
+void
+Display__present__(Display* self)
+{
+    if(self->count == 1)
+    {
+        SDL_UpdateTexture(self->texture, NULL, self->tiles[0].upscaler.pixels, self->tiles[0].upscaler.pitch);
+    }
+    else
+    {
+        SDL_UpdateTexture(self->texture, NULL, self->atlas, self->pitch);
+    }
+
+    SDL_Rect visible = { 0, 0, self->width, self->height };
+    SDL_RenderCopy(self->sdl_renderer, self->texture, &visible, NULL);
+
+    SDL_RenderPresent(self->sdl_renderer);
+
+    if(atomic_load_explicit(&self->first_present_ns, memory_order_relaxed) == 0)
+    {
+        atomic_store(&self->first_present_ns, Clock_now_ns());
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "utils/type_alias.h"
+#include "utils/triple_buffer.h"
+#include "renderer_frame.h"
+#include "upscaler.h"
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// one place of the atlas, shows the frames of one renderer
+typedef struct {
+    TripleBuffer* frames;   // Renderer_Frame slots published by the renderer, NULL when empty
+    Upscaler upscaler;      // only used by the render thread
+} Display__Tile__;
+
+// The window, the SDL renderer and the thread that presents the frames.
+// The renderers only publish into their tile (see Renderer_set_display),
+// each from its own thread and at its own pace; the render thread takes the
+// last frame of every tile that published one, upscales it into its place
+// in an atlas of tiles, then uploads the atlas and draws it once per
+// presentation, however many tiles there are. Without vsync a wall is
+// presented DISPLAY_WALL_HZ times a second at most.
+typedef struct {
+    i32 scale;              // window pixels per lores pixel
+    bool vsync;
+    u32 count;              // tiles
+    u32 cols;               // of tiles, in the atlas
+    u32 rows;
+    i32 tile_width;         // in pixels, upscaled, the last col/row isn't shown
+    i32 tile_height;
+    i32 width;              // of the window, and of the atlas
+    i32 height;
+    Display__Tile__* tiles;
+    u32* atlas;             // ARGB8888, the whole window, NULL for a single tile (its upscaler's pixels)
+    i32 pitch;              // in bytes
+    void* window;
+    void* sdl_renderer;
+    void* texture;          // streaming texture the atlas is uploaded to
+    void* frame_ready;      // SDL_sem, posted on every publish of any tile
+    void* thread;           // SDL_Thread that presents the frames
+    void* started;          // SDL_sem, posted once the thread has its SDL renderer, or failed to
+    bool failed;            // no SDL renderer or texture, the thread returned
+    atomic_bool quit;
+    _Atomic u64 first_present_ns;   // Clock_now_ns of the first frame shown, 0 before
+    bool valid;
+} Display;
+
+/// the atlas only, the window opens with Display_start
+/// @param: count: tiles, laid out in a grid as square as it gets
+/// @param: scale: window pixels per lores pixel of a tile
+/// @param: filter: smoothing applied by the upscalers, see Upscaler_Filter
+Display
+Display_init(u32 count, i32 scale, bool vsync, Upscaler_Filter filter);
+
+/// shows the frames published to `frames` in `tile`, before Display_start
+bool
+Display_attach(Display* self, u32 tile, TripleBuffer* frames);
+
+/// opens the window and starts the render thread, `self` should not move
+/// after that. Call it from the main thread, SDL wants the video there
+/// @return: false if the window, or the SDL renderer of the thread, can't be
+/// created
+bool
+Display_start(Display* self);
+
+/// a tile published a frame, wakes the render thread up
+void
+Display_notify(Display* self);
+
+/// replaces the window title, nothing before Display_start
+void
+Display_set_title(Display* self, const char* title);
+
+void
+Display_deinit(Display* self);
+
+#endif // DISPLAY_H
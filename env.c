@@ -0,0 +1,323 @@
+#include "env.h"
+#include "utils/hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+static int
+Env__thread__(void* arg);
+
+static void
+Env__run__(Env* self, u32 first, u32 count);
+
+static void
+Env__reset_instance__(Env* self, u32 index);
+
+static void
+Env__observe__(const Renderer_Frame* display, u8* observation);
+
+Env
+Env_init(const u8* program, size_t program_size, Env_Options options)
+{
+    Env env = {};
+
+    if(options.count == 0 || program_size > Cpu_max_program_size(options.mode))
+    {
+        fputs("Error: Env: no environment, or the program doesn't fit\n", stderr);
+        env.valid = false;
+        return env;
+    }
+
+    if(options.threads == 0)
+    {
+        options.threads = (u32)SDL_GetCPUCount();
+    }
+    if(options.threads > options.count)
+    {
+        options.threads = options.count;
+    }
+    if(options.threads > ENV_MAX_THREADS)
+    {
+        options.threads = ENV_MAX_THREADS;
+    }
+    env.options = options;
+
+    env.instances = calloc(options.count, sizeof(Env__Instance__));
+    env.initial = malloc(sizeof(Cpu_State));
+    env.workers = calloc(options.threads, sizeof(Env__Worker__));
+    if(!env.instances || !env.initial || !env.workers)
+    {
+        Env_deinit(&env);
+        env.valid = false;
+        return env;
+    }
+
+    for(u32 iii = 0; iii < options.count; iii++)
+    {
+        Env__Instance__* instance = &env.instances[iii];
+
+        instance->keyboard = Keyboard_init();
+        instance->speaker = Speaker_init_silent();
+        instance->renderer = Renderer_init();
+        instance->cpu = Cpu_init(&instance->renderer, &instance->keyboard, &instance->speaker, options.speed, options.mode, options.quirks);
+        if(!instance->keyboard.valid || !instance->renderer.valid || !instance->cpu.valid)
+        {
+            Env_deinit(&env);
+            env.valid = false;
+            return env;
+        }
+
+        Cpu_load_program(&instance->cpu, (u8*)program, program_size);
+        instance->needs_reset = true;
+    }
+
+    // the seed is set on every reset, only the rest has to be saved
+    Cpu_save_state(&env.instances[0].cpu, env.initial);
+
+    env.valid = true;
+    return env;
+}
+
+bool
+Env_start(Env* self)
+{
+    if(!self || !self->valid)
+    {
+        return false;
+    }
+
+    self->done = SDL_CreateSemaphore(0);
+    if(!self->done)
+    {
+        fputs(SDL_GetError(), stderr);
+        return false;
+    }
+
+    // the instances are split in slices, the caller takes the first one
+    const u32 threads = self->options.threads;
+    for(u32 iii = 0; iii < threads; iii++)
+    {
+        Env__Worker__* worker = &self->workers[iii];
+        worker->env = self;
+        worker->first = (u32)((u64)self->options.count * iii / threads);
+        worker->count = (u32)((u64)self->options.count * (iii + 1) / threads) - worker->first;
+
+        if(iii == 0)
+        {
+            continue;
+        }
+
+        worker->start = SDL_CreateSemaphore(0);
+        worker->thread = worker->start ? SDL_CreateThread(Env__thread__, "env", worker) : NULL;
+        if(!worker->thread)
+        {
+            fputs(SDL_GetError(), stderr);
+            return false;
+        }
+        self->workers_count = iii;
+    }
+
+    return true;
+}
+
+void
+Env_reset(Env* self, u8* observations)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    for(u32 iii = 0; iii < self->options.count; iii++)
+    {
+        Env__reset_instance__(self, iii);
+        Env__observe__(self->instances[iii].renderer.display, &observations[(size_t)iii * ENV_OBSERVATION_SIZE]);
+    }
+}
+
+void
+Env_step(Env* self, const u16* actions, u8* observations, f32* rewards, u8* dones)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    self->actions = actions;
+    self->observations = observations;
+    self->rewards = rewards;
+    self->dones = dones;
+
+    for(u32 iii = 1; iii <= self->workers_count; iii++)
+    {
+        SDL_SemPost(self->workers[iii].start);
+    }
+
+    Env__run__(self, self->workers[0].first, self->workers[0].count);
+
+    for(u32 iii = 1; iii <= self->workers_count; iii++)
+    {
+        SDL_SemWait(self->done);
+    }
+
+    self->frames += self->options.count;
+}
+
+void
+Env_deinit(Env* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    if(self->workers)
+    {
+        self->quit = true;
+        for(u32 iii = 1; iii <= self->workers_count; iii++)
+        {
+            SDL_SemPost(self->workers[iii].start);
+            SDL_WaitThread(self->workers[iii].thread, NULL);
+        }
+
+        for(u32 iii = 0; iii < self->options.threads; iii++)
+        {
+            if(self->workers[iii].start) SDL_DestroySemaphore(self->workers[iii].start);
+        }
+    }
+    if(self->done) SDL_DestroySemaphore(self->done);
+
+    if(self->instances)
+    {
+        for(u32 iii = 0; iii < self->options.count; iii++)
+        {
+            Env__Instance__* instance = &self->instances[iii];
+            if(instance->cpu.valid)
+            {
+                Cpu_deinit(&instance->cpu);
+            }
+            if(instance->renderer.valid)
+            {
+                Renderer_deinit(&instance->renderer);
+            }
+            if(instance->keyboard.valid)
+            {
+                Keyboard_deinit(&instance->keyboard);
+            }
+        }
+    }
+
+    free(self->instances);
+    free(self->initial);
+    free(self->workers);
+
+    self->instances = NULL;
+    self->initial = NULL;
+    self->workers = NULL;
+    self->done = NULL;
+    self->workers_count = 0;
+    self->valid = false;
+}
+
+
+// Private functions
+int
+Env__thread__(void* arg)
+{
+    Env__Worker__* worker = arg;
+    Env* env = worker->env;
+
+    for(;;)
+    {
+        SDL_SemWait(worker->start);
+        if(env->quit)
+        {
+            break;
+        }
+
+        Env__run__(env, worker->first, worker->count);
+        SDL_SemPost(env->done);
+    }
+
+    return 0;
+}
+
+void
+Env__run__(Env* self, u32 first, u32 count)
+{
+    const Env_Options* options = &self->options;
+
+    for(u32 iii = first; iii < first + count; iii++)
+    {
+        Env__Instance__* instance = &self->instances[iii];
+        Cpu* cpu = &instance->cpu;
+
+        if(instance->needs_reset)
+        {
+            Env__reset_instance__(self, iii);
+        }
+
+        Keyboard_set_keys(&instance->keyboard, self->actions[iii]);
+        const bool ok = Cpu_run_frame(cpu);
+        instance->frames++;
+
+        Env__observe__(instance->renderer.display, &self->observations[(size_t)iii * ENV_OBSERVATION_SIZE]);
+        self->rewards[iii] = options->reward ? options->reward(cpu, iii, options->reward_arg) : 0.0f;
+
+        instance->needs_reset = !ok || cpu->exited || cpu->halted ||
+            (options->max_frames && instance->frames >= options->max_frames);
+        self->dones[iii] = instance->needs_reset;
+    }
+}
+
+void
+Env__reset_instance__(Env* self, u32 index)
+{
+    Env__Instance__* instance = &self->instances[index];
+
+    // the keys of the last episode are released without calling anyone
+    Keyboard_register(&instance->keyboard, NULL, NULL);
+    Keyboard_set_keys(&instance->keyboard, 0);
+    Cpu_load_state(&instance->cpu, self->initial);
+
+    // a different run for every environment and episode
+    const u64 key = ((u64)self->options.seed << 32) ^ ((u64)index << 16) ^ instance->episodes;
+    Cpu_seed(&instance->cpu, (u32)Hash_mix(key));
+
+    instance->frames = 0;
+    instance->episodes++;
+    instance->needs_reset = false;
+}
+
+void
+Env__observe__(const Renderer_Frame* display, u8* observation)
+{
+    for(u32 row = 0; row < CANVAS_ROWS; row++)
+    {
+        u64 line = display->planes[0][row][0];
+
+        if(display->hires)
+        {
+            // both rows, then every pair of columns in one
+            const u64* top = display->planes[0][2 * row];
+            const u64* bottom = display->planes[0][2 * row + 1];
+            const u64 words[CANVAS_WORDS] = { top[0] | bottom[0], top[1] | bottom[1] };
+
+            line = 0;
+            for(u32 column = 0; column < CANVAS_COLS; column++)
+            {
+                const u64 pair = words[column / 32] >> (62 - 2 * (column % 32));
+                line |= (u64)((pair & 3) != 0) << (63 - column);
+            }
+        }
+
+        // the first byte is the most significant
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        line = __builtin_bswap64(line);
+#endif
+        memcpy(&observation[row * 8], &line, sizeof(line));
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include "utils/type_alias.h"
+#include "cpu.h"
+#include "renderer.h"
+#include "keyboard.h"
+#include "speaker.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// one observation: 32 rows of 64 pixels, 8 bytes per row, the most
+// significant bit of the first byte is column 0. The first plane only,
+// hires displays are halved (a pixel is set if any of its 2x2 is)
+#define ENV_OBSERVATION_SIZE    (CANVAS_ROWS * CANVAS_COLS / 8)
+#define ENV_MAX_THREADS         64
+
+/// reward of the environment `index` after a step, from the cpu (memory,
+/// registers...). Called from the worker threads, each env from one thread
+typedef f32 (*Env_Reward)(const Cpu* cpu, u32 index, void* arg);
+
+typedef struct {
+    u32 count;              // environments
+    u32 speed;              // instructions per frame
+    Cpu_Mode mode;
+    Cpu_Quirks quirks;
+    u32 seed;               // the environment n, episode e, gets a seed made from all three
+    u32 threads;            // 0 for one per CPU
+    u64 max_frames;         // episodes are cut there, 0 for no limit
+    Env_Reward reward;      // NULL for no reward
+    void* reward_arg;
+} Env_Options;
+
+// one headless machine
+typedef struct {
+    Renderer renderer;
+    Keyboard keyboard;
+    Speaker speaker;
+    Cpu cpu;
+    u64 frames;             // of the episode
+    u32 episodes;
+    bool needs_reset;
+} Env__Instance__;
+
+typedef struct {
+    void* env;              // Env
+    u32 first;
+    u32 count;
+    void* start;            // SDL_sem
+    void* thread;           // SDL_Thread, NULL for the caller's slice
+} Env__Worker__;
+
+// A batch of environments running the same ROM, for agent training.
+// Env_step advances every environment one frame with its action (the keys
+// held) and writes the observations, rewards and done flags into the
+// caller's arrays; the work is split between a pool of threads created
+// once, and nothing is allocated.
+//
+// An episode is done when the program exits (00FD), halts (jump to itself),
+// faults, or after max_frames. The next step of that environment starts a
+// new episode from the ROM's initial state with a new seed, then runs the
+// frame with the action as usual.
+typedef struct {
+    Env_Options options;
+    Env__Instance__* instances;
+    Cpu_State* initial;     // right after loading the ROM
+    Env__Worker__* workers;
+    u32 workers_count;
+    void* done;             // SDL_sem, posted by the workers
+
+    // the step going on
+    const u16* actions;
+    u8* observations;
+    f32* rewards;
+    u8* dones;
+    bool quit;
+
+    u64 frames;             // run by all the environments
+    bool valid;
+} Env;
+
+Env
+Env_init(const u8* program, size_t program_size, Env_Options options);
+
+/// starts the worker threads, `self` should not move after that
+bool
+Env_start(Env* self);
+
+/// starts a new episode everywhere and writes the first observations
+/// @param: observations: count * ENV_OBSERVATION_SIZE bytes
+void
+Env_reset(Env* self, u8* observations);
+
+/// one frame for every environment
+/// @param: actions: count key masks, bit n is the key n
+/// @param: observations: count * ENV_OBSERVATION_SIZE bytes
+/// @param: rewards: count values, from Env_Options.reward
+/// @param: dones: count flags, 1 if the episode ended with this step
+void
+Env_step(Env* self, const u16* actions, u8* observations, f32* rewards, u8* dones);
+
+void
+Env_deinit(Env* self);
+
+#endif // ENV_H
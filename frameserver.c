@@ -0,0 +1,392 @@
+#include "frameserver.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static void
+FrameServer__put__(u8* at, u64 value, u8 size);
+
+static size_t
+FrameServer__encode__(u8* message, const Renderer_Frame* frame, const Renderer_Frame* last, u32 number);
+
+static void
+FrameServer__accept__(FrameServer* self);
+
+static bool
+FrameServer__flush__(FrameServer__Viewer__* viewer);
+
+static bool
+FrameServer__send__(FrameServer__Viewer__* viewer, const u8* message, size_t size);
+
+static void
+FrameServer__close__(FrameServer__Viewer__* viewer);
+
+FrameServer
+FrameServer_init(const char* path)
+{
+    FrameServer self = {};
+    self.socket = -1;
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Error: FrameServer: socket path too long: %s\n", path);
+        self.valid = false;
+        return self;
+    }
+    strcpy(address.sun_path, path);
+
+    self.path = strdup(path);
+    self.viewers = malloc(FRAMESERVER_MAX_VIEWERS * sizeof(FrameServer__Viewer__));
+    self.last = calloc(1, sizeof(Renderer_Frame));
+    self.message = malloc(FRAMESERVER_MESSAGE_MAX);
+    self.keyframe = malloc(FRAMESERVER_MESSAGE_MAX);
+    if(!self.path || !self.viewers || !self.last || !self.message || !self.keyframe)
+    {
+        FrameServer_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+
+    for(u32 iii = 0; iii < FRAMESERVER_MAX_VIEWERS; iii++)
+    {
+        self.viewers[iii].socket = -1;
+    }
+
+    self.socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if(self.socket < 0 ||
+       fcntl(self.socket, F_SETFL, O_NONBLOCK) < 0 ||
+       bind(self.socket, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+       listen(self.socket, FRAMESERVER_MAX_VIEWERS) < 0)
+    {
+        fprintf(stderr, "Error: FrameServer: couldn't listen on %s: %s\n", path, strerror(errno));
+        FrameServer_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+
+    self.valid = true;
+    return self;
+}
+
+void
+FrameServer_publish(FrameServer* self, const Renderer_Frame* frame)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    FrameServer__accept__(self);
+
+    // one delta for everyone, a keyframe only if someone needs it
+    const bool first = self->frames == 0 || frame->hires != self->last->hires;
+    const size_t delta_size = first ? 0 : FrameServer__encode__(self->message, frame, self->last, (u32)self->frames);
+    size_t keyframe_size = 0;
+
+    for(u32 iii = 0; iii < FRAMESERVER_MAX_VIEWERS; iii++)
+    {
+        FrameServer__Viewer__* viewer = &self->viewers[iii];
+        if(viewer->socket < 0)
+        {
+            continue;
+        }
+
+        viewer->needs_keyframe |= first;
+
+        // still busy with an older frame: this one is lost, it'll need a
+        // keyframe to catch up
+        if(!FrameServer__flush__(viewer))
+        {
+            self->dropped++;
+            viewer->needs_keyframe = true;
+            continue;
+        }
+
+        const u8* message = self->message;
+        size_t size = delta_size;
+        if(viewer->needs_keyframe)
+        {
+            if(keyframe_size == 0)
+            {
+                keyframe_size = FrameServer__encode__(self->keyframe, frame, NULL, (u32)self->frames);
+                self->keyframes++;
+            }
+            message = self->keyframe;
+            size = keyframe_size;
+            viewer->needs_keyframe = false;
+        }
+
+        if(size == 0)
+        {
+            continue;
+        }
+
+        self->bytes += size;
+        if(!FrameServer__send__(viewer, message, size))
+        {
+            FrameServer__close__(viewer);
+        }
+    }
+
+    if(delta_size > 0)
+    {
+        self->deltas++;
+    }
+
+    memcpy(self->last, frame, sizeof(Renderer_Frame));
+    self->frames++;
+}
+
+u16
+FrameServer_keys(FrameServer* self)
+{
+    if(!self || !self->valid)
+    {
+        return 0;
+    }
+
+    self->keys = 0;
+    for(u32 iii = 0; iii < FRAMESERVER_MAX_VIEWERS; iii++)
+    {
+        FrameServer__Viewer__* viewer = &self->viewers[iii];
+        while(viewer->socket >= 0)
+        {
+            ssize_t size = recv(viewer->socket, viewer->received + viewer->received_size, 2 - viewer->received_size, 0);
+            if(size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            if(size <= 0)
+            {
+                FrameServer__close__(viewer);
+                break;
+            }
+
+            viewer->received_size += (size_t)size;
+            if(viewer->received_size == 2)
+            {
+                viewer->keys = viewer->received[0] | (viewer->received[1] << 8);
+                viewer->received_size = 0;
+            }
+        }
+
+        if(viewer->socket >= 0)
+        {
+            self->keys |= viewer->keys;
+        }
+    }
+
+    return self->keys;
+}
+
+void
+FrameServer_print_stats(const FrameServer* self, FILE* out)
+{
+    fprintf(out,
+        "stream: %llu frames, %llu deltas, %llu keyframes, %llu bytes (%.1f per frame), %llu viewers, %llu frames dropped\n",
+        (unsigned long long)self->frames,
+        (unsigned long long)self->deltas,
+        (unsigned long long)self->keyframes,
+        (unsigned long long)self->bytes,
+        self->frames ? (double)self->bytes / self->frames : 0.0,
+        (unsigned long long)self->viewers_count,
+        (unsigned long long)self->dropped
+    );
+}
+
+void
+FrameServer_deinit(FrameServer* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    if(self->viewers)
+    {
+        for(u32 iii = 0; iii < FRAMESERVER_MAX_VIEWERS; iii++)
+        {
+            FrameServer__close__(&self->viewers[iii]);
+        }
+    }
+
+    if(self->socket >= 0)
+    {
+        close(self->socket);
+        unlink(self->path);
+    }
+
+    free(self->path);
+    free(self->viewers);
+    free(self->last);
+    free(self->message);
+    free(self->keyframe);
+
+    self->socket = -1;
+    self->path = NULL;
+    self->viewers = NULL;
+    self->last = NULL;
+    self->message = NULL;
+    self->keyframe = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+void
+FrameServer__put__(u8* at, u64 value, u8 size)
+{
+    for(u8 iii = 0; iii < size; iii++)
+    {
+        at[iii] = (u8)(value >> (8 * iii));
+    }
+}
+
+size_t
+FrameServer__encode__(u8* message, const Renderer_Frame* frame, const Renderer_Frame* last, u32 number)
+{
+    const i32 rows = Renderer_Frame_rows(frame);
+    const u8 words = frame->hires ? CANVAS_WORDS : 1;
+    size_t size = FRAMESERVER_HEADER_SIZE;
+    u16 count = 0;
+
+    for(u8 plane = 0; plane < CANVAS_PLANES; plane++)
+    {
+        for(i32 row = 0; row < rows; row++)
+        {
+            const u64* line = frame->planes[plane][row];
+            if(last && memcmp(line, last->planes[plane][row], words * sizeof(u64)) == 0)
+            {
+                continue;
+            }
+
+            message[size++] = plane;
+            message[size++] = (u8)row;
+            for(u8 word = 0; word < words; word++)
+            {
+                FrameServer__put__(message + size, line[word], 8);
+                size += 8;
+            }
+            count++;
+        }
+    }
+
+    if(last && count == 0)
+    {
+        return 0;
+    }
+
+    message[0] = last ? FRAMESERVER_DELTA : FRAMESERVER_KEYFRAME;
+    message[1] = frame->hires;
+    FrameServer__put__(message + 2, count, 2);
+    FrameServer__put__(message + 4, number, 4);
+    return size;
+}
+
+void
+FrameServer__accept__(FrameServer* self)
+{
+    int socket;
+    while((socket = accept(self->socket, NULL, NULL)) >= 0)
+    {
+        fcntl(socket, F_SETFL, O_NONBLOCK);
+
+        FrameServer__Viewer__* viewer = NULL;
+        for(u32 iii = 0; iii < FRAMESERVER_MAX_VIEWERS && !viewer; iii++)
+        {
+            if(self->viewers[iii].socket < 0)
+            {
+                viewer = &self->viewers[iii];
+            }
+        }
+
+        if(!viewer)
+        {
+            fprintf(stderr, "stream: more than %d viewers, one refused\n", FRAMESERVER_MAX_VIEWERS);
+            close(socket);
+            continue;
+        }
+
+        *viewer = (FrameServer__Viewer__){ .socket = socket, .needs_keyframe = true };
+        self->viewers_count++;
+    }
+}
+
+bool
+FrameServer__flush__(FrameServer__Viewer__* viewer)
+{
+    while(viewer->pending_sent < viewer->pending_size)
+    {
+        ssize_t size = send(
+            viewer->socket,
+            viewer->pending + viewer->pending_sent,
+            viewer->pending_size - viewer->pending_sent,
+            MSG_NOSIGNAL
+        );
+
+        if(size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(size < 0)
+        {
+            // a viewer that left is noticed when reading its keys
+            return false;
+        }
+        viewer->pending_sent += (size_t)size;
+    }
+
+    viewer->pending_size = 0;
+    viewer->pending_sent = 0;
+    return true;
+}
+
+bool
+FrameServer__send__(FrameServer__Viewer__* viewer, const u8* message, size_t size)
+{
+    ssize_t sent = send(viewer->socket, message, size, MSG_NOSIGNAL);
+    if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+        sent = 0;
+    }
+    if(sent < 0)
+    {
+        return false;
+    }
+
+    // the rest goes before the next message
+    if((size_t)sent < size)
+    {
+        memmove(viewer->pending, message + sent, size - sent);
+        viewer->pending_size = size - sent;
+        viewer->pending_sent = 0;
+    }
+
+    return true;
+}
+
+void
+FrameServer__close__(FrameServer__Viewer__* viewer)
+{
+    if(viewer->socket >= 0)
+    {
+        close(viewer->socket);
+    }
+    viewer->socket = -1;
+    viewer->pending_size = 0;
+    viewer->pending_sent = 0;
+    viewer->received_size = 0;
+    viewer->keys = 0;
+}
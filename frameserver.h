@@ -0,0 +1,86 @@
+#ifndef FRAMESERVER_H
+#define FRAMESERVER_H
+
+#include "utils/type_alias.h"
+#include "renderer_frame.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FRAMESERVER_MAX_VIEWERS     16
+#define FRAMESERVER_HEADER_SIZE     8
+#define FRAMESERVER_ROW_SIZE        (2 + CANVAS_WORDS * 8)     // hires, lores rows have one word
+#define FRAMESERVER_MESSAGE_MAX     (FRAMESERVER_HEADER_SIZE + CANVAS_PLANES * CANVAS_HIRES_ROWS * FRAMESERVER_ROW_SIZE)
+
+#define FRAMESERVER_KEYFRAME        'K'
+#define FRAMESERVER_DELTA           'D'
+
+// Serves the published frames to viewers on a Unix socket, as the rows that
+// changed since the previous frame. Everything is little endian.
+//
+// server -> viewer, one message per frame that changed:
+//     type u8 (FRAMESERVER_KEYFRAME or FRAMESERVER_DELTA), hires u8,
+//     rows u16, frame u32, then `rows` times:
+//         plane u8, row u8, the row: 1 word (lores) or 2 (hires) u64,
+//         the most significant bit of the first word is column 0
+// A keyframe has every row of every plane and comes first, after a switch
+// between lores and hires, and after frames were dropped for a viewer too
+// slow to read them. An unchanged frame sends nothing.
+//
+// viewer -> server: u16 masks of the keys it holds (bit n is the key n),
+// the program sees the keys of all the viewers or'ed together.
+//
+// Everything happens in FrameServer_publish and FrameServer_keys, on the
+// emulation thread, without ever waiting on a viewer.
+typedef struct {
+    int socket;
+    u8 pending[FRAMESERVER_MESSAGE_MAX];    // the end of a message sent in part
+    size_t pending_size;
+    size_t pending_sent;
+    bool needs_keyframe;
+    u8 received[2];         // a partial key mask
+    size_t received_size;
+    u16 keys;
+} FrameServer__Viewer__;
+
+typedef struct {
+    char* path;
+    int socket;             // listening
+    FrameServer__Viewer__* viewers;     // FRAMESERVER_MAX_VIEWERS, socket -1 when free
+    Renderer_Frame* last;   // the last frame published
+    u64 frames;             // published
+    u8* message;            // the delta, FRAMESERVER_MESSAGE_MAX
+    u8* keyframe;           // encoded when a viewer needs it
+    u16 keys;
+
+    // stats
+    u64 deltas;
+    u64 keyframes;
+    u64 bytes;
+    u64 dropped;            // frames a slow viewer missed
+    u64 viewers_count;      // connected since the start
+    bool valid;
+} FrameServer;
+
+/// listens on the Unix socket `path`, it is removed first if it exists
+FrameServer
+FrameServer_init(const char* path);
+
+/// accepts the new viewers and sends `frame` to everyone
+void
+FrameServer_publish(FrameServer* self, const Renderer_Frame* frame);
+
+/// reads the viewers' input
+/// @return: the keys held by the viewers
+u16
+FrameServer_keys(FrameServer* self);
+
+void
+FrameServer_print_stats(const FrameServer* self, FILE* out);
+
+/// disconnects the viewers and removes the socket
+void
+FrameServer_deinit(FrameServer* self);
+
+#endif // FRAMESERVER_H
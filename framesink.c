@@ -0,0 +1,542 @@
+#include "framesink.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#define FRAMESINK_MAX_PATH      4096
+#define FRAMESINK_DEFLATE_BLOCK 65535
+
+static int
+FrameSink__thread__(void* arg);
+
+static void
+FrameSink__write__(FrameSink* self, const Renderer_Frame* frame, u64 frame_number);
+
+static void
+FrameSink__convert__(FrameSink* self, const Renderer_Frame* frame);
+
+static bool
+FrameSink__write_snapshot__(FrameSink* self, u64 frame_number);
+
+static void
+FrameSink__encode_png__(FrameSink* self);
+
+static void
+FrameSink__write_png_chunk__(FILE* file, const char* type, const u8* data, u32 size);
+
+static u32
+FrameSink__crc32__(u32 crc, const u8* data, size_t size);
+
+static bool
+FrameSink__is_snapshot__(FrameSink_Format format);
+
+static bool
+FrameSink__is_pattern__(const char* path);
+
+static size_t
+FrameSink__bytes_per_pixel__(FrameSink_Format format);
+
+FrameSink
+FrameSink_init(const char* path, FrameSink_Format format, i32 scale, u32 every)
+{
+    FrameSink self = {};
+
+    if(!path || every == 0)
+    {
+        fputs("Error: FrameSink: bad path or frame interval\n", stderr);
+        self.valid = false;
+        return self;
+    }
+
+    // the path is the format of snprintf, nothing but the frame number goes in
+    if(FrameSink__is_snapshot__(format) && !FrameSink__is_pattern__(path))
+    {
+        fputs("Error: FrameSink: snapshot path needs exactly one %d (or %05d) for the frame number, and %% for a %\n", stderr);
+        self.valid = false;
+        return self;
+    }
+
+    self.format = format;
+    self.every = FrameSink__is_snapshot__(format) ? every : 1;
+    self.upscaler = Upscaler_init(CANVAS_COLS * scale, CANVAS_ROWS * scale, UPSCALER_FILTER_NONE);
+
+    if(!self.upscaler.valid)
+    {
+        self.valid = false;
+        return self;
+    }
+
+    const size_t bpp = FrameSink__bytes_per_pixel__(format);
+    const size_t raw_size = (size_t)self.upscaler.height * (1 + self.upscaler.width * bpp);
+    const size_t blocks = (raw_size + FRAMESINK_DEFLATE_BLOCK - 1) / FRAMESINK_DEFLATE_BLOCK;
+
+    self.frame_size = (size_t)self.upscaler.width * self.upscaler.height * bpp;
+    self.png_size = format == FRAMESINK_FORMAT_PNG ? 2 + raw_size + 5 * blocks + 4 : 0;
+
+    self.path = strdup(path);
+    self.frame_data = malloc(self.frame_size);
+    self.png_data = self.png_size ? malloc(self.png_size) : NULL;
+    self.last = calloc(1, sizeof(Renderer_Frame));
+    self.queue = calloc(FRAMESINK_QUEUE_FRAMES, sizeof(Renderer_Frame));
+    self.queue_free = SDL_CreateSemaphore(FRAMESINK_QUEUE_FRAMES);
+    self.queue_used = SDL_CreateSemaphore(0);
+
+    if(!self.path || !self.frame_data || (self.png_size && !self.png_data) ||
+       !self.last || !self.queue || !self.queue_free || !self.queue_used)
+    {
+        fputs("Error: FrameSink: couldn't allocate memory\n", stderr);
+        self.valid = false;
+        return self;
+    }
+
+    if(!FrameSink__is_snapshot__(format))
+    {
+        self.file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+        if(!self.file)
+        {
+            fprintf(stderr, "Error: FrameSink: couldn't open %s\n", path);
+            self.valid = false;
+            return self;
+        }
+
+        self.io_buffer = malloc(FRAMESINK_IO_BUFFER);
+        if(self.io_buffer)
+        {
+            setvbuf(self.file, (char*)self.io_buffer, _IOFBF, FRAMESINK_IO_BUFFER);
+        }
+
+        if(format == FRAMESINK_FORMAT_Y4M)
+        {
+            fprintf(self.file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n",
+                self.upscaler.width,
+                self.upscaler.height
+            );
+        }
+    }
+
+    atomic_init(&self.quit, false);
+
+    self.valid = true;
+    return self;
+}
+
+bool
+FrameSink_format_from_path(const char* path, FrameSink_Format* format)
+{
+    if(!path || !format)
+    {
+        return false;
+    }
+
+    if(strcmp(path, "-") == 0)
+    {
+        *format = FRAMESINK_FORMAT_Y4M;
+        return true;
+    }
+
+    const char* extension = strrchr(path, '.');
+    if(!extension)
+    {
+        return false;
+    }
+
+    if(strcmp(extension, ".y4m") == 0) *format = FRAMESINK_FORMAT_Y4M;
+    else if(strcmp(extension, ".raw") == 0 ||
+            strcmp(extension, ".rgb") == 0) *format = FRAMESINK_FORMAT_RAW;
+    else if(strcmp(extension, ".ppm") == 0) *format = FRAMESINK_FORMAT_PPM;
+    else if(strcmp(extension, ".png") == 0) *format = FRAMESINK_FORMAT_PNG;
+    else return false;
+
+    return true;
+}
+
+bool
+FrameSink_start(FrameSink* self)
+{
+    if(!self || !self->valid)
+    {
+        return false;
+    }
+
+    self->thread = SDL_CreateThread(FrameSink__thread__, "framesink", self);
+
+    if(!self->thread)
+    {
+        fputs(SDL_GetError(), stderr);
+        return false;
+    }
+
+    return true;
+}
+
+void
+FrameSink_push(FrameSink* self, const Renderer_Frame* frame)
+{
+    if(!self || !self->valid || !self->thread)
+    {
+        return;
+    }
+
+    SDL_SemWait(self->queue_free);
+    self->queue[self->queue_head % FRAMESINK_QUEUE_FRAMES] = *frame;
+    self->queue_head++;
+    SDL_SemPost(self->queue_used);
+}
+
+void
+FrameSink_deinit(FrameSink* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    if(self->thread)
+    {
+        // the writer drains the queue before it sees the last post
+        atomic_store(&self->quit, true);
+        SDL_SemPost(self->queue_used);
+        SDL_WaitThread(self->thread, NULL);
+        self->thread = NULL;
+    }
+
+    if(self->file)
+    {
+        if(self->file == stdout)
+        {
+            fflush(self->file);
+            setvbuf(self->file, NULL, _IOLBF, 0);
+        }
+        else
+        {
+            fclose(self->file);
+        }
+    }
+
+    if(self->queue_free) SDL_DestroySemaphore(self->queue_free);
+    if(self->queue_used) SDL_DestroySemaphore(self->queue_used);
+
+    Upscaler_deinit(&self->upscaler);
+    free(self->path);
+    free(self->frame_data);
+    free(self->png_data);
+    free(self->io_buffer);
+    free(self->last);
+    free(self->queue);
+
+    self->file = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+int
+FrameSink__thread__(void* arg)
+{
+    FrameSink* self = arg;
+
+    while(true)
+    {
+        SDL_SemWait(self->queue_used);
+
+        if(atomic_load(&self->quit) && self->queue_tail == self->queue_head)
+        {
+            break;
+        }
+
+        FrameSink__write__(self, &self->queue[self->queue_tail % FRAMESINK_QUEUE_FRAMES], self->frames);
+        self->frames++;
+        self->queue_tail++;
+        SDL_SemPost(self->queue_free);
+    }
+
+    return 0;
+}
+
+void
+FrameSink__write__(FrameSink* self, const Renderer_Frame* frame, u64 frame_number)
+{
+    const bool unchanged = self->has_last &&
+        memcmp(frame, self->last, sizeof(Renderer_Frame)) == 0;
+
+    if(FrameSink__is_snapshot__(self->format))
+    {
+        if(frame_number % self->every != 0)
+        {
+            return;
+        }
+
+        // an image sequence doesn't need the same picture twice
+        if(unchanged)
+        {
+            self->skipped++;
+            return;
+        }
+    }
+
+    // a video stream has a fixed rate, unchanged frames are written again
+    // but not converted again
+    if(!unchanged)
+    {
+        FrameSink__convert__(self, frame);
+        *self->last = *frame;
+        self->has_last = true;
+    }
+
+    switch(self->format)
+    {
+        case FRAMESINK_FORMAT_Y4M:
+            fputs("FRAME\n", self->file);
+            fwrite(self->frame_data, 1, self->frame_size, self->file);
+            break;
+        case FRAMESINK_FORMAT_RAW:
+            fwrite(self->frame_data, 1, self->frame_size, self->file);
+            break;
+        case FRAMESINK_FORMAT_PPM:
+        case FRAMESINK_FORMAT_PNG:
+            if(!FrameSink__write_snapshot__(self, frame_number))
+            {
+                return;
+            }
+            break;
+    }
+
+    self->written++;
+}
+
+// converts the upscaled pixels to the output format
+void
+FrameSink__convert__(FrameSink* self, const Renderer_Frame* frame)
+{
+    Upscaler_run(
+        &self->upscaler,
+        &frame->planes[0][0][0],
+        Renderer_Frame_cols(frame),
+        Renderer_Frame_rows(frame)
+    );
+
+    const i32 width = self->upscaler.width;
+    const i32 pitch = self->upscaler.pitch / sizeof(u32);
+    const size_t bpp = FrameSink__bytes_per_pixel__(self->format);
+
+    for(i32 line = 0; line < self->upscaler.height; ++line)
+    {
+        const u32* pixels = &self->upscaler.pixels[line * pitch];
+        u8* out = &self->frame_data[(size_t)line * width * bpp];
+
+        for(i32 col = 0; col < width; ++col)
+        {
+            u8 r = (pixels[col] >> 16) & 0xFF;
+            u8 g = (pixels[col] >> 8) & 0xFF;
+            u8 b = pixels[col] & 0xFF;
+
+            if(bpp == 1)
+            {
+                *out++ = (u8)((77 * r + 150 * g + 29 * b) >> 8);
+            }
+            else
+            {
+                *out++ = r;
+                *out++ = g;
+                *out++ = b;
+            }
+        }
+    }
+}
+
+bool
+FrameSink__write_snapshot__(FrameSink* self, u64 frame_number)
+{
+    char path[FRAMESINK_MAX_PATH];
+    snprintf(path, sizeof(path), self->path, (int)frame_number);
+
+    FILE* file = fopen(path, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Error: FrameSink: couldn't open %s\n", path);
+        return false;
+    }
+
+    const i32 width = self->upscaler.width;
+    const i32 height = self->upscaler.height;
+
+    if(self->format == FRAMESINK_FORMAT_PPM)
+    {
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        fwrite(self->frame_data, 1, self->frame_size, file);
+    }
+    else
+    {
+        const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        const u8 header[13] = {
+            width >> 24, width >> 16, width >> 8, width,
+            height >> 24, height >> 16, height >> 8, height,
+            8,  // bit depth
+            2,  // color type: rgb
+            0, 0, 0
+        };
+
+        FrameSink__encode_png__(self);
+
+        fwrite(signature, 1, sizeof(signature), file);
+        FrameSink__write_png_chunk__(file, "IHDR", header, sizeof(header));
+        FrameSink__write_png_chunk__(file, "IDAT", self->png_data, self->png_size);
+        FrameSink__write_png_chunk__(file, "IEND", NULL, 0);
+    }
+
+    fclose(file);
+    return true;
+}
+
+// zlib stream of stored (uncompressed) deflate blocks, the snapshots are
+// small and this keeps us free of a compression dependency
+void
+FrameSink__encode_png__(FrameSink* self)
+{
+    const size_t line_size = (size_t)self->upscaler.width * 3;
+    const size_t raw_size = (size_t)self->upscaler.height * (1 + line_size);
+
+    u8* out = self->png_data;
+    size_t block_left = 0;
+    size_t raw_left = raw_size;
+    u32 adler_a = 1, adler_b = 0;
+
+    *out++ = 0x78;  // deflate, 32K window
+    *out++ = 0x01;  // no compression, check bits
+
+    for(i32 line = 0; line < self->upscaler.height; ++line)
+    {
+        const u8* data = &self->frame_data[line * line_size];
+
+        for(size_t iii = 0; iii < line_size + 1; ++iii)
+        {
+            if(block_left == 0)
+            {
+                block_left = raw_left < FRAMESINK_DEFLATE_BLOCK ? raw_left : FRAMESINK_DEFLATE_BLOCK;
+                raw_left -= block_left;
+
+                *out++ = raw_left == 0 ? 1 : 0;     // last block?
+                *out++ = block_left & 0xFF;
+                *out++ = (block_left >> 8) & 0xFF;
+                *out++ = ~block_left & 0xFF;
+                *out++ = (~block_left >> 8) & 0xFF;
+            }
+
+            // every scanline starts with its filter type (none)
+            u8 byte = iii == 0 ? 0 : data[iii - 1];
+            *out++ = byte;
+            block_left--;
+
+            adler_a = (adler_a + byte) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+    }
+
+    u32 adler = (adler_b << 16) | adler_a;
+    *out++ = adler >> 24;
+    *out++ = adler >> 16;
+    *out++ = adler >> 8;
+    *out++ = adler;
+}
+
+void
+FrameSink__write_png_chunk__(FILE* file, const char* type, const u8* data, u32 size)
+{
+    const u8 length[4] = { size >> 24, size >> 16, size >> 8, size };
+
+    u32 crc = FrameSink__crc32__(0xFFFFFFFF, (const u8*)type, 4);
+    crc = FrameSink__crc32__(crc, data, size) ^ 0xFFFFFFFF;
+
+    const u8 crc_bytes[4] = { crc >> 24, crc >> 16, crc >> 8, crc };
+
+    fwrite(length, 1, 4, file);
+    fwrite(type, 1, 4, file);
+    if(size) fwrite(data, 1, size, file);
+    fwrite(crc_bytes, 1, 4, file);
+}
+
+u32
+FrameSink__crc32__(u32 crc, const u8* data, size_t size)
+{
+    static u32 table[256];
+    static bool has_table = false;
+
+    // only the writer thread encodes PNGs, no need for a lock
+    if(!has_table)
+    {
+        for(u32 n = 0; n < 256; ++n)
+        {
+            u32 c = n;
+            for(int k = 0; k < 8; ++k)
+            {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+
+        has_table = true;
+    }
+
+    for(size_t iii = 0; iii < size; ++iii)
+    {
+        crc = table[(crc ^ data[iii]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+bool
+FrameSink__is_snapshot__(FrameSink_Format format)
+{
+    return format == FRAMESINK_FORMAT_PPM || format == FRAMESINK_FORMAT_PNG;
+}
+
+// one %d with an optional zero padding and width, every other % is a %%
+bool
+FrameSink__is_pattern__(const char* path)
+{
+    u32 numbers = 0;
+    for(const char* at = path; *at; at++)
+    {
+        if(*at != '%')
+        {
+            continue;
+        }
+
+        at++;
+        if(*at == '%')
+        {
+            continue;
+        }
+
+        if(*at == '0')
+        {
+            at++;
+        }
+
+        // the frame number never needs more than a two digit width
+        for(u32 digits = 0; *at >= '0' && *at <= '9'; digits++, at++)
+        {
+            if(digits == 2)
+            {
+                return false;
+            }
+        }
+
+        if(*at != 'd')
+        {
+            return false;
+        }
+        numbers++;
+    }
+
+    return numbers == 1;
+}
+
+size_t
+FrameSink__bytes_per_pixel__(FrameSink_Format format)
+{
+    return format == FRAMESINK_FORMAT_Y4M ? 1 : 3;
+}
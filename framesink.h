@@ -0,0 +1,77 @@
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include "utils/type_alias.h"
+#include "upscaler.h"
+#include "renderer_frame.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// frames queued between the emulation and the writer thread
+#define FRAMESINK_QUEUE_FRAMES  128
+#define FRAMESINK_IO_BUFFER     (1 << 20)
+
+typedef enum {
+    FRAMESINK_FORMAT_Y4M,   // one video stream, 8-bit luma (Cmono)
+    FRAMESINK_FORMAT_RAW,   // one video stream, packed rgb24 frames
+    FRAMESINK_FORMAT_PPM,   // one binary PPM (P6) per snapshot
+    FRAMESINK_FORMAT_PNG,   // one rgb PNG per snapshot
+} FrameSink_Format;
+
+// Streams the published frames to a file or a pipe.
+// Frames are copied (packed, a couple of KB) into a queue and the
+// upscaling, conversion and writing happens on a writer thread. When the
+// writer can't keep up the emulation waits, no frame is dropped.
+typedef struct {
+    FrameSink_Format format;
+    char* path;             // file, "-" for stdout, or a pattern with one %d (%05d pads) for snapshots, %% for a %
+    FILE* file;             // video stream, NULL for snapshots
+    u32 every;              // snapshots: keep one frame every `every` frames
+    Upscaler upscaler;
+    u8* frame_data;         // converted frame, rewritten only where the source changed
+    size_t frame_size;
+    u8* png_data;           // snapshots: encoded PNG image data (IDAT)
+    size_t png_size;
+    u8* io_buffer;
+    Renderer_Frame* last;   // source of the last written frame
+    bool has_last;
+
+    Renderer_Frame* queue;  // FRAMESINK_QUEUE_FRAMES frames
+    u64 queue_head;         // frames pushed, owned by the producer
+    u64 queue_tail;         // frames taken, owned by the writer
+    void* queue_free;       // SDL_sem
+    void* queue_used;       // SDL_sem
+    void* thread;
+    atomic_bool quit;
+
+    u64 frames;             // frames received
+    u64 written;
+    u64 skipped;            // unchanged frames that weren't written again
+    bool valid;
+} FrameSink;
+
+/// @param: path: see FrameSink.path
+/// @param: scale: integer upscale of a lores frame, hires frames get half of it
+/// @param: every: keep one frame every `every` frames (only for snapshots)
+FrameSink
+FrameSink_init(const char* path, FrameSink_Format format, i32 scale, u32 every);
+
+/// guesses the format from the extension of `path`, "-" is y4m
+bool
+FrameSink_format_from_path(const char* path, FrameSink_Format* format);
+
+/// starts the writer thread, `self` should not move after that
+bool
+FrameSink_start(FrameSink* self);
+
+/// queues a copy of `frame`
+void
+FrameSink_push(FrameSink* self, const Renderer_Frame* frame);
+
+/// writes the queued frames and closes the output
+void
+FrameSink_deinit(FrameSink* self);
+
+#endif // FRAMESINK_H
@@ -0,0 +1,111 @@
+// libFuzzer entry point: the input is a ROM, run for a few frames.
+//
+// The first byte picks the mode and the quirks profile, the next two are the
+// pressed keys (one bit per key), the rest is the program. Faults (bad
+// opcodes, stack overflows...) are an expected outcome and end the run, the
+// fuzzer is looking for what the sanitizers catch.
+//
+// Built by `cmake -DCHIP8_FUZZ=ON`: with clang it's a libFuzzer binary, with
+// other compilers CHIP8_FUZZ_MAIN adds a main() replaying the files given on
+// the command line, to reproduce a crash.
+
+#include "cpu.h"
+#include "renderer.h"
+#include "keyboard.h"
+#include "speaker.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FUZZ_HEADER_SIZE    3
+#define FUZZ_FRAMES         8
+#define FUZZ_SPEED          200     // instructions per frame
+#define FUZZ_SEED           1
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if(size <= FUZZ_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    const Cpu_Mode mode = data[0] % 3;
+    const Cpu_Quirks quirks = (data[0] / 3) % CPU_QUIRKS_COUNT;
+    const u16 keys = data[1] | (data[2] << 8);
+
+    const u8* program = data + FUZZ_HEADER_SIZE;
+    const size_t program_size = size - FUZZ_HEADER_SIZE;
+    if(program_size > Cpu_max_program_size(mode))
+    {
+        return 0;
+    }
+
+    // the keyboard and the speaker keep no state worth resetting, but the
+    // display does, a fresh one each run keeps the runs independent
+    static Keyboard keyboard;
+    static Speaker speaker;
+    if(!keyboard.valid)
+    {
+        keyboard = Keyboard_init();
+        speaker = Speaker_init_silent();
+    }
+
+    for(u8 key = 0; key < CHIP8_KEYS_COUNT; key++)
+    {
+        keyboard.chip8_keys_state[key] = (keys >> key) & 1;
+    }
+    keyboard.handler = NULL;
+
+    Renderer renderer = Renderer_init();
+    Cpu cpu = Cpu_init(&renderer, &keyboard, &speaker, FUZZ_SPEED, mode, quirks);
+    if(!cpu.valid)
+    {
+        abort();
+    }
+
+    Cpu_seed(&cpu, FUZZ_SEED);
+    Cpu_load_program(&cpu, (u8*)program, program_size);
+
+    // Fx0A waits for a key that never comes, nothing happens after
+    for(u32 frame = 0; frame < FUZZ_FRAMES; frame++)
+    {
+        if(!Cpu_run_frame(&cpu) || cpu.exited || cpu.halted || cpu.paused)
+        {
+            break;
+        }
+    }
+
+    Cpu_deinit(&cpu);
+    Renderer_deinit(&renderer);
+    return 0;
+}
+
+#ifdef CHIP8_FUZZ_MAIN
+int
+main(int argc, char** argv)
+{
+    for(int iii = 1; iii < argc; iii++)
+    {
+        FILE* file = fopen(argv[iii], "rb");
+        if(!file)
+        {
+            fprintf(stderr, "Error: couldn't open %s\n", argv[iii]);
+            return 1;
+        }
+
+        static u8 input[FUZZ_HEADER_SIZE + CPU_MEMORY_SIZE];
+        size_t size = fread(input, 1, sizeof(input), file);
+        fclose(file);
+
+        LLVMFuzzerTestOneInput(input, size);
+    }
+
+    return 0;
+}
+#endif // CHIP8_FUZZ_MAIN
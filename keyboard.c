@@ -5,6 +5,9 @@
 static bool
 Keyboard__init_key__(MapI32* keys_map, u8 chip8_key, u8 key_code);
 
+static void
+Keyboard__hotkey__(Keyboard* self, i32 key_code, bool pressed);
+
 Keyboard
 Keyboard_init()
 {
@@ -85,12 +88,52 @@ keyboard_is_pressed(Keyboard* self, u8 chip8_key)
     return self->chip8_keys_state[chip8_key];
 }
 
+u16
+Keyboard_keys(const Keyboard* self)
+{
+    u16 mask = 0;
+    for(u8 key = 0; key < CHIP8_KEYS_COUNT; key++)
+    {
+        mask |= (u16)(self->chip8_keys_state[key] != 0) << key;
+    }
+
+    return mask;
+}
+
+void
+Keyboard_set_keys(Keyboard* self, u16 mask)
+{
+    for(u8 key = 0; key < CHIP8_KEYS_COUNT; key++)
+    {
+        bool pressed = (mask >> key) & 1;
+        bool newly_pressed = pressed && !self->chip8_keys_state[key];
+        self->chip8_keys_state[key] = pressed;
+
+        if(newly_pressed && self->handler)
+        {
+            self->handler(self->handler_arg, key);
+            self->handler = NULL;
+            self->handler_arg = NULL;
+        }
+    }
+}
+
 bool
 Keyboard_is_quit_pressed(Keyboard* self)
 {
     return self->quit_pressed;
 }
 
+Keyboard_Hotkeys
+Keyboard_hotkeys(Keyboard* self)
+{
+    Keyboard_Hotkeys hotkeys = self->hotkeys;
+
+    self->hotkeys.speed_steps = 0;
+    self->hotkeys.speed_reset = false;
+    return hotkeys;
+}
+
 void
 Keyboard_run(Keyboard* self)
 {
@@ -117,6 +160,10 @@ Keyboard_run(Keyboard* self)
                     self->handler_arg = NULL;
                 }
             }
+            else
+            {
+                Keyboard__hotkey__(self, event.key.keysym.sym, true);
+            }
         }
         else if (event.type == SDL_KEYUP)
         {
@@ -125,6 +172,10 @@ Keyboard_run(Keyboard* self)
             {
                 self->chip8_keys_state[*key] = false;
             }
+            else
+            {
+                Keyboard__hotkey__(self, event.key.keysym.sym, false);
+            }
         }
         else if (event.type == SDL_QUIT)
         {
@@ -133,6 +184,18 @@ Keyboard_run(Keyboard* self)
     }
 }
 
+bool
+Keyboard_wait(Keyboard* self, u32 timeout_ms)
+{
+    if(!self || !self->valid)
+    {
+        return false;
+    }
+
+    // the event stays queued
+    return SDL_WaitEventTimeout(NULL, (int)timeout_ms) == 1;
+}
+
 void
 Keyboard_deinit(Keyboard* self)
 {
@@ -161,4 +224,24 @@ Keyboard__init_key__(MapI32* keys_map, u8 chip8_key, u8 key_code)
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+void
+Keyboard__hotkey__(Keyboard* self, i32 key_code, bool pressed)
+{
+    switch(key_code)
+    {
+        case SDLK_EQUALS:
+            if(pressed) self->hotkeys.speed_steps++;
+            break;
+        case SDLK_MINUS:
+            if(pressed) self->hotkeys.speed_steps--;
+            break;
+        case SDLK_0:
+            if(pressed) self->hotkeys.speed_reset = true;
+            break;
+        case SDLK_TAB:
+            self->hotkeys.fast_forward = pressed;
+            break;
+    }
+}
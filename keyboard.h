@@ -16,11 +16,19 @@
 //     // void(*handler)(void*);
 // } Keyboard_Key ;
 
+// keys outside of the keypad, for the emulator itself
+typedef struct {
+    i32 speed_steps;        // '=' presses minus '-' presses
+    bool speed_reset;       // '0' pressed
+    bool fast_forward;      // tab held
+} Keyboard_Hotkeys;
+
 typedef struct {
     MapI32 keys_map;
     // u8* chip8_keys;
     u8* chip8_keys_state;
     bool quit_pressed;
+    Keyboard_Hotkeys hotkeys;
     bool valid;
     void(*handler)(void*, u8);
     void* handler_arg;
@@ -40,12 +48,30 @@ Keyboard_register(Keyboard* self, void(*handler)(void*, u8), void* handler_arg);
 bool
 keyboard_is_pressed(Keyboard* self, u8 chip8_key);
 
+/// the held keys, bit n is the key n
+u16
+Keyboard_keys(const Keyboard* self);
+
+/// presses the keys of `mask` (bit n is the key n) and releases the others,
+/// like typing them: a newly pressed key goes to the registered handler
+void
+Keyboard_set_keys(Keyboard* self, u16 mask);
+
 bool
 Keyboard_is_quit_pressed(Keyboard* self);
 
+/// the hotkeys pressed since the last call, and whether tab is held
+Keyboard_Hotkeys
+Keyboard_hotkeys(Keyboard* self);
+
 void
 Keyboard_run(Keyboard* self);
 
+/// sleeps until an event is queued for Keyboard_run, or `timeout_ms`
+/// @return: false on timeout
+bool
+Keyboard_wait(Keyboard* self, u32 timeout_ms);
+
 void
 Keyboard_deinit(Keyboard* self);
 
@@ -0,0 +1,433 @@
+#include "lockstep.h"
+#include "renderer.h"
+#include "keyboard.h"
+#include "speaker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOCKSTEP_DIFFERENCE_SIZE    128
+
+static const char* const LOCKSTEP__GRANULARITIES__[] = {
+    [LOCKSTEP_INSTRUCTION] = "instruction",
+    [LOCKSTEP_BLOCK] = "block",
+    [LOCKSTEP_FRAME] = "frame",
+};
+
+// one engine and the headless machine around it
+typedef struct {
+    const char* name;
+    Renderer renderer;
+    Keyboard keyboard;
+    Speaker speaker;
+    Cpu cpu;
+} Lockstep__Engine__;
+
+// the first comparison that failed
+typedef struct {
+    u64 frame;
+    u64 frames;             // run to the end by both engines
+    u64 instructions;       // executed by both before the step that diverged
+    Cpu_Error error;        // the fault both engines stopped on, if they agree
+    u16 fault_pc;
+    bool exited;            // the program ended with 00FD
+    u16 pc;                 // first instruction of that step
+    char difference[LOCKSTEP_DIFFERENCE_SIZE];
+} Lockstep__Divergence__;
+
+static bool
+Lockstep__engine_init__(Lockstep__Engine__* self, const char* name, const u8* program, size_t program_size, const Lockstep_Options* options, const Cpu_Compiled* compiled);
+
+static void
+Lockstep__engine_deinit__(Lockstep__Engine__* self);
+
+static bool
+Lockstep__compare__(Lockstep__Engine__* a, Lockstep__Engine__* b, bool full, char* difference);
+
+static void
+Lockstep__print_state__(const Lockstep__Engine__* self, FILE* out);
+
+static bool
+Lockstep__run__(const u8* program, size_t program_size, const Analyzer* analysis, const Lockstep_Options* options, Lockstep_Granularity granularity, u64 frames, Lockstep__Divergence__* divergence, FILE* report);
+
+bool
+Lockstep_granularity_from_name(const char* name, Lockstep_Granularity* granularity)
+{
+    for(u32 iii = 0; iii < sizeof(LOCKSTEP__GRANULARITIES__) / sizeof(*LOCKSTEP__GRANULARITIES__); iii++)
+    {
+        if(strcmp(name, LOCKSTEP__GRANULARITIES__[iii]) == 0)
+        {
+            *granularity = iii;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+Lockstep_run(const u8* program, size_t program_size, const Analyzer* analysis, Lockstep_Options options, FILE* out)
+{
+    if(!options.compiled)
+    {
+        fputs("Error: Lockstep: there is no compiled engine to compare the interpreter with\n", stderr);
+        return false;
+    }
+
+    Lockstep__Divergence__ divergence = {};
+    FILE* report = options.granularity == LOCKSTEP_INSTRUCTION ? out : NULL;
+    if(Lockstep__run__(program, program_size, analysis, &options, options.granularity, options.frames, &divergence, report))
+    {
+        // agreeing on a fault isn't a run of the frames asked for
+        if(divergence.error != CPU_NO_ERROR)
+        {
+            fprintf(out, "lockstep: both engines stopped on %s at 0x%04X in frame %llu, after %llu of %llu frames\n",
+                Cpu_error_name(divergence.error),
+                divergence.fault_pc,
+                (unsigned long long)divergence.frame,
+                (unsigned long long)divergence.frames,
+                (unsigned long long)options.frames
+            );
+            return false;
+        }
+
+        fprintf(out, "lockstep: the engines agree on %llu frames%s (%llu instructions), compared every %s\n",
+            (unsigned long long)divergence.frames,
+            divergence.exited ? ", then the program exited" : "",
+            (unsigned long long)divergence.instructions,
+            LOCKSTEP__GRANULARITIES__[options.granularity]
+        );
+        return true;
+    }
+
+    if(options.granularity == LOCKSTEP_INSTRUCTION)
+    {
+        return false;
+    }
+
+    // everything is deterministic, the same run compared after every
+    // instruction up to that frame finds the instruction
+    fprintf(out, "lockstep: diverged in frame %llu (%s), replaying it instruction by instruction\n",
+        (unsigned long long)divergence.frame,
+        divergence.difference
+    );
+
+    if(Lockstep__run__(program, program_size, analysis, &options, LOCKSTEP_INSTRUCTION, divergence.frame + 1, &divergence, out))
+    {
+        fputs("lockstep: the instruction by instruction run agrees, the engines aren't deterministic\n", out);
+    }
+    return false;
+}
+
+// private functions
+bool
+Lockstep__engine_init__(Lockstep__Engine__* self, const char* name, const u8* program, size_t program_size, const Lockstep_Options* options, const Cpu_Compiled* compiled)
+{
+    self->name = name;
+    self->keyboard = Keyboard_init();
+    self->speaker = Speaker_init_silent();
+    self->renderer = Renderer_init();
+
+    self->cpu = Cpu_init(&self->renderer, &self->keyboard, &self->speaker, options->speed, options->mode, options->quirks);
+    if(!self->cpu.valid)
+    {
+        return false;
+    }
+
+    Cpu_seed(&self->cpu, options->seed);
+    Cpu_load_program(&self->cpu, (u8*)program, program_size);
+    if(self->cpu.error != CPU_NO_ERROR)
+    {
+        return false;
+    }
+
+    if(compiled && !Cpu_attach_compiled(&self->cpu, compiled))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void
+Lockstep__engine_deinit__(Lockstep__Engine__* self)
+{
+    Cpu_deinit(&self->cpu);
+    Renderer_deinit(&self->renderer);
+    Keyboard_deinit(&self->keyboard);
+    Speaker_deinit(&self->speaker);
+}
+
+// the memory and the display are compared byte by byte when `full` or when
+// their hashes differ
+bool
+Lockstep__compare__(Lockstep__Engine__* a, Lockstep__Engine__* b, bool full, char* difference)
+{
+    const Cpu* x = &a->cpu;
+    const Cpu* y = &b->cpu;
+
+#define LOCKSTEP__COMPARE__(FIELD, FORMAT)                                                  \
+    if(x->FIELD != y->FIELD)                                                                \
+    {                                                                                       \
+        snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, #FIELD " " FORMAT " vs " FORMAT,     \
+                 x->FIELD, y->FIELD);                                                       \
+        return false;                                                                       \
+    }
+
+    LOCKSTEP__COMPARE__(pc, "0x%04X");
+    LOCKSTEP__COMPARE__(i, "0x%04X");
+    LOCKSTEP__COMPARE__(delay_timer, "%u");
+    LOCKSTEP__COMPARE__(sound_timer, "%u");
+    LOCKSTEP__COMPARE__(paused, "%d");
+    LOCKSTEP__COMPARE__(exited, "%d");
+    LOCKSTEP__COMPARE__(halted, "%d");
+    LOCKSTEP__COMPARE__(error, "%d");
+    LOCKSTEP__COMPARE__(pitch, "%u");
+    LOCKSTEP__COMPARE__(rng, "0x%08X");
+#undef LOCKSTEP__COMPARE__
+
+    for(u8 reg = 0; reg < 16; reg++)
+    {
+        if(x->registers[reg] != y->registers[reg])
+        {
+            snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "V%X 0x%02X vs 0x%02X", reg, x->registers[reg], y->registers[reg]);
+            return false;
+        }
+    }
+
+    // the stack grows down from the end of its data
+    const size_t depth_x = x->stack.data + x->stack.size - x->stack.stack_ptr;
+    const size_t depth_y = y->stack.data + y->stack.size - y->stack.stack_ptr;
+    if(depth_x != depth_y || memcmp(x->stack.stack_ptr, y->stack.stack_ptr, depth_x * sizeof(Stack_Type)) != 0)
+    {
+        snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "stack (depth %zu vs %zu)", depth_x, depth_y);
+        return false;
+    }
+
+    if(memcmp(x->flags, y->flags, CPU_FLAGS_COUNT) != 0)
+    {
+        snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "RPL flags");
+        return false;
+    }
+
+    if(memcmp(x->audio_pattern, y->audio_pattern, CPU_AUDIO_PATTERN) != 0)
+    {
+        snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "audio pattern");
+        return false;
+    }
+
+    const u64 display_hash_x = Renderer_hash(&a->renderer);
+    const u64 display_hash_y = Renderer_hash(&b->renderer);
+    if(!full && x->memory_hash == y->memory_hash && display_hash_x == display_hash_y)
+    {
+        return true;
+    }
+
+    if(memcmp(x->memory, y->memory, CPU_MEMORY_SIZE) != 0)
+    {
+        u32 addr = 0;
+        while(x->memory[addr] == y->memory[addr]) addr++;
+
+        snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "memory[0x%04X] 0x%02X vs 0x%02X", addr, x->memory[addr], y->memory[addr]);
+        return false;
+    }
+
+    const Renderer_Frame* display_x = a->renderer.display;
+    const Renderer_Frame* display_y = b->renderer.display;
+    if(display_x->hires != display_y->hires || a->renderer.planes != b->renderer.planes)
+    {
+        snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "display mode (hires %d vs %d, planes %u vs %u)",
+                 display_x->hires, display_y->hires, a->renderer.planes, b->renderer.planes);
+        return false;
+    }
+
+    for(u32 plane = 0; plane < CANVAS_PLANES; plane++)
+    {
+        for(u32 row = 0; row < CANVAS_HIRES_ROWS; row++)
+        {
+            if(memcmp(display_x->planes[plane][row], display_y->planes[plane][row], sizeof(display_x->planes[plane][row])) != 0)
+            {
+                snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "display plane %u row %u", plane, row);
+                return false;
+            }
+        }
+    }
+
+    // same contents, one of the incremental hashes missed a change
+    if(x->memory_hash != y->memory_hash || display_hash_x != display_hash_y)
+    {
+        snprintf(difference, LOCKSTEP_DIFFERENCE_SIZE, "state hash 0x%016llX vs 0x%016llX",
+                 (unsigned long long)Cpu_state_hash(x), (unsigned long long)Cpu_state_hash(y));
+        return false;
+    }
+
+    return true;
+}
+
+void
+Lockstep__print_state__(const Lockstep__Engine__* self, FILE* out)
+{
+    const Cpu* cpu = &self->cpu;
+
+    fprintf(out, "  %-12s pc 0x%04X  I 0x%04X  DT %3u  ST %3u  rng 0x%08X%s%s%s\n",
+        self->name,
+        cpu->pc,
+        cpu->i,
+        cpu->delay_timer,
+        cpu->sound_timer,
+        cpu->rng,
+        cpu->paused ? "  paused" : "",
+        cpu->exited ? "  exited" : "",
+        cpu->error != CPU_NO_ERROR ? "  faulted" : ""
+    );
+
+    fputs("               V", out);
+    for(u8 reg = 0; reg < 16; reg++)
+    {
+        fprintf(out, " %02X", cpu->registers[reg]);
+    }
+
+    fputs("\n               stack", out);
+    for(const Stack_Type* entry = cpu->stack.stack_ptr; entry < cpu->stack.data + cpu->stack.size; entry++)
+    {
+        fprintf(out, " 0x%03X", (u16)*entry);
+    }
+    fputc('\n', out);
+}
+
+// runs both engines from the start for `frames` frames, false at the first
+// divergence, described in `divergence` and printed to `report` if not NULL
+bool
+Lockstep__run__(const u8* program, size_t program_size, const Analyzer* analysis, const Lockstep_Options* options, Lockstep_Granularity granularity, u64 frames, Lockstep__Divergence__* divergence, FILE* report)
+{
+    // they point at each other (cpu -> renderer...), they must not move
+    Lockstep__Engine__* engines = calloc(2, sizeof(Lockstep__Engine__));
+    if(!engines)
+    {
+        return false;
+    }
+
+    Lockstep__Engine__* a = &engines[0];
+    Lockstep__Engine__* b = &engines[1];
+    if(!Lockstep__engine_init__(a, "interpreter", program, program_size, options, NULL) ||
+       !Lockstep__engine_init__(b, "compiled", program, program_size, options, options->compiled))
+    {
+        Lockstep__engine_deinit__(a);
+        Lockstep__engine_deinit__(b);
+        free(engines);
+        snprintf(divergence->difference, LOCKSTEP_DIFFERENCE_SIZE, "couldn't start the engines");
+        return false;
+    }
+
+    if(options->replay)
+    {
+        Replay_rewind(options->replay);
+    }
+
+    bool agree = true;
+    u64 instructions = 0;
+    u16 pc = a->cpu.pc;
+
+    for(u64 frame = 0; agree && frame < frames; frame++)
+    {
+        divergence->frame = frame;
+
+        if(options->replay)
+        {
+            u16 keys = Replay_keys(options->replay, frame);
+            Keyboard_set_keys(&a->keyboard, keys);
+            Keyboard_set_keys(&b->keyboard, keys);
+        }
+
+        u32 executed = 0;
+        while(agree && executed < options->speed && !a->cpu.exited && !a->cpu.paused)
+        {
+            u32 budget = options->speed - executed;
+            if(granularity == LOCKSTEP_INSTRUCTION)
+            {
+                budget = 1;
+            }
+            else if(granularity == LOCKSTEP_BLOCK)
+            {
+                const Analyzer_Block* block = Analyzer_block_at(analysis, a->cpu.pc);
+                u32 block_size = block ? block->instructions : 1;
+                budget = block_size < budget ? block_size : budget;
+            }
+
+            pc = a->cpu.pc;
+            u32 ran_a = Cpu_run(&a->cpu, budget);
+            u32 ran_b = Cpu_run(&b->cpu, budget);
+
+            if(ran_a != ran_b)
+            {
+                snprintf(divergence->difference, LOCKSTEP_DIFFERENCE_SIZE, "instructions run %u vs %u", ran_a, ran_b);
+                agree = false;
+            }
+            else if(!Lockstep__compare__(a, b, false, divergence->difference))
+            {
+                agree = false;
+            }
+            else
+            {
+                instructions += ran_a;
+            }
+
+            // a fault, or the program stopped on Fx0A/00FD
+            if(ran_a == 0 || a->cpu.error != CPU_NO_ERROR)
+            {
+                break;
+            }
+            executed += ran_a;
+        }
+
+        if(!agree || a->cpu.error != CPU_NO_ERROR)
+        {
+            break;
+        }
+
+        Cpu_end_frame(&a->cpu);
+        Cpu_end_frame(&b->cpu);
+
+        pc = a->cpu.pc;
+        if(!Lockstep__compare__(a, b, true, divergence->difference))
+        {
+            agree = false;
+            break;
+        }
+        divergence->frames = frame + 1;
+
+        if(a->cpu.exited)
+        {
+            break;
+        }
+    }
+
+    divergence->instructions = instructions;
+    divergence->pc = pc;
+    divergence->error = a->cpu.error;
+    divergence->fault_pc = a->cpu.fault_pc;
+    divergence->exited = a->cpu.exited;
+
+    if(!agree && report)
+    {
+        const Analyzer_Instruction instruction = Analyzer_decode(a->cpu.memory, pc, options->mode);
+        char mnemonic[32];
+        Analyzer_format(&instruction, mnemonic, sizeof(mnemonic));
+
+        fprintf(report, "lockstep: diverged in frame %llu after %llu instructions, at 0x%04X %04X %s: %s\n",
+            (unsigned long long)divergence->frame,
+            (unsigned long long)instructions,
+            pc,
+            instruction.opcode,
+            mnemonic,
+            divergence->difference
+        );
+        Lockstep__print_state__(a, report);
+        Lockstep__print_state__(b, report);
+    }
+
+    Lockstep__engine_deinit__(a);
+    Lockstep__engine_deinit__(b);
+    free(engines);
+    return agree;
+}
@@ -0,0 +1,44 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "utils/type_alias.h"
+#include "cpu.h"
+#include "analyzer.h"
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// how often the two engines are compared
+typedef enum {
+    LOCKSTEP_INSTRUCTION,   // after every instruction
+    LOCKSTEP_BLOCK,         // after every basic block (see Analyzer_Block)
+    LOCKSTEP_FRAME,         // after every frame
+} Lockstep_Granularity;
+
+typedef struct {
+    Lockstep_Granularity granularity;
+    u64 frames;
+    u32 speed;
+    Cpu_Mode mode;
+    Cpu_Quirks quirks;
+    u32 seed;
+    const Cpu_Compiled* compiled;
+    Replay* replay;         // NULL for no key pressed
+} Lockstep_Options;
+
+bool
+Lockstep_granularity_from_name(const char* name, Lockstep_Granularity* granularity);
+
+// Runs the interpreter and the compiled engine side by side on the same
+// program and input, headless, and compares the whole machine state (CPU,
+// memory and display) as often as `granularity` asks. The memory and the
+// display are compared through their hashes (see Cpu_state_hash), byte by
+// byte at the end of every frame. A divergence found after a block or a frame is replayed
+// instruction by instruction to report the first instruction that
+// diverged, with both states.
+/// @return: true if the engines agreed for all the frames
+bool
+Lockstep_run(const u8* program, size_t program_size, const Analyzer* analysis, Lockstep_Options options, FILE* out);
+
+#endif // LOCKSTEP_H
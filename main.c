@@ -1,22 +1,316 @@
 #include "chip8.h"
 #include "string.h"
+#include "utils/clock.h"
+
+#ifdef CHIP8_COMPILED
+// the ROM translated by chip8-recompile (see CMakeLists.txt)
+extern const Cpu_Compiled CPU_COMPILED;
+#endif
+
+static void
+usage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s [options] <rom>\n"
+        "  --vsync                 let the display refresh pace the frames\n"
+        "  --jitter-report <file>  write the frame time jitter histogram on exit\n"
+        "  --scale <n>             window pixels per chip8 pixel (default 10)\n"
+        "  --mode <m>              chip8 (default), schip or xochip\n"
+        "  --quirks <q>            modern, vip, schip or xochip (default: from --mode)\n"
+        "  --speed <n>             instructions per frame (default 15)\n"
+        "  --scale2x               smooth the display with the Scale2x filter\n"
+        "  --headless              no window and no audio, run as fast as possible\n"
+        "  --frames <n>            stop after n frames\n"
+        "  --record <file>         record the frames scaled by --scale: .y4m/.raw video\n"
+        "                          (- for y4m on stdout) or .ppm/.png snapshots, the\n"
+        "                          snapshot name needs one %%d (or %%05d) for the frame\n"
+        "                          number, and %%%% for a %%\n"
+        "  --record-every <n>      snapshots: keep one frame every n frames\n"
+        "  --disasm                print the disassembly and code/data map, then exit\n"
+        "  --strict                refuse ROMs with errors in the static analysis\n"
+        "  --interpret             don't use the compiled ROM (chip8-compiled)\n"
+        "  --no-fusion             interpret the instructions one by one, without\n"
+        "                          fusing the common sequences\n"
+        "  --seed <n>              seed of the random numbers, for reproducible runs\n"
+        "  --replay <file>         play the keys back from a replay file\n"
+        "  --lockstep <g>          chip8-compiled: run the interpreter and the compiled\n"
+        "                          ROM side by side for --frames frames (default 3600),\n"
+        "                          compared every instruction, block or frame\n"
+        "  --wall <n>              run n copies of the ROM side by side in one window,\n"
+        "                          2 to 256, with their own seeds (try a small --scale)\n"
+        "  --verify-hash           check the incremental state hash every frame and\n"
+        "                          print it at the end\n"
+        "  --netplay-host <socket> share the game with a --netplay-join on that Unix socket\n"
+        "  --netplay-join <socket> join a --netplay-host, its seed is used\n"
+        "  --netplay-report <file> write the rollback cost of every frame (CSV)\n"
+        "  --stream <socket>       stream the changed rows of every frame on that Unix\n"
+        "                          socket and take the viewers' keys\n"
+        "  --export-state <name>   mirror the registers, keys and display in the shared\n"
+        "                          memory object <name> every frame\n"
+        "  --fast-forward <x>      run x times faster than real time, 0.25 to max\n"
+        "                          (uncapped), changed with = - 0 and tab (held)\n"
+        "  --debug                 start in the debugger console (stdin), ^C to get\n"
+        "                          back there\n"
+        "  --audio-buffer <n>      samples the audio device asks for at once, 64 to\n"
+        "                          8192 (default 512, about 12 ms)\n"
+        "  --wav <file>            write the sound to a WAV file (- for stdout), in\n"
+        "                          emulated time, also headless\n"
+        "  --bench-startup         print how long the first instruction, the first\n"
+        "                          frame shown and the audio device take, then exit\n",
+        program
+    );
+}
 
 int main(int argc, char* argv[])
 {
-    if(argc != 2)
+    const u64 start_ns = Clock_now_ns();
+
+    Chip8_Options options = {
+        .screen_scale = 10,
+        .speed = 15,
+        .mode = CPU_MODE_CHIP8,
+        .quirks = CPU_QUIRKS_MODERN,
+        .vsync = false,
+        .filter = UPSCALER_FILTER_NONE,
+        .jitter_report_path = NULL,
+        .headless = false,
+        .max_frames = 0,
+        .record_path = NULL,
+        .record_every = 1,
+        .strict = false,
+        .compiled = NULL,
+        .seed = 0,
+        .replay_path = NULL,
+        .lockstep = LOCKSTEP_FRAME,
+        .verify_hash = false,
+        .netplay_path = NULL,
+        .netplay_role = NETPLAY_HOST,
+        .netplay_report_path = NULL,
+        .stream_path = NULL,
+        .export_name = NULL,
+        .start_ns = start_ns,
+    };
+
+#ifdef CHIP8_COMPILED
+    options.compiled = &CPU_COMPILED;
+#endif
+
+    char* rom_file = NULL;
+    bool disasm = false;
+    bool lockstep = false;
+    bool quirks_set = false;
+
+    for(int iii = 1; iii < argc; ++iii)
+    {
+        if(strcmp(argv[iii], "--vsync") == 0)
+        {
+            options.vsync = true;
+        }
+        else if(strcmp(argv[iii], "--jitter-report") == 0 && iii + 1 < argc)
+        {
+            options.jitter_report_path = argv[++iii];
+        }
+        else if(strcmp(argv[iii], "--scale") == 0 && iii + 1 < argc)
+        {
+            options.screen_scale = (u8)atoi(argv[++iii]);
+        }
+        else if(strcmp(argv[iii], "--mode") == 0 && iii + 1 < argc)
+        {
+            const char* mode = argv[++iii];
+            if(strcmp(mode, "chip8") == 0) options.mode = CPU_MODE_CHIP8;
+            else if(strcmp(mode, "schip") == 0) options.mode = CPU_MODE_SCHIP;
+            else if(strcmp(mode, "xochip") == 0) options.mode = CPU_MODE_XOCHIP;
+            else
+            {
+                usage(argv[0]);
+                exit(0);
+            }
+        }
+        else if(strcmp(argv[iii], "--quirks") == 0 && iii + 1 < argc)
+        {
+            if(!Cpu_quirks_from_name(argv[++iii], &options.quirks))
+            {
+                usage(argv[0]);
+                exit(0);
+            }
+            quirks_set = true;
+        }
+        else if(strcmp(argv[iii], "--speed") == 0 && iii + 1 < argc)
+        {
+            options.speed = (u32)atoi(argv[++iii]);
+        }
+        else if(strcmp(argv[iii], "--scale2x") == 0)
+        {
+            options.filter = UPSCALER_FILTER_SCALE2X;
+        }
+        else if(strcmp(argv[iii], "--headless") == 0)
+        {
+            options.headless = true;
+        }
+        else if(strcmp(argv[iii], "--frames") == 0 && iii + 1 < argc)
+        {
+            options.max_frames = strtoull(argv[++iii], NULL, 10);
+        }
+        else if(strcmp(argv[iii], "--record") == 0 && iii + 1 < argc)
+        {
+            options.record_path = argv[++iii];
+        }
+        else if(strcmp(argv[iii], "--record-every") == 0 && iii + 1 < argc)
+        {
+            options.record_every = (u32)atoi(argv[++iii]);
+        }
+        else if(strcmp(argv[iii], "--disasm") == 0)
+        {
+            disasm = true;
+        }
+        else if(strcmp(argv[iii], "--strict") == 0)
+        {
+            options.strict = true;
+        }
+        else if(strcmp(argv[iii], "--no-fusion") == 0)
+        {
+            options.no_fusion = true;
+        }
+        else if(strcmp(argv[iii], "--interpret") == 0)
+        {
+            options.compiled = NULL;
+        }
+        else if(strcmp(argv[iii], "--seed") == 0 && iii + 1 < argc)
+        {
+            options.seed = (u32)strtoul(argv[++iii], NULL, 0);
+        }
+        else if(strcmp(argv[iii], "--replay") == 0 && iii + 1 < argc)
+        {
+            options.replay_path = argv[++iii];
+        }
+        else if(strcmp(argv[iii], "--lockstep") == 0 && iii + 1 < argc)
+        {
+            if(!Lockstep_granularity_from_name(argv[++iii], &options.lockstep))
+            {
+                usage(argv[0]);
+                exit(0);
+            }
+            lockstep = true;
+        }
+        else if(strcmp(argv[iii], "--wall") == 0 && iii + 1 < argc)
+        {
+            options.wall = (u32)atoi(argv[++iii]);
+            if(options.wall < 2 || options.wall > WALL_MAX_INSTANCES)
+            {
+                usage(argv[0]);
+                exit(0);
+            }
+        }
+        else if(strcmp(argv[iii], "--verify-hash") == 0)
+        {
+            options.verify_hash = true;
+        }
+        else if(strcmp(argv[iii], "--netplay-host") == 0 && iii + 1 < argc)
+        {
+            options.netplay_path = argv[++iii];
+            options.netplay_role = NETPLAY_HOST;
+        }
+        else if(strcmp(argv[iii], "--netplay-join") == 0 && iii + 1 < argc)
+        {
+            options.netplay_path = argv[++iii];
+            options.netplay_role = NETPLAY_JOIN;
+        }
+        else if(strcmp(argv[iii], "--netplay-report") == 0 && iii + 1 < argc)
+        {
+            options.netplay_report_path = argv[++iii];
+        }
+        else if(strcmp(argv[iii], "--stream") == 0 && iii + 1 < argc)
+        {
+            options.stream_path = argv[++iii];
+        }
+        else if(strcmp(argv[iii], "--export-state") == 0 && iii + 1 < argc)
+        {
+            options.export_name = argv[++iii];
+        }
+        else if(strcmp(argv[iii], "--debug") == 0)
+        {
+            options.debug = true;
+        }
+        else if(strcmp(argv[iii], "--fast-forward") == 0 && iii + 1 < argc)
+        {
+            const char* multiplier = argv[++iii];
+            options.speed_multiplier = strcmp(multiplier, "max") == 0 ? CHIP8_SPEED_UNCAPPED : strtod(multiplier, NULL);
+            if(options.speed_multiplier <= 0)
+            {
+                usage(argv[0]);
+                exit(0);
+            }
+        }
+        else if(strcmp(argv[iii], "--audio-buffer") == 0 && iii + 1 < argc)
+        {
+            options.audio_buffer = (u32)atoi(argv[++iii]);
+            if(options.audio_buffer < 64 || options.audio_buffer > 8192)
+            {
+                usage(argv[0]);
+                exit(0);
+            }
+        }
+        else if(strcmp(argv[iii], "--bench-startup") == 0)
+        {
+            options.bench_startup = true;
+        }
+        else if(strcmp(argv[iii], "--wav") == 0 && iii + 1 < argc)
+        {
+            options.wav_path = argv[++iii];
+        }
+        else if(argv[iii][0] != '-' && !rom_file)
+        {
+            rom_file = argv[iii];
+        }
+        else
+        {
+            usage(argv[0]);
+            exit(0);
+        }
+    }
+
+    if(!rom_file)
     {
         fprintf(stderr, "%s: you should pass the rom file\n", argv[0]);
+        usage(argv[0]);
         exit(0);
     }
 
-    String rom_path = String_from_char_ptr(argv[1]);
+    if(!quirks_set)
+    {
+        options.quirks = Cpu_default_quirks(options.mode);
+    }
 
-    u8 chip8_speed = 15;
-    u8 chip8_scale = 10;
+    String rom_path = String_from_char_ptr(rom_file);
 
-    Chip8 chip8 = Chip8_init(rom_path, chip8_scale, chip8_speed);
+    if(disasm)
+    {
+        return Chip8_disassemble(rom_path, options) ? 0 : 1;
+    }
+
+    if(lockstep)
+    {
+        return Chip8_lockstep(rom_path, options) ? 0 : 1;
+    }
+
+    if(options.wall)
+    {
+        if(options.headless)
+        {
+            fputs("Error: a wall needs a window, not --headless\n", stderr);
+            return 1;
+        }
+        return Chip8_wall(rom_path, options) ? 0 : 1;
+    }
+
+    Chip8 chip8 = Chip8_init(rom_path, options);
+    if(!chip8.valid)
+    {
+        return 1;
+    }
 
-    Chip8_mainloop(&chip8);
+    bool ok = Chip8_mainloop(&chip8);
 
     Chip8_deinit(&chip8);
-}
\ No newline at end of file
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,625 @@
+#include "netplay.h"
+#include "utils/clock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define NETPLAY_MAGIC               0x504E3843  // "C8NP"
+#define NETPLAY_DONE                UINT32_MAX  // frame of the final message
+#define NETPLAY_CONNECT_TRIES       100
+#define NETPLAY_CONNECT_DELAY_NS    (100 * CLOCK_NS_PER_MS)
+#define NETPLAY_WAIT_MS             5000        // the other player is gone after that
+#define NETPLAY_FRAME_BUDGET_NS     (CLOCK_NS_PER_SEC / 60)
+
+// Messages are NETPLAY_MESSAGE_SIZE bytes, little endian.
+// hello, both ways once connected:
+//     magic u32, seed u32, speed u32, mode u8, quirks u8, 2 unused, state hash u64
+// input, every frame:
+//     frame u32, keys u16, 2 unused, confirmed frames u32, 4 unused, hash u64
+// the hash is the state hash after the last confirmed frame, the final
+// message (Netplay_finish) has NETPLAY_DONE as frame
+
+static void
+Netplay__put__(u8* at, u64 value, u8 size);
+
+static u64
+Netplay__get__(const u8* at, u8 size);
+
+static int
+Netplay__connect__(Netplay_Role role, const char* socket_path);
+
+static bool
+Netplay__hello__(Netplay* self, Cpu* cpu);
+
+static bool
+Netplay__send__(Netplay* self, const u8* message);
+
+static bool
+Netplay__send_input__(Netplay* self, u32 frame, u16 keys);
+
+static void
+Netplay__receive__(Netplay* self);
+
+static void
+Netplay__on_message__(Netplay* self, const u8* message);
+
+static bool
+Netplay__wait__(Netplay* self);
+
+static u64
+Netplay__confirmed__(const Netplay* self);
+
+static u16
+Netplay__remote_keys__(const Netplay* self, u64 frame);
+
+static bool
+Netplay__run_frame__(Netplay* self, Cpu* cpu, u64 frame);
+
+static bool
+Netplay__rollback__(Netplay* self, Cpu* cpu, u64* resimulated);
+
+static bool
+Netplay__check__(Netplay* self);
+
+Netplay
+Netplay_init(Netplay_Role role, const char* socket_path, Cpu* cpu, const char* report_path)
+{
+    Netplay netplay = {};
+
+    netplay.role = role;
+    netplay.rollback_from = UINT64_MAX;
+
+    netplay.pad = malloc(sizeof(Keyboard));
+    netplay.frames = malloc(NETPLAY_ROLLBACK_FRAMES * sizeof(Netplay__Frame__));
+    if(!netplay.pad || !netplay.frames)
+    {
+        free(netplay.pad);
+        free(netplay.frames);
+        netplay.valid = false;
+        return netplay;
+    }
+
+    *netplay.pad = Keyboard_init();
+
+    netplay.socket = Netplay__connect__(role, socket_path);
+    if(netplay.socket < 0 || !Netplay__hello__(&netplay, cpu))
+    {
+        Netplay_deinit(&netplay);
+        netplay.valid = false;
+        return netplay;
+    }
+
+    // everything else happens between the frames
+    fcntl(netplay.socket, F_SETFL, fcntl(netplay.socket, F_GETFL) | O_NONBLOCK);
+
+    if(report_path)
+    {
+        netplay.report = fopen(report_path, "w");
+        if(!netplay.report)
+        {
+            fprintf(stderr, "Error: Netplay: couldn't open %s\n", report_path);
+            Netplay_deinit(&netplay);
+            netplay.valid = false;
+            return netplay;
+        }
+        fputs("frame,resimulated,resimulation_us,stall_us\n", netplay.report);
+    }
+
+    // the program only sees the keys of both players, from here
+    cpu->keyboard = netplay.pad;
+
+    netplay.valid = true;
+    return netplay;
+}
+
+bool
+Netplay_advance(Netplay* self, Cpu* cpu, u16 local_keys)
+{
+    Netplay__receive__(self);
+
+    // too far ahead: the frame to roll back to would be gone
+    u64 stall_ns = 0;
+    if(self->frame >= self->remote_frames + NETPLAY_ROLLBACK_FRAMES)
+    {
+        const u64 start = Clock_now_ns();
+        while(self->frame >= self->remote_frames + NETPLAY_ROLLBACK_FRAMES)
+        {
+            if(!Netplay__wait__(self))
+            {
+                return false;
+            }
+        }
+
+        stall_ns = Clock_now_ns() - start;
+        self->stats.stalls++;
+        self->stats.stall_ns += stall_ns;
+    }
+
+    const u64 start = Clock_now_ns();
+    u64 resimulated = 0;
+    if(!Netplay__rollback__(self, cpu, &resimulated))
+    {
+        return false;
+    }
+
+    const u64 resimulation_ns = resimulated ? Clock_now_ns() - start : 0;
+    if(resimulated)
+    {
+        self->stats.rollbacks++;
+        self->stats.resimulated += resimulated;
+        self->stats.resimulation_ns += resimulation_ns;
+        if(resimulation_ns > self->stats.resimulation_max_ns)
+        {
+            self->stats.resimulation_max_ns = resimulation_ns;
+        }
+        if(resimulation_ns > NETPLAY_FRAME_BUDGET_NS)
+        {
+            self->stats.over_budget++;
+        }
+    }
+
+    if(!Netplay__check__(self) || !Netplay__send_input__(self, (u32)self->frame, local_keys))
+    {
+        return false;
+    }
+
+    Netplay__Frame__* frame = &self->frames[self->frame % NETPLAY_ROLLBACK_FRAMES];
+    frame->local = local_keys;
+    frame->remote = Netplay__remote_keys__(self, self->frame);
+
+    if(self->report)
+    {
+        fprintf(self->report, "%llu,%llu,%llu,%llu\n",
+            (unsigned long long)self->frame,
+            (unsigned long long)resimulated,
+            (unsigned long long)(resimulation_ns / CLOCK_NS_PER_US),
+            (unsigned long long)(stall_ns / CLOCK_NS_PER_US)
+        );
+    }
+
+    return Netplay__run_frame__(self, cpu, self->frame++);
+}
+
+bool
+Netplay_finish(Netplay* self, Cpu* cpu)
+{
+    while(self->remote_frames < self->frame)
+    {
+        if(!Netplay__wait__(self))
+        {
+            return false;
+        }
+    }
+
+    u64 resimulated = 0;
+    if(!Netplay__rollback__(self, cpu, &resimulated))
+    {
+        return false;
+    }
+
+    // the hash of the last frame both ran, for a last check
+    u8 message[NETPLAY_MESSAGE_SIZE] = {};
+    const u64 confirmed = Netplay__confirmed__(self);
+    Netplay__put__(message, NETPLAY_DONE, 4);
+    Netplay__put__(message + 8, confirmed, 4);
+    Netplay__put__(message + 16, confirmed ? self->hashes[(confirmed - 1) % NETPLAY_HISTORY] : 0, 8);
+    if(!Netplay__send__(self, message))
+    {
+        return false;
+    }
+
+    while(!self->remote_done)
+    {
+        if(!Netplay__wait__(self))
+        {
+            return false;
+        }
+    }
+
+    return Netplay__check__(self);
+}
+
+void
+Netplay_print_stats(const Netplay* self, FILE* out)
+{
+    const Netplay_Stats* stats = &self->stats;
+
+    fprintf(out,
+        "netplay: %llu frames, %llu rollbacks, %llu frames resimulated, "
+        "resimulation %.3f ms mean %.3f ms max, %llu over the %.1f ms frame budget, "
+        "%llu stalls (%.1f ms), %llu desyncs\n",
+        (unsigned long long)self->frame,
+        (unsigned long long)stats->rollbacks,
+        (unsigned long long)stats->resimulated,
+        stats->rollbacks ? (double)stats->resimulation_ns / stats->rollbacks / CLOCK_NS_PER_MS : 0.0,
+        (double)stats->resimulation_max_ns / CLOCK_NS_PER_MS,
+        (unsigned long long)stats->over_budget,
+        (double)NETPLAY_FRAME_BUDGET_NS / CLOCK_NS_PER_MS,
+        (unsigned long long)stats->stalls,
+        (double)stats->stall_ns / CLOCK_NS_PER_MS,
+        (unsigned long long)stats->desyncs
+    );
+}
+
+void
+Netplay_deinit(Netplay* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    if(self->socket > 0)
+    {
+        close(self->socket);
+    }
+
+    if(self->report)
+    {
+        fclose(self->report);
+    }
+
+    if(self->pad)
+    {
+        Keyboard_deinit(self->pad);
+        free(self->pad);
+    }
+    free(self->frames);
+
+    self->socket = -1;
+    self->report = NULL;
+    self->pad = NULL;
+    self->frames = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+void
+Netplay__put__(u8* at, u64 value, u8 size)
+{
+    for(u8 iii = 0; iii < size; iii++)
+    {
+        at[iii] = (u8)(value >> (8 * iii));
+    }
+}
+
+u64
+Netplay__get__(const u8* at, u8 size)
+{
+    u64 value = 0;
+    for(u8 iii = 0; iii < size; iii++)
+    {
+        value |= (u64)at[iii] << (8 * iii);
+    }
+
+    return value;
+}
+
+int
+Netplay__connect__(Netplay_Role role, const char* socket_path)
+{
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Error: Netplay: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        fprintf(stderr, "Error: Netplay: socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(role == NETPLAY_JOIN)
+    {
+        // the host may not be there yet
+        for(u32 tries = 0; connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0; tries++)
+        {
+            if(tries == NETPLAY_CONNECT_TRIES)
+            {
+                fprintf(stderr, "Error: Netplay: couldn't connect to %s: %s\n", socket_path, strerror(errno));
+                close(fd);
+                return -1;
+            }
+            Clock_sleep_until_ns(Clock_now_ns() + NETPLAY_CONNECT_DELAY_NS);
+        }
+
+        return fd;
+    }
+
+    unlink(socket_path);
+    if(bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 1) < 0)
+    {
+        fprintf(stderr, "Error: Netplay: couldn't listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    fprintf(stderr, "netplay: waiting for the other player on %s\n", socket_path);
+    int peer = accept(fd, NULL, NULL);
+    if(peer < 0)
+    {
+        fprintf(stderr, "Error: Netplay: accept: %s\n", strerror(errno));
+    }
+
+    close(fd);
+    unlink(socket_path);
+    return peer;
+}
+
+bool
+Netplay__hello__(Netplay* self, Cpu* cpu)
+{
+    u8 message[NETPLAY_MESSAGE_SIZE];
+
+    // the host's first, the joiner takes its seed and answers with its own
+    if(self->role == NETPLAY_JOIN)
+    {
+        if(recv(self->socket, message, sizeof(message), MSG_WAITALL) != sizeof(message) ||
+           Netplay__get__(message, 4) != NETPLAY_MAGIC)
+        {
+            fputs("Error: Netplay: the host didn't say hello\n", stderr);
+            return false;
+        }
+        Cpu_seed(cpu, (u32)Netplay__get__(message + 4, 4));
+    }
+
+    u8 hello[NETPLAY_MESSAGE_SIZE] = {};
+    Netplay__put__(hello, NETPLAY_MAGIC, 4);
+    Netplay__put__(hello + 4, cpu->rng, 4);
+    Netplay__put__(hello + 8, cpu->speed, 4);
+    hello[12] = (u8)cpu->mode;
+    hello[13] = (u8)cpu->quirks;
+    Netplay__put__(hello + 16, Cpu_state_hash(cpu), 8);
+
+    if(!Netplay__send__(self, hello))
+    {
+        return false;
+    }
+
+    if(self->role == NETPLAY_HOST &&
+       recv(self->socket, message, sizeof(message), MSG_WAITALL) != sizeof(message))
+    {
+        fputs("Error: Netplay: the other player didn't say hello\n", stderr);
+        return false;
+    }
+
+    // the same seed, program, memory and display, and run the same way
+    if(memcmp(message, hello, sizeof(hello)) != 0)
+    {
+        fputs("Error: Netplay: the players run different ROMs, modes, quirks or speeds\n", stderr);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+Netplay__send__(Netplay* self, const u8* message)
+{
+    size_t sent = 0;
+    while(sent < NETPLAY_MESSAGE_SIZE)
+    {
+        ssize_t size = send(self->socket, message + sent, NETPLAY_MESSAGE_SIZE - sent, MSG_NOSIGNAL);
+        if(size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            struct pollfd pollfd = { .fd = self->socket, .events = POLLOUT };
+            poll(&pollfd, 1, NETPLAY_WAIT_MS);
+            continue;
+        }
+        if(size < 0)
+        {
+            fprintf(stderr, "Error: Netplay: send: %s\n", strerror(errno));
+            return false;
+        }
+        sent += (size_t)size;
+    }
+
+    return true;
+}
+
+bool
+Netplay__send_input__(Netplay* self, u32 frame, u16 keys)
+{
+    u8 message[NETPLAY_MESSAGE_SIZE] = {};
+    const u64 confirmed = Netplay__confirmed__(self);
+
+    Netplay__put__(message, frame, 4);
+    Netplay__put__(message + 4, keys, 2);
+    Netplay__put__(message + 8, confirmed, 4);
+    Netplay__put__(message + 16, confirmed ? self->hashes[(confirmed - 1) % NETPLAY_HISTORY] : 0, 8);
+
+    return Netplay__send__(self, message);
+}
+
+void
+Netplay__receive__(Netplay* self)
+{
+    while(!self->remote_left)
+    {
+        ssize_t size = recv(
+            self->socket,
+            self->received + self->received_size,
+            NETPLAY_MESSAGE_SIZE - self->received_size,
+            0
+        );
+
+        if(size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        if(size <= 0)
+        {
+            self->remote_left = true;
+            return;
+        }
+
+        self->received_size += (size_t)size;
+        if(self->received_size == NETPLAY_MESSAGE_SIZE)
+        {
+            Netplay__on_message__(self, self->received);
+            self->received_size = 0;
+        }
+    }
+}
+
+void
+Netplay__on_message__(Netplay* self, const u8* message)
+{
+    const u64 frame = Netplay__get__(message, 4);
+
+    self->remote_confirmed = Netplay__get__(message + 8, 4);
+    self->remote_hash = Netplay__get__(message + 16, 8);
+
+    if(frame == NETPLAY_DONE)
+    {
+        self->remote_done = true;
+        return;
+    }
+
+    // a stream socket keeps them in order
+    const u16 keys = (u16)Netplay__get__(message + 4, 2);
+    self->remote_keys[frame % NETPLAY_HISTORY] = keys;
+    self->remote_frames = frame + 1;
+
+    // already run with a guess
+    if(frame < self->frame &&
+       self->frames[frame % NETPLAY_ROLLBACK_FRAMES].remote != keys &&
+       frame < self->rollback_from)
+    {
+        self->rollback_from = frame;
+    }
+}
+
+bool
+Netplay__wait__(Netplay* self)
+{
+    const u64 remote_frames = self->remote_frames;
+    const bool remote_done = self->remote_done;
+
+    while(self->remote_frames == remote_frames && self->remote_done == remote_done)
+    {
+        if(self->remote_left)
+        {
+            fputs("Error: Netplay: the other player left\n", stderr);
+            return false;
+        }
+
+        struct pollfd pollfd = { .fd = self->socket, .events = POLLIN };
+        if(poll(&pollfd, 1, NETPLAY_WAIT_MS) == 0)
+        {
+            fputs("Error: Netplay: the other player stopped answering\n", stderr);
+            return false;
+        }
+
+        Netplay__receive__(self);
+    }
+
+    return true;
+}
+
+u64
+Netplay__confirmed__(const Netplay* self)
+{
+    return self->frame < self->remote_frames ? self->frame : self->remote_frames;
+}
+
+u16
+Netplay__remote_keys__(const Netplay* self, u64 frame)
+{
+    // predicted: the last keys received are still held
+    if(frame >= self->remote_frames)
+    {
+        frame = self->remote_frames;
+        if(frame == 0)
+        {
+            return 0;
+        }
+        frame--;
+    }
+
+    return self->remote_keys[frame % NETPLAY_HISTORY];
+}
+
+bool
+Netplay__run_frame__(Netplay* self, Cpu* cpu, u64 frame)
+{
+    Netplay__Frame__* saved = &self->frames[frame % NETPLAY_ROLLBACK_FRAMES];
+
+    Cpu_save_state(cpu, &saved->state);
+    saved->held = Keyboard_keys(self->pad);
+
+    Keyboard_set_keys(self->pad, saved->local | saved->remote);
+    bool ok = Cpu_run_frame(cpu);
+
+    self->hashes[frame % NETPLAY_HISTORY] = Cpu_state_hash(cpu);
+    return ok;
+}
+
+bool
+Netplay__rollback__(Netplay* self, Cpu* cpu, u64* resimulated)
+{
+    const u64 from = self->rollback_from;
+    if(from == UINT64_MAX)
+    {
+        return true;
+    }
+    self->rollback_from = UINT64_MAX;
+
+    // the keys held before the frame first, so the same ones are new again,
+    // then the state, which waits for a key again if it did
+    const Netplay__Frame__* first = &self->frames[from % NETPLAY_ROLLBACK_FRAMES];
+    Keyboard_register(self->pad, NULL, NULL);
+    Keyboard_set_keys(self->pad, first->held);
+    Cpu_load_state(cpu, &first->state);
+
+    for(u64 frame = from; frame < self->frame; frame++)
+    {
+        self->frames[frame % NETPLAY_ROLLBACK_FRAMES].remote = Netplay__remote_keys__(self, frame);
+        if(!Netplay__run_frame__(self, cpu, frame))
+        {
+            return false;
+        }
+    }
+
+    *resimulated = self->frame - from;
+    return true;
+}
+
+bool
+Netplay__check__(Netplay* self)
+{
+    const u64 confirmed = self->remote_confirmed;
+
+    if(confirmed == 0 || confirmed <= self->checked ||
+       confirmed > Netplay__confirmed__(self) || self->frame - confirmed >= NETPLAY_HISTORY)
+    {
+        return true;
+    }
+    self->checked = confirmed;
+
+    if(self->hashes[(confirmed - 1) % NETPLAY_HISTORY] != self->remote_hash)
+    {
+        self->stats.desyncs++;
+        fprintf(stderr, "Error: Netplay: desync, the states differ after frame %llu\n", (unsigned long long)(confirmed - 1));
+        return false;
+    }
+
+    return true;
+}
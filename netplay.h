@@ -0,0 +1,102 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "utils/type_alias.h"
+#include "cpu.h"
+#include "keyboard.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define NETPLAY_ROLLBACK_FRAMES     8       // how far the remote input can lag behind
+#define NETPLAY_HISTORY             64      // frames of hashes kept
+#define NETPLAY_MESSAGE_SIZE        24
+
+typedef enum {
+    NETPLAY_HOST,       // listens on the socket, gives the seed
+    NETPLAY_JOIN,       // connects to the socket
+} Netplay_Role;
+
+typedef struct {
+    u64 rollbacks;          // mispredictions
+    u64 resimulated;        // frames run again after them
+    u64 resimulation_ns;    // restoring and running them again, in total
+    u64 resimulation_max_ns;
+    u64 over_budget;        // frames whose resimulation didn't fit in a frame (16.6 ms)
+    u64 stalls;             // frames waiting for the remote input
+    u64 stall_ns;
+    u64 desyncs;            // confirmed frames whose state hashes differ
+} Netplay_Stats;
+
+// a frame that can be rolled back to
+typedef struct {
+    Cpu_State state;        // before the frame
+    u16 held;               // the keys held before the frame
+    u16 local;
+    u16 remote;             // the remote input it was run with, maybe predicted
+} Netplay__Frame__;
+
+// Two players on one game over a Unix socket, rollback style: every frame
+// each side sends its keys, and runs the frame right away with the remote
+// keys predicted (the last ones received). When the real ones turn out
+// different, the machine goes back to the state saved before that frame
+// and runs the frames since again. The program sees the keys of both
+// players or'ed together.
+//
+// Each side also sends the state hash of its last confirmed frame (both
+// inputs known), a different hash is a desync.
+typedef struct {
+    int socket;
+    Netplay_Role role;
+    Keyboard* pad;          // the cpu's keyboard: the keys of both players
+
+    u64 frame;              // next frame to run
+    u64 remote_frames;      // remote inputs received, in order
+    u16 remote_keys[NETPLAY_HISTORY];
+    u64 rollback_from;      // first mispredicted frame, or UINT64_MAX
+    Netplay__Frame__* frames;               // NETPLAY_ROLLBACK_FRAMES
+    u64 hashes[NETPLAY_HISTORY];            // state hash after each frame
+
+    // the last confirmed frames count and hash the other side sent
+    u64 remote_confirmed;
+    u64 remote_hash;
+    u64 checked;            // confirmed frames compared so far
+    bool remote_done;       // sent its final hash (Netplay_finish)
+
+    u8 received[NETPLAY_MESSAGE_SIZE];  // partial message
+    size_t received_size;
+    bool remote_left;
+
+    Netplay_Stats stats;
+    FILE* report;           // per frame CSV, or NULL
+    bool valid;
+} Netplay;
+
+/// connects to the other player (the joiner retries for a few seconds)
+/// and takes over `cpu`'s keyboard, the same cpu has to be given to
+/// Netplay_advance and Netplay_finish. The joiner takes the host's seed and
+/// both check they run the same program the same way.
+/// `report_path`: if set, the resimulation cost of every frame is written there
+Netplay
+Netplay_init(Netplay_Role role, const char* socket_path, Cpu* cpu, const char* report_path);
+
+/// runs the next frame with `local_keys`, after rolling back if the remote
+/// input received says so. Waits for the remote input when it is
+/// NETPLAY_ROLLBACK_FRAMES behind.
+/// @return: false on a CPU fault, a desync or when the other player left
+bool
+Netplay_advance(Netplay* self, Cpu* cpu, u16 local_keys);
+
+/// waits for the remote input of every frame run, so the state is final
+/// @return: false if the other player left before
+bool
+Netplay_finish(Netplay* self, Cpu* cpu);
+
+/// prints the stats to `out`
+void
+Netplay_print_stats(const Netplay* self, FILE* out);
+
+void
+Netplay_deinit(Netplay* self);
+
+#endif // NETPLAY_H
@@ -0,0 +1,223 @@
+#include "pacer.h"
+#include "utils/clock.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#define PACER_SPIN_MIN_NS       (100 * CLOCK_NS_PER_US)
+#define PACER_SPIN_MAX_NS       (2 * CLOCK_NS_PER_MS)
+
+static void
+Pacer__record__(Pacer* self, u64 now);
+
+static void
+Pacer__adapt_spin__(Pacer* self, u64 sleep_target, u64 woke_at);
+
+Pacer
+Pacer_init(f64 hz)
+{
+    Pacer self = {};
+
+    if(hz <= 0)
+    {
+        fputs("Error: Pacer: frame rate should be positive\n", stderr);
+        self.valid = false;
+        return self;
+    }
+
+    self.period_ns = (u64)((f64)CLOCK_NS_PER_SEC / hz);
+    self.base_period_ns = self.period_ns;
+    self.speed = 1;
+    self.spin_ns = PACER_SPIN_MIN_NS * 5;
+    self.last_frame_ns = Clock_now_ns();
+    self.deadline_ns = self.last_frame_ns + self.period_ns;
+    self.jitter_min_ns = INT64_MAX;
+    self.jitter_max_ns = INT64_MIN;
+
+    self.valid = true;
+    return self;
+}
+
+void
+Pacer_wait(Pacer* self)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    u64 now = Clock_now_ns();
+
+    if(self->speed <= 0)
+    {
+        self->last_frame_ns = now;
+        self->deadline_ns = now;
+        return;
+    }
+
+    if(now < self->deadline_ns)
+    {
+        // sleep for the bulk of the remaining time, the scheduler is not
+        // precise enough for the rest so we spin on the clock
+        if(self->sleep_only)
+        {
+            Clock_sleep_until_ns(self->deadline_ns);
+        }
+        else if(self->deadline_ns - now > self->spin_ns)
+        {
+            u64 sleep_target = self->deadline_ns - self->spin_ns;
+            Clock_sleep_until_ns(sleep_target);
+            Pacer__adapt_spin__(self, sleep_target, Clock_now_ns());
+        }
+
+        while((now = Clock_now_ns()) < self->deadline_ns);
+    }
+
+    Pacer__record__(self, now);
+
+    if(now > self->deadline_ns + self->period_ns)
+    {
+        // we fell behind (stalled host), don't try to catch up with a burst
+        self->missed++;
+        self->deadline_ns = now + self->period_ns;
+    }
+    else
+    {
+        // absolute schedule, so errors don't accumulate
+        self->deadline_ns += self->period_ns;
+    }
+}
+
+void
+Pacer_set_speed(Pacer* self, f64 speed)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    self->speed = speed > 0 ? speed : 0;
+    if(self->speed > 0)
+    {
+        self->period_ns = (u64)((f64)self->base_period_ns / self->speed);
+    }
+
+    // no burst to catch up and no jitter from the old period
+    self->last_frame_ns = Clock_now_ns();
+    self->deadline_ns = self->last_frame_ns + self->period_ns;
+}
+
+void
+Pacer_set_spin(Pacer* self, bool enabled)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    self->sleep_only = !enabled;
+}
+
+bool
+Pacer_export(Pacer* self, const char* path)
+{
+    if(!self || !self->valid || !path)
+    {
+        return false;
+    }
+
+    FILE* file = fopen(path, "w");
+    if(!file)
+    {
+        fprintf(stderr, "Error: Pacer: couldn't open %s\n", path);
+        return false;
+    }
+
+    f64 mean = 0;
+    f64 stddev = 0;
+    if(self->frames > 0)
+    {
+        mean = self->jitter_sum / (f64)self->frames;
+        stddev = sqrt(fmax(0, self->jitter_sum_sq / (f64)self->frames - mean * mean));
+    }
+
+    fprintf(file, "# period_us=%.3f frames=%llu missed=%llu\n",
+        (f64)self->period_ns / CLOCK_NS_PER_US,
+        (unsigned long long)self->frames,
+        (unsigned long long)self->missed
+    );
+    fprintf(file, "# jitter_us min=%.3f max=%.3f mean=%.3f stddev=%.3f\n",
+        self->frames ? (f64)self->jitter_min_ns / CLOCK_NS_PER_US : 0,
+        self->frames ? (f64)self->jitter_max_ns / CLOCK_NS_PER_US : 0,
+        mean / CLOCK_NS_PER_US,
+        stddev / CLOCK_NS_PER_US
+    );
+    fputs("bucket_from_us,bucket_to_us,frames\n", file);
+
+    for(int iii = 0; iii < PACER_HISTOGRAM_BUCKETS; ++iii)
+    {
+        i64 from = ((i64)iii - PACER_HISTOGRAM_BUCKETS / 2) * PACER_HISTOGRAM_BUCKET_NS;
+        fprintf(file, "%.1f,%.1f,%llu\n",
+            (f64)from / CLOCK_NS_PER_US,
+            (f64)(from + PACER_HISTOGRAM_BUCKET_NS) / CLOCK_NS_PER_US,
+            (unsigned long long)self->histogram[iii]
+        );
+    }
+
+    fclose(file);
+    return true;
+}
+
+void
+Pacer_deinit(Pacer* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    self->valid = false;
+}
+
+
+// Private functions
+void
+Pacer__record__(Pacer* self, u64 now)
+{
+    i64 jitter = (i64)(now - self->last_frame_ns) - (i64)self->period_ns;
+    self->last_frame_ns = now;
+
+    if(jitter < self->jitter_min_ns) self->jitter_min_ns = jitter;
+    if(jitter > self->jitter_max_ns) self->jitter_max_ns = jitter;
+    self->jitter_sum += (f64)jitter;
+    self->jitter_sum_sq += (f64)jitter * (f64)jitter;
+
+    // first and last buckets collect everything out of range
+    i64 bucket = jitter / PACER_HISTOGRAM_BUCKET_NS + PACER_HISTOGRAM_BUCKETS / 2;
+    if(jitter < 0 && jitter % PACER_HISTOGRAM_BUCKET_NS != 0) bucket--;
+    if(bucket < 0) bucket = 0;
+    if(bucket >= PACER_HISTOGRAM_BUCKETS) bucket = PACER_HISTOGRAM_BUCKETS - 1;
+
+    self->histogram[bucket]++;
+    self->frames++;
+}
+
+void
+Pacer__adapt_spin__(Pacer* self, u64 sleep_target, u64 woke_at)
+{
+    // keep the spin window at about twice the worst recent oversleep
+    u64 oversleep = woke_at > sleep_target ? woke_at - sleep_target : 0;
+    u64 wanted = oversleep * 2;
+
+    if(wanted > self->spin_ns)
+    {
+        self->spin_ns = wanted;
+    }
+    else
+    {
+        self->spin_ns -= (self->spin_ns - wanted) / 16;
+    }
+
+    if(self->spin_ns < PACER_SPIN_MIN_NS) self->spin_ns = PACER_SPIN_MIN_NS;
+    if(self->spin_ns > PACER_SPIN_MAX_NS) self->spin_ns = PACER_SPIN_MAX_NS;
+}
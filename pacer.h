@@ -0,0 +1,58 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include "utils/type_alias.h"
+
+#include <stdbool.h>
+
+// histogram of (actual frame time - target frame time), centered on zero
+#define PACER_HISTOGRAM_BUCKETS     64
+#define PACER_HISTOGRAM_BUCKET_NS   25000   // 25us per bucket -> +-800us range
+
+typedef struct {
+    u64 period_ns;
+    u64 base_period_ns; // at 1x
+    f64 speed;          // multiplier of the frame rate, 0 for uncapped
+    u64 deadline_ns;
+    u64 last_frame_ns;
+    u64 spin_ns;        // how long before the deadline we stop sleeping and start spinning
+    bool sleep_only;    // never spin, see Pacer_set_spin
+    u64 frames;
+    u64 missed;         // frames that ended more than a whole period late
+    i64 jitter_min_ns;
+    i64 jitter_max_ns;
+    f64 jitter_sum;
+    f64 jitter_sum_sq;
+    u64 histogram[PACER_HISTOGRAM_BUCKETS];
+    bool valid;
+} Pacer;
+
+/// @param: hz: target frame rate, e.g. 60
+Pacer
+Pacer_init(f64 hz);
+
+/// blocks until the next frame deadline (sleep, then spin for the last part)
+/// and records the frame time of the frame that just finished
+void
+Pacer_wait(Pacer* self);
+
+/// changes the frame rate to `speed` times the one given to Pacer_init,
+/// 0 (or less) for uncapped: Pacer_wait returns right away. The schedule
+/// restarts from now, the frames run uncapped aren't recorded
+void
+Pacer_set_speed(Pacer* self, f64 speed);
+
+/// spinning is on after Pacer_init. Off, the whole wait is a sleep and the
+/// frames end as late as the scheduler wakes up: for many pacers sharing
+/// the cpus, where spinning would starve the others
+void
+Pacer_set_spin(Pacer* self, bool enabled);
+
+/// writes a summary and the jitter histogram as CSV to `path`
+bool
+Pacer_export(Pacer* self, const char* path);
+
+void
+Pacer_deinit(Pacer* self);
+
+#endif // PACER_H
@@ -0,0 +1,489 @@
+#include "analyzer.h"
+#include "cpu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Translates a ROM to a C file implementing a Cpu_Compiled (see cpu.h).
+//
+// Every instruction found by the Analyzer gets a label, and a dispatch switch
+// on pc jumps to it. Straight line code falls through from one label to the
+// next, jumps and skips to known code are gotos, and each instruction checks
+// the budget first so the frame timing matches the interpreter exactly.
+// Simple instructions are inlined, the rest (drawing, keys, calls, stores...)
+// call Cpu_execute so both engines share one implementation of them.
+
+#define RECOMPILER_BYTES_PER_LINE   16
+
+typedef struct {
+    FILE* out;
+    const Analyzer* analysis;
+    Cpu_Quirks quirks;
+    const Cpu_Quirk_Set* quirk_set;
+} Recompiler;
+
+static bool
+Recompiler__load__(const char* path, u8** data, size_t* size);
+
+static void
+Recompiler__emit_data__(Recompiler* self, const char* name, const u8* data, size_t size);
+
+static void
+Recompiler__emit_goto__(Recompiler* self, u32 target);
+
+static void
+Recompiler__emit_execute__(Recompiler* self, const Analyzer_Instruction* instruction);
+
+static void
+Recompiler__emit_instruction__(Recompiler* self, const Analyzer_Instruction* instruction);
+
+static void
+Recompiler__emit__(Recompiler* self, const char* rom_name, const u8* program, size_t program_size);
+
+static void
+usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [--mode chip8|schip|xochip] [--quirks modern|vip|schip|xochip] <rom> <output.c>\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    Cpu_Mode mode = CPU_MODE_CHIP8;
+    Cpu_Quirks quirks = CPU_QUIRKS_MODERN;
+    bool quirks_set = false;
+    const char* paths[2] = {};
+    int paths_count = 0;
+
+    for(int iii = 1; iii < argc; ++iii)
+    {
+        if(strcmp(argv[iii], "--mode") == 0 && iii + 1 < argc)
+        {
+            const char* name = argv[++iii];
+            if(strcmp(name, "chip8") == 0) mode = CPU_MODE_CHIP8;
+            else if(strcmp(name, "schip") == 0) mode = CPU_MODE_SCHIP;
+            else if(strcmp(name, "xochip") == 0) mode = CPU_MODE_XOCHIP;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if(strcmp(argv[iii], "--quirks") == 0 && iii + 1 < argc)
+        {
+            if(!Cpu_quirks_from_name(argv[++iii], &quirks))
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            quirks_set = true;
+        }
+        else if(argv[iii][0] != '-' && paths_count < 2)
+        {
+            paths[paths_count++] = argv[iii];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(paths_count != 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!quirks_set)
+    {
+        quirks = Cpu_default_quirks(mode);
+    }
+
+    u8* program = NULL;
+    size_t program_size = 0;
+    if(!Recompiler__load__(paths[0], &program, &program_size))
+    {
+        return 1;
+    }
+
+    Analyzer analysis = Analyzer_init(program, program_size, mode);
+    if(!analysis.valid)
+    {
+        free(program);
+        return 1;
+    }
+
+    Analyzer_report(&analysis, stderr);
+
+    FILE* out = fopen(paths[1], "w");
+    if(!out)
+    {
+        fprintf(stderr, "Error: couldn't open %s\n", paths[1]);
+        Analyzer_deinit(&analysis);
+        free(program);
+        return 1;
+    }
+
+    Recompiler recompiler = {
+        .out = out,
+        .analysis = &analysis,
+        .quirks = quirks,
+        .quirk_set = Cpu_quirk_set(quirks),
+    };
+    Recompiler__emit__(&recompiler, paths[0], program, program_size);
+
+    fclose(out);
+
+    fprintf(stderr, "%s: %u instructions in %zu blocks compiled, %u data bytes\n",
+        paths[0], analysis.instructions, analysis.blocks_count, analysis.data_bytes);
+
+    Analyzer_deinit(&analysis);
+    free(program);
+    return 0;
+}
+
+
+// private functions
+bool
+Recompiler__load__(const char* path, u8** data, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Couldn't open %s\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+
+    *data = malloc(length > 0 ? length : 1);
+    if(!*data)
+    {
+        fclose(file);
+        return false;
+    }
+
+    *size = fread(*data, sizeof(u8), length, file);
+    fclose(file);
+    return true;
+}
+
+void
+Recompiler__emit_data__(Recompiler* self, const char* name, const u8* data, size_t size)
+{
+    fprintf(self->out, "static const u8 %s[%zu] = {", name, size);
+    for(size_t iii = 0; iii < size; iii++)
+    {
+        if(iii % RECOMPILER_BYTES_PER_LINE == 0) fputs("\n   ", self->out);
+        fprintf(self->out, " 0x%02X,", data[iii]);
+    }
+    fputs("\n};\n\n", self->out);
+}
+
+void
+Recompiler__emit_goto__(Recompiler* self, u32 target)
+{
+    if(target < self->analysis->program_end && Analyzer_is_code(self->analysis, target))
+    {
+        fprintf(self->out, "    goto L_%04X;\n", target);
+    }
+    else
+    {
+        fprintf(self->out, "    self->pc = 0x%04X; return executed;\n", target & (CPU_MEMORY_SIZE - 1));
+    }
+}
+
+void
+Recompiler__emit_execute__(Recompiler* self, const Analyzer_Instruction* instruction)
+{
+    // a failing instruction is left to the interpreter, which reports it
+    fprintf(self->out,
+        "    self->pc = 0x%04X;\n"
+        "    if(!Cpu_execute(self, 0x%04X)) { self->pc = 0x%04X; return executed - 1; }\n",
+        instruction->addr,
+        instruction->opcode,
+        instruction->addr
+    );
+}
+
+void
+Recompiler__emit_instruction__(Recompiler* self, const Analyzer_Instruction* instruction)
+{
+    FILE* out = self->out;
+    const u16 opcode = instruction->opcode;
+    const u8 x = (opcode & 0x0F00) >> 8;
+    const u8 y = (opcode & 0x00F0) >> 4;
+    const u8 kk = opcode & 0xFF;
+    const u32 next = instruction->addr + instruction->size;
+
+    char mnemonic[32];
+    Analyzer_format(instruction, mnemonic, sizeof(mnemonic));
+    fprintf(out, "L_%04X: // %04X %s\n", instruction->addr, opcode, mnemonic);
+
+    if(instruction->flow == ANALYZER_FLOW_INVALID)
+    {
+        fprintf(out, "    self->pc = 0x%04X; return executed;\n", instruction->addr);
+        return;
+    }
+
+    fprintf(out, "    if(executed == budget) { self->pc = 0x%04X; return executed; }\n", instruction->addr);
+    fputs("    executed++;\n", out);
+
+    switch(instruction->flow)
+    {
+        case ANALYZER_FLOW_JUMP:
+            if(instruction->target <= instruction->addr)
+            {
+                // may close a loop that can't change anything until the next frame
+                fprintf(out, "    executed = Cpu_idle_jump(self, 0x%04X, executed, budget);\n", instruction->addr);
+            }
+            Recompiler__emit_goto__(self, instruction->target);
+            return;
+        case ANALYZER_FLOW_CALL:
+            Recompiler__emit_execute__(self, instruction);
+            Recompiler__emit_goto__(self, instruction->target);
+            return;
+        case ANALYZER_FLOW_RETURN:
+        case ANALYZER_FLOW_COMPUTED:
+            Recompiler__emit_execute__(self, instruction);
+            fputs("    goto dispatch;\n", out);
+            return;
+        case ANALYZER_FLOW_EXIT:
+            Recompiler__emit_execute__(self, instruction);
+            fputs("    return executed;\n", out);
+            return;
+        case ANALYZER_FLOW_SKIP:
+        {
+            // where the skip lands, past a 4 bytes `F000 nnnn` on XO-CHIP
+            const Analyzer_Instruction skipped = Analyzer_decode(self->analysis->memory, (u16)next, self->analysis->mode);
+            const u32 skip = next + skipped.size;
+
+            switch(opcode >> 12)
+            {
+                case 0x3: fprintf(out, "    if(V[0x%X] == 0x%02X)\n", x, kk); break;
+                case 0x4: fprintf(out, "    if(V[0x%X] != 0x%02X)\n", x, kk); break;
+                case 0x5: fprintf(out, "    if(V[0x%X] == V[0x%X])\n", x, y); break;
+                case 0x9: fprintf(out, "    if(V[0x%X] != V[0x%X])\n", x, y); break;
+                default:
+                    // Ex9E/ExA1 read the keyboard
+                    Recompiler__emit_execute__(self, instruction);
+                    fprintf(out, "    if(self->pc != 0x%04X) goto dispatch;\n", next);
+                    return;
+            }
+
+            fputs("    {\n    ", out);
+            Recompiler__emit_goto__(self, skip);
+            fputs("    }\n", out);
+            return;
+        }
+        default:
+            break;
+    }
+
+    // ANALYZER_FLOW_NEXT
+    switch(opcode >> 12)
+    {
+        case 0x6:
+            fprintf(out, "    V[0x%X] = 0x%02X;\n", x, kk);
+            return;
+        case 0x7:
+            fprintf(out, "    V[0x%X] += 0x%02X;\n", x, kk);
+            return;
+        case 0x8:
+        {
+            // same statements as Cpu__alu__, VF is written last
+            const Cpu_Quirk_Set* quirks = self->quirk_set;
+            const u8 source = quirks->shift_vy ? y : x;
+            const char* vf_reset = quirks->vf_reset ? " V[0xF] = 0;" : "";
+
+            switch(opcode & 0xF)
+            {
+                case 0x0: fprintf(out, "    V[0x%X] = V[0x%X];\n", x, y); return;
+                case 0x1: fprintf(out, "    V[0x%X] |= V[0x%X];%s\n", x, y, vf_reset); return;
+                case 0x2: fprintf(out, "    V[0x%X] &= V[0x%X];%s\n", x, y, vf_reset); return;
+                case 0x3: fprintf(out, "    V[0x%X] ^= V[0x%X];%s\n", x, y, vf_reset); return;
+                case 0x4:
+                    fprintf(out, "    { u16 sum = V[0x%X] + V[0x%X]; V[0x%X] = (u8)sum; V[0xF] = sum > 0xFF; }\n", x, y, x);
+                    return;
+                case 0x5:
+                    fprintf(out, "    { u8 no_borrow = V[0x%X] >= V[0x%X]; V[0x%X] -= V[0x%X]; V[0xF] = no_borrow; }\n", x, y, x, y);
+                    return;
+                case 0x6:
+                    fprintf(out, "    { u8 source = V[0x%X]; V[0x%X] = source >> 1; V[0xF] = source & 0x1; }\n", source, x);
+                    return;
+                case 0x7:
+                    fprintf(out, "    { u8 no_borrow = V[0x%X] >= V[0x%X]; V[0x%X] = V[0x%X] - V[0x%X]; V[0xF] = no_borrow; }\n", y, x, x, y, x);
+                    return;
+                case 0xE:
+                    fprintf(out, "    { u8 source = V[0x%X]; V[0x%X] = source << 1; V[0xF] = source >> 7; }\n", source, x);
+                    return;
+            }
+            break;
+        }
+        case 0xA:
+            fprintf(out, "    self->i = 0x%03X;\n", instruction->target);
+            return;
+        case 0xF:
+            switch(kk)
+            {
+                case 0x00:
+                    fprintf(out, "    self->i = 0x%04X;\n", instruction->operand);
+                    return;
+                case 0x07:
+                    fprintf(out, "    V[0x%X] = self->delay_timer;\n", x);
+                    return;
+                case 0x15:
+                    fprintf(out, "    self->delay_timer = V[0x%X];\n", x);
+                    return;
+                case 0x18:
+                    fprintf(out, "    self->sound_timer = V[0x%X];\n", x);
+                    fputs("    Cpu_sound_set(self, self->frame_executed + executed);\n", out);
+                    return;
+                case 0x1E:
+                    fprintf(out, "    self->i += V[0x%X];\n", x);
+                    return;
+                case 0x29:
+                    fprintf(out, "    self->i = V[0x%X] * 5;\n", x);
+                    return;
+                case 0x65:
+                    fprintf(out, "    for(u8 r = 0; r <= 0x%X; r++) V[r] = self->memory[(self->i + r) & (CPU_MEMORY_SIZE - 1)];\n", x);
+                    if(self->quirk_set->load_store_i) fprintf(out, "    self->i += 0x%X;\n", x + 1);
+                    return;
+                case 0x0A:
+                    // paused until a key is pressed
+                    Recompiler__emit_execute__(self, instruction);
+                    fputs("    return executed;\n", out);
+                    return;
+                case 0x33:
+                case 0x55:
+                    // a store into the code drops the compiled code
+                    Recompiler__emit_execute__(self, instruction);
+                    fputs("    if(!self->compiled) return executed;\n", out);
+                    return;
+            }
+            break;
+        case 0x5:
+            // XO-CHIP 5xy2 stores, 5xy3 loads
+            Recompiler__emit_execute__(self, instruction);
+            if((opcode & 0xF) == 0x2) fputs("    if(!self->compiled) return executed;\n", out);
+            return;
+    }
+
+    Recompiler__emit_execute__(self, instruction);
+}
+
+void
+Recompiler__emit__(Recompiler* self, const char* rom_name, const u8* program, size_t program_size)
+{
+    static const char* const MODES[] = {
+        [CPU_MODE_CHIP8] = "CPU_MODE_CHIP8",
+        [CPU_MODE_SCHIP] = "CPU_MODE_SCHIP",
+        [CPU_MODE_XOCHIP] = "CPU_MODE_XOCHIP",
+    };
+
+    static const char* const QUIRKS[] = {
+#define RECOMPILER_QUIRKS_NAME(NAME, ...) [CPU_QUIRKS_##NAME] = "CPU_QUIRKS_" #NAME,
+        CPU_QUIRKS_PROFILES(RECOMPILER_QUIRKS_NAME)
+#undef RECOMPILER_QUIRKS_NAME
+    };
+
+    FILE* out = self->out;
+    const Analyzer* analysis = self->analysis;
+
+    fprintf(out, "// generated by chip8-recompile from %s, do not edit\n", rom_name);
+    fputs("#include \"cpu.h\"\n\n", out);
+
+    Recompiler__emit_data__(self, "PROGRAM", program, program_size);
+
+    // code bytes, a store there means the program changed its own code
+    size_t map_size = (program_size + 7) / 8;
+    u8* code_map = calloc(map_size, sizeof(u8));
+    for(size_t offset = 0; offset < program_size; offset++)
+    {
+        if(analysis->map[CPU_PROGRAM_ADDR + offset] & (ANALYZER_BYTE_CODE | ANALYZER_BYTE_OPERAND))
+        {
+            code_map[offset >> 3] |= 1 << (offset & 7);
+        }
+    }
+    Recompiler__emit_data__(self, "CODE_MAP", code_map, map_size);
+    free(code_map);
+
+    fputs(
+        "static u32\n"
+        "Compiled__run__(Cpu* self, u32 budget)\n"
+        "{\n"
+        "    u8* const V = self->registers;\n"
+        "    u32 executed = 0;\n"
+        "\n"
+        "dispatch:\n"
+        "    switch(self->pc)\n"
+        "    {\n",
+        out
+    );
+
+    for(u32 addr = CPU_PROGRAM_ADDR; addr < analysis->program_end; addr++)
+    {
+        if(analysis->map[addr] & ANALYZER_BYTE_CODE)
+        {
+            fprintf(out, "        case 0x%04X: goto L_%04X;\n", addr, addr);
+        }
+    }
+
+    fputs(
+        "        default: return executed;\n"
+        "    }\n",
+        out
+    );
+
+    u32 previous_next = 0;
+    bool falls_through = false;
+
+    for(u32 addr = CPU_PROGRAM_ADDR; addr < analysis->program_end; addr++)
+    {
+        if(!(analysis->map[addr] & ANALYZER_BYTE_CODE))
+        {
+            continue;
+        }
+
+        // the previous instruction continues somewhere else than here
+        if(falls_through && previous_next != addr)
+        {
+            Recompiler__emit_goto__(self, previous_next);
+        }
+
+        const Analyzer_Block* block = Analyzer_block_at(analysis, addr);
+        if(block)
+        {
+            fputc('\n', out);
+        }
+
+        Analyzer_Instruction instruction = Analyzer_decode(analysis->memory, addr, analysis->mode);
+        Recompiler__emit_instruction__(self, &instruction);
+
+        previous_next = addr + instruction.size;
+        falls_through = instruction.flow == ANALYZER_FLOW_NEXT || instruction.flow == ANALYZER_FLOW_SKIP;
+    }
+
+    if(falls_through)
+    {
+        Recompiler__emit_goto__(self, previous_next);
+    }
+
+    fprintf(out,
+        "}\n"
+        "\n"
+        "const Cpu_Compiled CPU_COMPILED = {\n"
+        "    .mode = %s,\n"
+        "    .quirks = %s,\n"
+        "    .program = PROGRAM,\n"
+        "    .program_size = sizeof(PROGRAM),\n"
+        "    .code_map = CODE_MAP,\n"
+        "    .run = Compiled__run__,\n"
+        "};\n",
+        MODES[analysis->mode],
+        QUIRKS[self->quirks]
+    );
+}
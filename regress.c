@@ -0,0 +1,580 @@
+// Golden hash regression runner: `chip8-regress [--update] [--threads n] <golden file>`
+//
+// The golden file lists the runs, each one a ROM played headless for a
+// number of frames with recorded keys, followed by the hashes expected
+// every `every` frames: the machine state (Cpu_state_hash) and the display
+// (Renderer_hash). Paths are relative to the golden file.
+//
+//     # a comment
+//     rom BLITZ mode=chip8 speed=15 seed=1 frames=3600 every=300 replay=BLITZ.rep
+//     300 <state hash> <display hash>
+//     600 ...
+//
+// `fault=<error>` (Cpu_error_name with _ for the spaces, e.g.
+// fault=invalid_instruction) expects the run to stop on that fault before
+// its last frame, the checkpoints before it are compared as usual.
+//
+// The runs are spread over a pool of threads. A run stops at its first
+// mismatch, and the others stop at their next checkpoint, so a broken cpu.c
+// or renderer.c fails in about the time it takes to reach it. --update runs
+// everything and writes the hashes found back into the file.
+
+#include "cpu.h"
+#include "renderer.h"
+#include "keyboard.h"
+#include "speaker.h"
+#include "replay.h"
+#include "utils/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <SDL2/SDL.h>
+
+#define REGRESS_LINE_SIZE       512
+#define REGRESS_MAX_THREADS     64
+
+typedef struct {
+    u64 frame;
+    u64 state;
+    u64 display;
+} Regress__Checkpoint__;
+
+typedef struct {
+    char line[REGRESS_LINE_SIZE];   // the `rom` line, written back by --update
+    char name[REGRESS_LINE_SIZE];
+    char rom[REGRESS_LINE_SIZE];
+    char replay[REGRESS_LINE_SIZE]; // empty for no keys
+    char fault[REGRESS_LINE_SIZE];  // the Cpu_error_name expected, empty for none
+    Cpu_Mode mode;
+    Cpu_Quirks quirks;
+    u32 speed;
+    u32 seed;
+    u64 frames;
+    u64 every;
+
+    Regress__Checkpoint__* golden;  // from the file
+    size_t golden_count;
+    Regress__Checkpoint__* found;   // by the run
+    size_t found_count;
+
+    u64 fault_frame;            // the expected fault happened there, 0 before
+    bool done;                  // ran to the end, or to the expected fault
+    bool failed;                // a mismatch, at found[found_count - 1]
+    const char* error;          // couldn't run
+    f64 seconds;
+} Regress__Run__;
+
+typedef struct {
+    Regress__Run__* runs;
+    size_t runs_count;
+    char* header;               // the comments before the first run
+    bool update;
+    atomic_size_t next;         // first run nobody took
+    atomic_bool stop;           // a run failed, the others give up
+} Regress__Suite__;
+
+static bool
+Regress__load__(Regress__Suite__* suite, const char* path);
+
+static bool
+Regress__parse_run__(Regress__Run__* run, const char* line, const char* directory);
+
+static bool
+Regress__add_golden__(Regress__Run__* run, const char* line);
+
+static int
+Regress__worker__(void* arg);
+
+static void
+Regress__run__(Regress__Suite__* suite, Regress__Run__* run);
+
+static u8*
+Regress__read_file__(const char* path, size_t* size);
+
+static bool
+Regress__report__(const Regress__Suite__* suite);
+
+static bool
+Regress__write__(const Regress__Suite__* suite, const char* path);
+
+int main(int argc, char* argv[])
+{
+    Regress__Suite__ suite = {};
+    const char* path = NULL;
+    u32 threads = 0;
+
+    for(int iii = 1; iii < argc; iii++)
+    {
+        if(strcmp(argv[iii], "--update") == 0)
+        {
+            suite.update = true;
+        }
+        else if(strcmp(argv[iii], "--threads") == 0 && iii + 1 < argc)
+        {
+            threads = (u32)atoi(argv[++iii]);
+        }
+        else if(argv[iii][0] != '-' && !path)
+        {
+            path = argv[iii];
+        }
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+
+    if(!path)
+    {
+        fprintf(stderr, "usage: %s [--update] [--threads n] <golden file>\n", argv[0]);
+        return 1;
+    }
+
+    if(!Regress__load__(&suite, path))
+    {
+        return 1;
+    }
+
+    if(threads == 0)
+    {
+        threads = (u32)SDL_GetCPUCount();
+    }
+    if(threads > suite.runs_count) threads = (u32)suite.runs_count;
+    if(threads > REGRESS_MAX_THREADS) threads = REGRESS_MAX_THREADS;
+    if(threads == 0) threads = 1;
+
+    atomic_init(&suite.next, 0);
+    atomic_init(&suite.stop, false);
+
+    // the caller is one of the workers
+    const u64 start = Clock_now_ns();
+    SDL_Thread* workers[REGRESS_MAX_THREADS] = {};
+    for(u32 iii = 1; iii < threads; iii++)
+    {
+        workers[iii] = SDL_CreateThread(Regress__worker__, "regress", &suite);
+    }
+    Regress__worker__(&suite);
+    for(u32 iii = 1; iii < threads; iii++)
+    {
+        if(workers[iii]) SDL_WaitThread(workers[iii], NULL);
+    }
+    const f64 seconds = (f64)(Clock_now_ns() - start) / CLOCK_NS_PER_SEC;
+
+    bool ok = Regress__report__(&suite);
+    if(ok && suite.update)
+    {
+        ok = Regress__write__(&suite, path);
+    }
+
+    printf("%s: %zu runs on %u threads in %.2f s\n", ok ? "ok" : "FAILED", suite.runs_count, threads, seconds);
+
+    for(size_t iii = 0; iii < suite.runs_count; iii++)
+    {
+        free(suite.runs[iii].golden);
+        free(suite.runs[iii].found);
+    }
+    free(suite.runs);
+    free(suite.header);
+    return ok ? 0 : 1;
+}
+
+// Private functions
+bool
+Regress__load__(Regress__Suite__* suite, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if(!file)
+    {
+        fprintf(stderr, "Error: regress: couldn't open %s\n", path);
+        return false;
+    }
+
+    // the paths in the file are relative to it
+    char directory[REGRESS_LINE_SIZE] = ".";
+    const char* slash = strrchr(path, '/');
+    if(slash && (size_t)(slash - path) < sizeof(directory))
+    {
+        memcpy(directory, path, slash - path);
+        directory[slash - path] = '\0';
+    }
+
+    char line[REGRESS_LINE_SIZE];
+    size_t header_size = 0;
+    u32 number = 0;
+    bool ok = true;
+
+    while(ok && fgets(line, sizeof(line), file))
+    {
+        number++;
+        const char* text = line + strspn(line, " \t");
+
+        if(text[0] == '#' || text[0] == '\n' || text[0] == '\0')
+        {
+            if(suite->runs_count == 0)
+            {
+                const size_t size = strlen(line);
+                char* header = realloc(suite->header, header_size + size + 1);
+                if(!header)
+                {
+                    ok = false;
+                    break;
+                }
+                memcpy(header + header_size, line, size + 1);
+                suite->header = header;
+                header_size += size;
+            }
+            continue;
+        }
+
+        if(strncmp(text, "rom ", 4) == 0)
+        {
+            Regress__Run__* runs = realloc(suite->runs, (suite->runs_count + 1) * sizeof(Regress__Run__));
+            if(!runs)
+            {
+                ok = false;
+                break;
+            }
+            suite->runs = runs;
+            suite->runs_count++;
+
+            ok = Regress__parse_run__(&suite->runs[suite->runs_count - 1], text, directory);
+        }
+        else
+        {
+            ok = suite->runs_count > 0 && Regress__add_golden__(&suite->runs[suite->runs_count - 1], text);
+        }
+
+        if(!ok)
+        {
+            fprintf(stderr, "Error: regress: %s:%u: can't read %s", path, number, line);
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+bool
+Regress__parse_run__(Regress__Run__* run, const char* line, const char* directory)
+{
+    *run = (Regress__Run__){
+        .mode = CPU_MODE_CHIP8,
+        .quirks = CPU_QUIRKS_COUNT,
+        .speed = 15,
+        .seed = 1,
+        .frames = 3600,
+        .every = 300,
+    };
+
+    snprintf(run->line, sizeof(run->line), "%s", line);
+    run->line[strcspn(run->line, "\r\n")] = '\0';
+
+    char fields[REGRESS_LINE_SIZE];
+    snprintf(fields, sizeof(fields), "%s", run->line + 4);
+
+    for(char* field = strtok(fields, " \t"); field; field = strtok(NULL, " \t"))
+    {
+        char* value = strchr(field, '=');
+        if(!value)
+        {
+            if(run->name[0])
+            {
+                return false;
+            }
+            snprintf(run->name, sizeof(run->name), "%s", field);
+            snprintf(run->rom, sizeof(run->rom), "%s/%s", directory, field);
+            continue;
+        }
+        *value++ = '\0';
+
+        if(strcmp(field, "mode") == 0)
+        {
+            if(strcmp(value, "chip8") == 0) run->mode = CPU_MODE_CHIP8;
+            else if(strcmp(value, "schip") == 0) run->mode = CPU_MODE_SCHIP;
+            else if(strcmp(value, "xochip") == 0) run->mode = CPU_MODE_XOCHIP;
+            else return false;
+        }
+        else if(strcmp(field, "quirks") == 0)
+        {
+            if(!Cpu_quirks_from_name(value, &run->quirks)) return false;
+        }
+        else if(strcmp(field, "speed") == 0) run->speed = (u32)strtoul(value, NULL, 10);
+        else if(strcmp(field, "seed") == 0) run->seed = (u32)strtoul(value, NULL, 0);
+        else if(strcmp(field, "frames") == 0) run->frames = strtoull(value, NULL, 10);
+        else if(strcmp(field, "every") == 0) run->every = strtoull(value, NULL, 10);
+        else if(strcmp(field, "replay") == 0) snprintf(run->replay, sizeof(run->replay), "%s/%s", directory, value);
+        else if(strcmp(field, "fault") == 0)
+        {
+            snprintf(run->fault, sizeof(run->fault), "%s", value);
+            for(char* c = run->fault; *c; c++)
+            {
+                if(*c == '_') *c = ' ';
+            }
+        }
+        else return false;
+    }
+
+    if(run->quirks == CPU_QUIRKS_COUNT)
+    {
+        run->quirks = Cpu_default_quirks(run->mode);
+    }
+
+    return run->name[0] && run->speed > 0 && run->every > 0 && run->frames >= run->every;
+}
+
+bool
+Regress__add_golden__(Regress__Run__* run, const char* line)
+{
+    Regress__Checkpoint__ checkpoint;
+    unsigned long long frame, state, display;
+    if(sscanf(line, "%llu %llx %llx", &frame, &state, &display) != 3)
+    {
+        return false;
+    }
+    checkpoint = (Regress__Checkpoint__){ .frame = frame, .state = state, .display = display };
+
+    Regress__Checkpoint__* golden = realloc(run->golden, (run->golden_count + 1) * sizeof(Regress__Checkpoint__));
+    if(!golden)
+    {
+        return false;
+    }
+
+    run->golden = golden;
+    run->golden[run->golden_count++] = checkpoint;
+    return true;
+}
+
+int
+Regress__worker__(void* arg)
+{
+    Regress__Suite__* suite = arg;
+
+    for(;;)
+    {
+        const size_t index = atomic_fetch_add(&suite->next, 1);
+        if(index >= suite->runs_count || atomic_load(&suite->stop))
+        {
+            break;
+        }
+
+        Regress__run__(suite, &suite->runs[index]);
+    }
+
+    return 0;
+}
+
+void
+Regress__run__(Regress__Suite__* suite, Regress__Run__* run)
+{
+    size_t program_size = 0;
+    u8* program = Regress__read_file__(run->rom, &program_size);
+    run->found = calloc(run->frames / run->every, sizeof(Regress__Checkpoint__));
+    if(!program || !run->found || program_size > Cpu_max_program_size(run->mode))
+    {
+        run->error = "can't load the ROM";
+        free(program);
+        atomic_store(&suite->stop, true);
+        return;
+    }
+
+    Replay replay = {};
+    if(run->replay[0])
+    {
+        replay = Replay_load(run->replay);
+        if(!replay.valid)
+        {
+            run->error = "can't load the replay";
+            free(program);
+            atomic_store(&suite->stop, true);
+            return;
+        }
+    }
+
+    Keyboard keyboard = Keyboard_init();
+    Speaker speaker = Speaker_init_silent();
+    Renderer renderer = Renderer_init();
+    Cpu cpu = Cpu_init(&renderer, &keyboard, &speaker, run->speed, run->mode, run->quirks);
+    Cpu_load_program(&cpu, program, program_size);
+    Cpu_seed(&cpu, run->seed);
+    free(program);
+
+    // the same frames as Chip8_mainloop with --replay --headless
+    const u64 start = Clock_now_ns();
+    for(u64 frame = 0; frame < run->frames; frame++)
+    {
+        if(replay.valid)
+        {
+            Keyboard_set_keys(&keyboard, Replay_keys(&replay, frame));
+        }
+
+        if(!Cpu_run_frame(&cpu))
+        {
+            if(run->fault[0] && strcmp(Cpu_error_name(cpu.error), run->fault) == 0)
+            {
+                run->fault_frame = frame + 1;
+                break;
+            }
+
+            run->error = Cpu_error_name(cpu.error);
+            atomic_store(&suite->stop, true);
+            break;
+        }
+
+        if((frame + 1) % run->every != 0)
+        {
+            continue;
+        }
+
+        Regress__Checkpoint__* found = &run->found[run->found_count];
+        found->frame = frame + 1;
+        found->state = Cpu_state_hash(&cpu);
+        found->display = Renderer_hash(&renderer);
+
+        const Regress__Checkpoint__* golden = run->found_count < run->golden_count ? &run->golden[run->found_count] : NULL;
+        run->found_count++;
+
+        if(!suite->update &&
+           (!golden || golden->frame != found->frame || golden->state != found->state || golden->display != found->display))
+        {
+            run->failed = true;
+            atomic_store(&suite->stop, true);
+            break;
+        }
+
+        if(atomic_load(&suite->stop))
+        {
+            break;
+        }
+    }
+    run->seconds = (f64)(Clock_now_ns() - start) / CLOCK_NS_PER_SEC;
+    if(run->fault[0] && !run->fault_frame && !run->failed && !run->error && run->found_count == run->frames / run->every)
+    {
+        run->error = "the expected fault didn't happen";
+        atomic_store(&suite->stop, true);
+    }
+    run->done = !run->failed && !run->error &&
+                (run->fault_frame || run->found_count == run->frames / run->every);
+
+    Cpu_deinit(&cpu);
+    Renderer_deinit(&renderer);
+    Keyboard_deinit(&keyboard);
+    Replay_deinit(&replay);
+}
+
+u8*
+Regress__read_file__(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file)
+    {
+        return NULL;
+    }
+
+    u8* data = malloc(CPU_MEMORY_SIZE);
+    if(data)
+    {
+        *size = fread(data, 1, CPU_MEMORY_SIZE, file);
+    }
+
+    fclose(file);
+    return data;
+}
+
+bool
+Regress__report__(const Regress__Suite__* suite)
+{
+    bool ok = true;
+
+    for(size_t iii = 0; iii < suite->runs_count; iii++)
+    {
+        const Regress__Run__* run = &suite->runs[iii];
+
+        if(run->error)
+        {
+            printf("%-16s error: %s\n", run->name, run->error);
+            ok = false;
+        }
+        else if(run->failed)
+        {
+            const Regress__Checkpoint__* found = &run->found[run->found_count - 1];
+            const Regress__Checkpoint__* golden = run->found_count <= run->golden_count ? &run->golden[run->found_count - 1] : NULL;
+
+            if(!golden || golden->frame != found->frame)
+            {
+                printf("%-16s no golden hashes for frame %llu, run --update\n", run->name, (unsigned long long)found->frame);
+            }
+            else
+            {
+                printf("%-16s mismatch in frame %llu:%s%s\n", run->name, (unsigned long long)found->frame,
+                    found->state != golden->state ? " state" : "",
+                    found->display != golden->display ? " display" : ""
+                );
+                printf("%-16s   state   %016llX, expected %016llX\n", "", (unsigned long long)found->state, (unsigned long long)golden->state);
+                printf("%-16s   display %016llX, expected %016llX\n", "", (unsigned long long)found->display, (unsigned long long)golden->display);
+            }
+            ok = false;
+        }
+        else if(run->done)
+        {
+            const u64 frames = run->fault_frame ? run->fault_frame : run->found[run->found_count - 1].frame;
+            printf("%-16s ok, %llu frames in %.3f s (%.0f frames/s)%s%s\n", run->name,
+                (unsigned long long)frames,
+                run->seconds,
+                run->seconds > 0 ? (f64)frames / run->seconds : 0.0,
+                run->fault_frame ? ", then the expected " : "",
+                run->fault_frame ? run->fault : ""
+            );
+        }
+        else
+        {
+            printf("%-16s stopped\n", run->name);
+            ok = false;
+        }
+
+        // a golden file longer than the run is out of date too
+        if(run->done && !suite->update && run->golden_count != run->found_count)
+        {
+            printf("%-16s %zu golden hashes for %zu checkpoints, run --update\n", run->name, run->golden_count, run->found_count);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+bool
+Regress__write__(const Regress__Suite__* suite, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if(!file)
+    {
+        fprintf(stderr, "Error: regress: couldn't write %s\n", path);
+        return false;
+    }
+
+    if(suite->header)
+    {
+        fputs(suite->header, file);
+    }
+
+    for(size_t iii = 0; iii < suite->runs_count; iii++)
+    {
+        const Regress__Run__* run = &suite->runs[iii];
+
+        fprintf(file, "%s%s\n", iii ? "\n" : "", run->line);
+        for(size_t checkpoint = 0; checkpoint < run->found_count; checkpoint++)
+        {
+            fprintf(file, "%llu %016llX %016llX\n",
+                (unsigned long long)run->found[checkpoint].frame,
+                (unsigned long long)run->found[checkpoint].state,
+                (unsigned long long)run->found[checkpoint].display
+            );
+        }
+    }
+
+    fclose(file);
+    return true;
+}
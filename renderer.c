@@ -1,166 +1,369 @@
 #include "renderer.h"
 #include "error.h"
+#include "utils/hash.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
-#include <sys/time.h>
 
-#include <SDL2/SDL.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#define CANVAS_COLS  64
-#define CANVAS_ROWS  32
-#define WINDOW_TITLE "Chip 8"
+static void
+Renderer__place__(u32 bits, u32 width, u32 pos_x, i32 cols, bool wrap, u64 placed[CANVAS_WORDS]);
 
-static u64 __time_ms__(void);
+static void
+Renderer__shift_right_4__(u64 row[CANVAS_WORDS]);
+
+static void
+Renderer__shift_left_4__(u64 row[CANVAS_WORDS]);
+
+static u64
+Renderer__hash_row__(const Renderer_Frame* frame, int plane, u32 row);
 
 Renderer
-Renderer_init(i32 scale)
+Renderer_init(void)
 {
     Renderer self = {};
 
-    const i32 WINDIW_X_POS    = 0;
-    const i32 WINDIW_Y_POS    = 0;
-    const u32 WINDOW_FLAGS    = 0;
-    const u32 SDL_FLAGS       = SDL_INIT_VIDEO;
-    const u32 RENDERER_FLAGS  = 0;
-
-    self.width  = CANVAS_COLS * scale;
-    self.height = CANVAS_ROWS * scale;
-    self.scale  = scale;
+    self.display = calloc(1, sizeof(Renderer_Frame));
+    self.planes = 0x1;
+    self.frames = TripleBuffer_construct(sizeof(Renderer_Frame));
 
-    i32 sdl_init_status = SDL_Init(SDL_FLAGS);
-
-    if(sdl_init_status != 0)
+    if(!self.display || !self.frames.valid)
     {
-        fputs(SDL_GetError(), stderr);
         self.valid = false;
         return self;
     }
 
-    self.window = SDL_CreateWindow(
-        WINDOW_TITLE,
-        SDL_WINDOWPOS_CENTERED,
-        SDL_WINDOWPOS_CENTERED,
-        self.width - scale,     // for some unknown reason(s) we should remove that last col/row
-        self.height - scale,
-        WINDOW_FLAGS
-    );
+    self.valid = true;
+    return self;
+}
 
-    if(!self.window)
+bool
+Renderer_set_display(Renderer* self, Display* display, u32 tile)
+{
+    if(!self || !self->valid || !Display_attach(display, tile, &self->frames))
     {
-        fputs(SDL_GetError(), stderr);
-        self.valid = false;
-        return self;
+        return false;
     }
 
-    self.sdl_renderer = SDL_CreateRenderer(self.window, -1, RENDERER_FLAGS);
+    self->output = display;
+    self->tile = tile;
+    return true;
+}
 
-    self.valid = true;
-    self.display = calloc(CANVAS_COLS * CANVAS_ROWS, sizeof(u8));
+void
+Renderer_set_sink(Renderer* self, FrameSink* sink)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    self->sink = sink;
+}
 
-    if(!self.display)
+void
+Renderer_set_server(Renderer* self, FrameServer* server)
+{
+    if(!self || !self->valid)
     {
-        self.valid = false;
-        return self;
+        return;
     }
 
-    self.valid = true;
-    return self;
+    self->server = server;
 }
 
 void
-Renderer_render(Renderer* self)
+Renderer_publish(Renderer* self)
 {
     if(!self || !self->valid)
     {
         return;
     }
 
-    // Set the draw color of renderer to green
-    SDL_RenderClear(self->sdl_renderer);
+    Renderer_Frame* frame = TripleBuffer_back(&self->frames);
+    memcpy(frame, self->display, sizeof(Renderer_Frame));
 
-    // rectangle color -> black
-    SDL_SetRenderDrawColor(self->sdl_renderer, 0, 0, 0, 255);
+    if(self->sink)
+    {
+        FrameSink_push(self->sink, frame);
+    }
 
-    u32 x, y;
-    for(int iii = 0; iii < CANVAS_COLS * CANVAS_ROWS; ++iii)
+    if(self->server)
     {
-        // If the value at this.display[i] == 1, then draw a pixel.
-        if (self->display[iii] != 0)
-        {
-            // Grabs the x position of the pixel based off of `iii`
-            x = (iii % CANVAS_COLS) * self->scale;
+        FrameServer_publish(self->server, frame);
+    }
 
-            // Grabs the y position of the pixel based off of `i`
-            y = (iii / CANVAS_COLS) * self->scale;
+    if(self->output)
+    {
+        TripleBuffer_publish(&self->frames);
+        Display_notify(self->output);
+    }
+}
 
-            // Place a pixel at position (x, y) with a width and height of scale
-            SDL_RenderFillRect(self->sdl_renderer, &(SDL_Rect){ x, y, self->scale, self->scale });
-        }
+void
+Renderer_skip(Renderer* self)
+{
+    if(!self || !self->valid || !self->sink)
+    {
+        return;
     }
 
-    // background color
-    SDL_SetRenderDrawColor(self->sdl_renderer, 255, 255, 255, 255);
+    Renderer_Frame* frame = TripleBuffer_back(&self->frames);
+    memcpy(frame, self->display, sizeof(Renderer_Frame));
+    FrameSink_push(self->sink, frame);
+}
 
-    // Update the renderer which will show the renderer cleared by the draw color which is green
-    SDL_RenderPresent(self->sdl_renderer);
+void
+Renderer_set_hires(Renderer* self, bool hires)
+{
+    if(!self->valid)
+    {
+        return;
+    }
+
+    memset(self->display, 0, sizeof(Renderer_Frame));
+    memset(self->dirty_rows, 0xFF, sizeof(self->dirty_rows));
+    self->display->hires = hires;
+}
+
+void
+Renderer_select_planes(Renderer* self, u8 planes)
+{
+    self->planes = planes & ((1 << CANVAS_PLANES) - 1);
 }
 
 bool
-Renderer_toggle_pixel(Renderer* self, u32 pos_x, u32 pos_y)
+Renderer_draw_sprite(Renderer* self, const u8* sprite, u8 height, bool wide, u32 pos_x, u32 pos_y, bool wrap)
 {
     if(!self->valid)
     {
         return false;
     }
 
-    if (pos_x > CANVAS_COLS) {
-        pos_x -= CANVAS_COLS;
-    } else if (pos_x < 0) {
-        pos_x += CANVAS_COLS;
+    const i32 cols = Renderer_Frame_cols(self->display);
+    const i32 rows = Renderer_Frame_rows(self->display);
+    const u32 width = wide ? 16 : 8;
+    const u32 row_bytes = wide ? 2 : 1;
+
+    if(wide)
+    {
+        height = 16;
+    }
+
+    pos_x %= cols;
+    pos_y %= rows;
+
+    bool erased = false;
+
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        if(!(self->planes & (1 << plane)))
+        {
+            continue;
+        }
+
+        for(u32 row = 0; row < height; ++row)
+        {
+            u32 line = pos_y + row;
+            if(line >= (u32)rows)
+            {
+                if(!wrap) break;
+                line -= rows;
+            }
+
+            const u8* data = &sprite[row * row_bytes];
+            u32 bits = wide ? ((u32)data[0] << 8) | data[1] : data[0];
+
+            // the whole sprite row is placed in a display row and XORed at once
+            u64 placed[CANVAS_WORDS];
+            Renderer__place__(bits, width, pos_x, cols, wrap, placed);
+
+            u64* target = self->display->planes[plane][line];
+            erased |= ((target[0] & placed[0]) | (target[1] & placed[1])) != 0;
+            target[0] ^= placed[0];
+            target[1] ^= placed[1];
+            self->dirty_rows[plane] |= 1ULL << line;
+        }
+
+        sprite += height * row_bytes;
     }
 
-    if (pos_y > CANVAS_ROWS) {
-        pos_y -= CANVAS_ROWS;
-    } else if (pos_y < 0) {
-        pos_y += CANVAS_ROWS;
+    return erased;
+}
+
+void
+Renderer_scroll_down(Renderer* self, u8 rows)
+{
+    if(!self->valid)
+    {
+        return;
     }
 
-    u32 pixel_loc = pos_x + (pos_y * CANVAS_COLS);
-    self->display[pixel_loc] ^= 1;
+    const i32 height = Renderer_Frame_rows(self->display);
+    if(rows > height) rows = height;
 
-    return !self->display[pixel_loc];
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        if(self->planes & (1 << plane))
+        {
+            u64 (*lines)[CANVAS_WORDS] = self->display->planes[plane];
+            memmove(&lines[rows], &lines[0], (height - rows) * sizeof(lines[0]));
+            memset(&lines[0], 0, rows * sizeof(lines[0]));
+            self->dirty_rows[plane] = ~0ULL;
+        }
+    }
 }
 
 void
-Renderer_clear(Renderer* self)
+Renderer_scroll_up(Renderer* self, u8 rows)
 {
     if(!self->valid)
     {
         return;
     }
 
-    memset(self->display, 0, CANVAS_COLS * CANVAS_ROWS);
+    const i32 height = Renderer_Frame_rows(self->display);
+    if(rows > height) rows = height;
+
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        if(self->planes & (1 << plane))
+        {
+            u64 (*lines)[CANVAS_WORDS] = self->display->planes[plane];
+            memmove(&lines[0], &lines[rows], (height - rows) * sizeof(lines[0]));
+            memset(&lines[height - rows], 0, rows * sizeof(lines[0]));
+            self->dirty_rows[plane] = ~0ULL;
+        }
+    }
 }
 
 void
-Renderer_deinit(Renderer* self)
+Renderer_scroll_right(Renderer* self)
 {
     if(!self->valid)
     {
-        fputs("Warning: deinitialize invalid Renderer", stderr);
+        return;
     }
 
-    if(self->window)
+    const i32 height = Renderer_Frame_rows(self->display);
+
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
     {
-        if(self->sdl_renderer)
+        if(self->planes & (1 << plane))
         {
-            //Destroy the renderer created above
-            SDL_DestroyRenderer(self->sdl_renderer);
+            for(int row = 0; row < height; ++row)
+            {
+                Renderer__shift_right_4__(self->display->planes[plane][row]);
+
+                // lores rows are one word, what left it is off screen
+                if(!self->display->hires)
+                {
+                    self->display->planes[plane][row][1] = 0;
+                }
+            }
+            self->dirty_rows[plane] = ~0ULL;
         }
+    }
+}
+
+void
+Renderer_scroll_left(Renderer* self)
+{
+    if(!self->valid)
+    {
+        return;
+    }
+
+    const i32 height = Renderer_Frame_rows(self->display);
+
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        if(self->planes & (1 << plane))
+        {
+            for(int row = 0; row < height; ++row)
+            {
+                Renderer__shift_left_4__(self->display->planes[plane][row]);
+            }
+            self->dirty_rows[plane] = ~0ULL;
+        }
+    }
+}
+
+void
+Renderer_clear(Renderer* self)
+{
+    if(!self->valid)
+    {
+        return;
+    }
 
-        // Close and destroy the window
-        SDL_DestroyWindow(self->window);
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        if(self->planes & (1 << plane))
+        {
+            memset(self->display->planes[plane], 0, sizeof(self->display->planes[plane]));
+            self->dirty_rows[plane] = ~0ULL;
+        }
+    }
+}
+
+void
+Renderer_load_display(Renderer* self, const Renderer_Frame* display, u8 planes)
+{
+    memcpy(self->display, display, sizeof(Renderer_Frame));
+    self->planes = planes;
+    memset(self->dirty_rows, 0xFF, sizeof(self->dirty_rows));
+}
+
+u64
+Renderer_hash(Renderer* self)
+{
+    u64 hash = 0;
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        for(u64 dirty = self->dirty_rows[plane]; dirty; dirty &= dirty - 1)
+        {
+            const u32 row = __builtin_ctzll(dirty);
+            const u64 row_hash = Renderer__hash_row__(self->display, plane, row);
+            self->hashes[plane] ^= self->row_hashes[plane][row] ^ row_hash;
+            self->row_hashes[plane][row] = row_hash;
+        }
+        self->dirty_rows[plane] = 0;
+
+        hash ^= self->hashes[plane];
+    }
+
+    const u8 mode[] = { self->display->hires, self->planes };
+    return Hash_bytes(hash, mode, sizeof(mode));
+}
+
+u64
+Renderer_hash_full(const Renderer* self)
+{
+    u64 hash = 0;
+    for(int plane = 0; plane < CANVAS_PLANES; ++plane)
+    {
+        for(u32 row = 0; row < CANVAS_HIRES_ROWS; ++row)
+        {
+            hash ^= Renderer__hash_row__(self->display, plane, row);
+        }
+    }
+
+    const u8 mode[] = { self->display->hires, self->planes };
+    return Hash_bytes(hash, mode, sizeof(mode));
+}
+
+void
+Renderer_deinit(Renderer* self)
+{
+    if(!self->valid)
+    {
+        fputs("Warning: deinitialize invalid Renderer", stderr);
     }
 
     if(self->display)
@@ -168,15 +371,73 @@ Renderer_deinit(Renderer* self)
         free(self->display);
     }
 
+    TripleBuffer_deconstruct(&self->frames);
+
     self->valid = false;
 }
 
 
 // Private functions
-static u64 __time_ms__(void)
+u64
+Renderer__hash_row__(const Renderer_Frame* frame, int plane, u32 row)
 {
-    struct timeval tv;
+    u64 hash = 0;
+    for(u32 word = 0; word < CANVAS_WORDS; ++word)
+    {
+        hash ^= Hash_key(((u64)plane << 8) | (row << 1) | word, frame->planes[plane][row][word]);
+    }
+
+    return hash;
+}
+
+// puts the `width` bits of a sprite row at column `pos_x` of a display row
+void
+Renderer__place__(u32 bits, u32 width, u32 pos_x, i32 cols, bool wrap, u64 placed[CANVAS_WORDS])
+{
+    const u64 aligned = (u64)bits << (64 - width);
+
+    placed[0] = pos_x < 64 ? aligned >> pos_x : 0;
+    placed[1] = pos_x == 0 ? 0 : pos_x < 64 ? aligned << (64 - pos_x) : aligned >> (pos_x - 64);
+
+    // lores rows are one word
+    if(cols == CANVAS_COLS)
+    {
+        placed[1] = 0;
+    }
 
-    gettimeofday(&tv, NULL);
-    return (((u64)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
+    // the pixels past the right edge come back on the left
+    if(wrap && pos_x + width > (u32)cols)
+    {
+        u32 spill = pos_x + width - cols;
+        placed[0] |= (u64)(bits & ((1u << spill) - 1)) << (64 - spill);
+    }
+}
+
+// the two words of a row are shifted as one 128-bit value
+void
+Renderer__shift_right_4__(u64 row[CANVAS_WORDS])
+{
+#ifdef __SSE2__
+    __m128i value = _mm_loadu_si128((const __m128i*)row);
+    // the low bits of the first word enter the second word from the top
+    __m128i carry = _mm_slli_si128(_mm_slli_epi64(value, 60), 8);
+    _mm_storeu_si128((__m128i*)row, _mm_or_si128(_mm_srli_epi64(value, 4), carry));
+#else
+    row[1] = (row[1] >> 4) | (row[0] << 60);
+    row[0] >>= 4;
+#endif
+}
+
+void
+Renderer__shift_left_4__(u64 row[CANVAS_WORDS])
+{
+#ifdef __SSE2__
+    __m128i value = _mm_loadu_si128((const __m128i*)row);
+    // the high bits of the second word enter the first word from the bottom
+    __m128i carry = _mm_srli_si128(_mm_srli_epi64(value, 60), 8);
+    _mm_storeu_si128((__m128i*)row, _mm_or_si128(_mm_slli_epi64(value, 4), carry));
+#else
+    row[0] = (row[0] << 4) | (row[1] >> 60);
+    row[1] <<= 4;
+#endif
 }
\ No newline at end of file
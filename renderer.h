@@ -2,35 +2,115 @@
 #define RENDERER_H
 
 #include "utils/type_alias.h"
+#include "utils/triple_buffer.h"
+#include "renderer_frame.h"
+#include "display.h"
+#include "framesink.h"
+#include "frameserver.h"
 // #include "result.h"
 
 #include <stdbool.h>
+#include <stdatomic.h>
 
+#define RENDERER_SPRITE_MAX_BYTES   (CANVAS_PLANES * 32)    // a 16x16 sprite for each plane
+
+// The display of one machine: the cpu draws into it, Renderer_publish hands
+// a copy to the window (a tile of a Display), the sink and the stream
 typedef struct
 {
-    i32 width;
-    i32 height;
-    i32 scale;
-    u8* display;
-    void* window;
-    void* sdl_renderer;
+    Renderer_Frame* display;    // drawn by the cpu
+    u8 planes;                  // mask of the planes drawn, cleared and scrolled (XO-CHIP)
+    // display hash (see utils/hash.h): the draws only mark their rows dirty,
+    // Renderer_hash rehashes the dirty rows
+    u64 hashes[CANVAS_PLANES];
+    u64 row_hashes[CANVAS_PLANES][CANVAS_HIRES_ROWS];
+    u64 dirty_rows[CANVAS_PLANES];  // one bit per row
+    TripleBuffer frames;    // Renderer_Frame slots, emulation thread -> render thread
+    Display* output;        // optional, shows the published frames in `tile`
+    u32 tile;
+    FrameSink* sink;        // optional, gets every published frame
+    FrameServer* server;    // optional, streams every published frame
     // bool is_running;
     bool valid;
 } Renderer;
 
+/// the display only, without a Display (Renderer_set_display) the
+/// published frames only go to the sink and the stream
 Renderer
-Renderer_init(i32 scale);
+Renderer_init(void);
+
+/// every published frame is shown in `tile` of `display`, before
+/// Display_start, `self` should not move after that
+/// @return: false if the tile doesn't exist or the display is started
+bool
+Renderer_set_display(Renderer* self, Display* display, u32 tile);
+
+/// every published frame is also pushed to `sink`, NULL to detach
+void
+Renderer_set_sink(Renderer* self, FrameSink* sink);
+
+/// every published frame is also streamed by `server`, NULL to detach
+void
+Renderer_set_server(Renderer* self, FrameServer* server);
+
+/// copies the display into a frame and hands it to the render thread,
+/// it never waits for the presentation
+void
+Renderer_publish(Renderer* self);
+
+/// a frame that isn't shown (fast-forward): only the sink gets it, the
+/// window and the stream wait for the next published one
+void
+Renderer_skip(Renderer* self);
+
+/// switches between 64x32 and 128x64, the display is cleared
+void
+Renderer_set_hires(Renderer* self, bool hires);
 
+/// @param: planes: mask of the planes the next draws, clears and scrolls apply to
 void
-Renderer_render(Renderer* self);
+Renderer_select_planes(Renderer* self, u8 planes);
 
+/// XORs a sprite into the selected planes, every selected plane takes the
+/// next `height` rows (or 16 rows of 2 bytes if `wide`) of `sprite`
+/// @param: wrap: pixels past the edges wrap around instead of being clipped,
+///               the start position always wraps
+/// @return: true if any pixel was erased
 bool
-Renderer_toggle_pixel(Renderer* self, u32 pos_x, u32 pos_y);
+Renderer_draw_sprite(Renderer* self, const u8* sprite, u8 height, bool wide, u32 pos_x, u32 pos_y, bool wrap);
+
+/// replaces the display and the selected planes, e.g. with a saved state
+void
+Renderer_load_display(Renderer* self, const Renderer_Frame* display, u8 planes);
+
+/// hash of the display and the selected planes, rehashes at most the rows
+/// changed since the last call
+u64
+Renderer_hash(Renderer* self);
+
+/// the same hash computed from the whole display, to check Renderer_hash
+u64
+Renderer_hash_full(const Renderer* self);
+
+void
+Renderer_scroll_down(Renderer* self, u8 rows);
+
+void
+Renderer_scroll_up(Renderer* self, u8 rows);
+
+/// scrolls 4 pixels to the right
+void
+Renderer_scroll_right(Renderer* self);
+
+/// scrolls 4 pixels to the left
+void
+Renderer_scroll_left(Renderer* self);
 
+/// clears the selected planes
 void
 Renderer_clear(Renderer* self);
 
 void
 Renderer_deinit(Renderer* self);
 
-#endif // RENDERER_H
\ No newline at end of file
+#endif // RENDERER_H
@@ -0,0 +1,36 @@
+#ifndef RENDERER_FRAME_H
+#define RENDERER_FRAME_H
+
+#include "utils/type_alias.h"
+
+#include <stdbool.h>
+
+#define CANVAS_COLS         64      // lores, CHIP-8
+#define CANVAS_ROWS         32
+#define CANVAS_HIRES_COLS   128     // SUPER-CHIP/XO-CHIP hires
+#define CANVAS_HIRES_ROWS   64
+#define CANVAS_WORDS        2       // u64 per row, enough for a hires row
+#define CANVAS_PLANES       2       // XO-CHIP bit planes
+
+// One bit per pixel and per plane, the most significant bit of the first
+// word is column 0. In lores only the first 32 rows and the first word of
+// each row are used, the rest stays zero.
+typedef struct
+{
+    u64 planes[CANVAS_PLANES][CANVAS_HIRES_ROWS][CANVAS_WORDS];
+    bool hires;
+} Renderer_Frame;
+
+static inline i32
+Renderer_Frame_cols(const Renderer_Frame* frame)
+{
+    return frame->hires ? CANVAS_HIRES_COLS : CANVAS_COLS;
+}
+
+static inline i32
+Renderer_Frame_rows(const Renderer_Frame* frame)
+{
+    return frame->hires ? CANVAS_HIRES_ROWS : CANVAS_ROWS;
+}
+
+#endif // RENDERER_FRAME_H
@@ -0,0 +1,102 @@
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REPLAY_LINE_SIZE    256
+
+Replay
+Replay_load(const char* path)
+{
+    Replay replay = {};
+
+    FILE* file = fopen(path, "r");
+    if(!file)
+    {
+        fprintf(stderr, "Error: Replay: couldn't open %s\n", path);
+        replay.valid = false;
+        return replay;
+    }
+
+    size_t capacity = 0;
+    char line[REPLAY_LINE_SIZE];
+    for(u32 line_number = 1; fgets(line, sizeof(line), file); line_number++)
+    {
+        unsigned long long frame;
+        unsigned int keys;
+        char first;
+
+        // blank lines and comments
+        if(sscanf(line, " %c", &first) != 1 || first == '#')
+        {
+            continue;
+        }
+
+        if(sscanf(line, "%llu %x", &frame, &keys) != 2 || keys > 0xFFFF ||
+           (replay.events_count > 0 && frame < replay.events[replay.events_count - 1].frame))
+        {
+            fprintf(stderr, "Error: Replay: %s:%u: expected `<frame> <keys>` with the frames going up\n", path, line_number);
+            fclose(file);
+            free(replay.events);
+            replay.events = NULL;
+            replay.valid = false;
+            return replay;
+        }
+
+        if(replay.events_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            Replay_Event* events = realloc(replay.events, capacity * sizeof(Replay_Event));
+            if(!events)
+            {
+                fclose(file);
+                free(replay.events);
+                replay.events = NULL;
+                replay.valid = false;
+                return replay;
+            }
+            replay.events = events;
+        }
+
+        replay.events[replay.events_count++] = (Replay_Event) { frame, (u16)keys };
+    }
+
+    fclose(file);
+
+    replay.next = 0;
+    replay.keys = 0;
+    replay.valid = true;
+    return replay;
+}
+
+u16
+Replay_keys(Replay* self, u64 frame)
+{
+    while(self->next < self->events_count && self->events[self->next].frame <= frame)
+    {
+        self->keys = self->events[self->next].keys;
+        self->next++;
+    }
+
+    return self->keys;
+}
+
+void
+Replay_rewind(Replay* self)
+{
+    self->next = 0;
+    self->keys = 0;
+}
+
+void
+Replay_deinit(Replay* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    free(self->events);
+    self->events = NULL;
+    self->valid = false;
+}
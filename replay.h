@@ -0,0 +1,43 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "utils/type_alias.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A recorded keypad input: the keys held during each frame.
+// The file is text, one change per line, `<frame> <keys>` where keys is the
+// 16-bit mask of the held keys in hex (bit n is the key n), the keys stay
+// held until the next line. Frames go up, `#` starts a comment, e.g.
+//     # press 5 for a second
+//     60  0020
+//     120 0000
+typedef struct {
+    u64 frame;
+    u16 keys;
+} Replay_Event;
+
+typedef struct {
+    Replay_Event* events;   // sorted by frame
+    size_t events_count;
+    size_t next;            // first event not applied yet
+    u16 keys;
+    bool valid;
+} Replay;
+
+Replay
+Replay_load(const char* path);
+
+/// the keys held during `frame`, frames are asked in order
+u16
+Replay_keys(Replay* self, u64 frame);
+
+/// back to frame 0
+void
+Replay_rewind(Replay* self);
+
+void
+Replay_deinit(Replay* self);
+
+#endif // REPLAY_H
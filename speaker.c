@@ -1,49 +1,150 @@
 #include "speaker.h"
+#include "utils/clock.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_audio.h>
 
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
-// This callback will play a square wave
+// Copies the queued samples out, silence when they run short
 static void
 Speaker__callback__(void* userdata, u8* stream, int len);
 
+static void
+Speaker__change__(Speaker* self, bool on, f32 at);
+
+static bool
+Speaker__track_resize__(Speaker__Track__* track, f64 frame_samples);
+
+static u32
+Speaker__render__(const Speaker* self, Speaker__Track__* track);
+
+static int
+Speaker__warmup__(void* arg);
+
+static bool
+Speaker__open__(Speaker* self);
+
+static void
+Speaker__write_wav_header__(Speaker* self, u32 data_size);
+
+static void
+Speaker__put__(u8* at, u32 value, u32 bytes);
+
 Speaker
-Speaker_init()
+Speaker_init(u32 buffer, u32 fps)
 {
     Speaker speaker = {};
 
-    if(SDL_Init(SDL_INIT_AUDIO) != 0)
+    speaker.buffer = buffer ? buffer : AUDIO_BUFFER;
+    speaker.fps = fps;
+
+    // a second of samples, far more than the queue is let to grow
+    speaker.ring = Ring_construct(AUDIO_RATE);
+    if(!speaker.ring.valid)
     {
-        fputs(SDL_GetError(), stderr);
-        SDL_ClearError();
         speaker.valid = false;
         return speaker;
     }
 
     /* a general specification */
-    speaker.specs.freq = 44100;
-    speaker.specs.format = AUDIO_S16;
+    speaker.specs.freq = AUDIO_RATE;
+    speaker.specs.format = AUDIO_S16SYS;
     speaker.specs.channels = 1; /* 1, 2, 4, or 6 */
-    speaker.specs.samples = 2048; /* power of 2, or 0 and env SDL_AUDIO_SAMPLES is used */
+    speaker.specs.samples = (u16)speaker.buffer;
     speaker.specs.callback = Speaker__callback__; /* can not be NULL */
 
     speaker.valid = true;
-    speaker.sample_pos = 0;
-    speaker.freq = AUDIO_FREQ;
     speaker.dev_id = 0;
+    speaker.freq = AUDIO_FREQ;
     speaker.amplitude = AUDIO_AMPLITUDE;
     speaker.is_playing = false;
+    atomic_init(&speaker.underruns, 0);
+    atomic_init(&speaker.missing, 0);
+    atomic_init(&speaker.depth_max, 0);
+    atomic_init(&speaker.ready_ns, 0);
+    atomic_init(&speaker.failed, false);
+
+    if(!Speaker__track_resize__(&speaker.device, (f64)AUDIO_RATE / fps))
+    {
+        Ring_deconstruct(&speaker.ring);
+        speaker.valid = false;
+    }
+
+    return speaker;
+}
+
+Speaker
+Speaker_init_silent()
+{
+    Speaker speaker = {};
+
+    speaker.freq = AUDIO_FREQ;
+    speaker.amplitude = AUDIO_AMPLITUDE;
+    speaker.silent = true;
+    speaker.valid = true;
 
     return speaker;
 }
 
+bool
+Speaker_start(Speaker* self)
+{
+    if(!self || !self->valid || self->silent)
+    {
+        return self && self->valid;
+    }
+
+    self->warmup = SDL_CreateThread(Speaker__warmup__, "audio warmup", self);
+    if(!self->warmup)
+    {
+        fputs(SDL_GetError(), stderr);
+        atomic_store(&self->failed, true);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+Speaker_record(Speaker* self, const char* path, u32 fps)
+{
+    if(!self || !self->valid || self->wav || fps == 0)
+    {
+        return false;
+    }
+
+    if(!Speaker__track_resize__(&self->wav_track, (f64)AUDIO_RATE / fps))
+    {
+        return false;
+    }
+
+    self->wav = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if(!self->wav)
+    {
+        fprintf(stderr, "Error: Speaker: couldn't open %s\n", path);
+        return false;
+    }
+
+    self->wav_buffer = malloc(SPEAKER_WAV_BUFFER);
+    if(self->wav_buffer)
+    {
+        setvbuf(self->wav, (char*)self->wav_buffer, _IOFBF, SPEAKER_WAV_BUFFER);
+    }
+
+    // the sizes are written again once known
+    Speaker__write_wav_header__(self, UINT32_MAX - 36);
+    self->wav_samples = 0;
+    return true;
+}
+
 void
-Speaker_play(Speaker* self, f64 freq, i32 amplitude)
+Speaker_play(Speaker* self, f64 freq, i32 amplitude, f32 at)
 {
-    if(!self || !self->valid)
+    if(!self || !self->valid || (self->silent && !self->wav))
     {
         return;
     }
@@ -51,48 +152,168 @@ Speaker_play(Speaker* self, f64 freq, i32 amplitude)
     if(freq == 0) freq = AUDIO_FREQ;
     if(amplitude < 0) amplitude = AUDIO_AMPLITUDE;
 
-    SDL_AudioSpec have;
-
     self->freq = freq;
     self->amplitude = amplitude;
-    self->specs.userdata = self;
+    Speaker__change__(self, true, at);
+}
 
-    if(self->dev_id == 0)
+void
+Speaker_stop(Speaker* self, f32 at)
+{
+    if(!self || !self->valid || (self->silent && !self->wav))
     {
-        self->dev_id = SDL_OpenAudioDevice(NULL, 0, &self->specs, &have, SDL_AUDIO_ALLOW_ANY_CHANGE);
+        return;
     }
 
-    if(self->dev_id == 0)
+    Speaker__change__(self, false, at);
+}
+
+void
+Speaker_end_frame(Speaker* self)
+{
+    if(!self || !self->valid || (self->silent && !self->wav))
     {
-        fputs(SDL_GetError(), stderr);
-        self->valid = false;
+        return;
     }
 
-    self->is_playing = true;
-    SDL_PauseAudioDevice(self->dev_id, 0); /* play! */
+    if(self->wav)
+    {
+        const u32 count = Speaker__render__(self, &self->wav_track);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for(u32 iii = 0; iii < count; iii++)
+        {
+            self->wav_track.samples[iii] = (i16)__builtin_bswap16((u16)self->wav_track.samples[iii]);
+        }
+#endif
+        self->wav_samples += fwrite(self->wav_track.samples, sizeof(i16), count, self->wav);
+    }
+
+    bool sounds = self->is_playing;
+    for(u32 iii = 0; iii < self->changes_count; iii++)
+    {
+        sounds |= self->changes[iii].on;
+    }
+
+    // the device only opens with the first tone, then keeps running
+    if(!self->silent && !self->muted && (self->started || sounds) &&
+       (self->started || Speaker__open__(self)))
+    {
+        const u32 count = Speaker__render__(self, &self->device);
+
+        // past the limit the queue only adds latency, the rest of the frame
+        // is dropped instead
+        const u32 depth = Ring_count(&self->ring);
+        const u32 limit = self->buffer + (u32)(AUDIO_FRAMES_QUEUED * self->device.frame_samples);
+        const u32 room = depth < limit ? limit - depth : 0;
+        const u32 pushed = Ring_push(&self->ring, self->device.samples, count < room ? count : room);
+
+        self->dropped += count - pushed;
+        self->frames++;
+    }
+
+    if(self->changes_count)
+    {
+        self->is_playing = self->changes[self->changes_count - 1].on;
+        self->changes_count = 0;
+    }
 }
 
 void
-Speaker_stop(Speaker* self)
+Speaker_set_speed(Speaker* self, f64 speed)
 {
-    if(!self || !self->valid)
+    if(!self || !self->valid || self->silent || speed <= 0 || isinf(speed))
     {
         return;
     }
 
-    if(!self->is_playing)
+    // one frame never takes more than half the ring
+    f64 samples = (f64)AUDIO_RATE / (self->fps * speed);
+    if(samples > (self->ring.mask + 1) / 2)
+    {
+        samples = (self->ring.mask + 1) / 2;
+    }
+
+    if(!Speaker__track_resize__(&self->device, samples))
+    {
+        fputs("Error: Speaker: no memory for the frame samples\n", stderr);
+    }
+}
+
+void
+Speaker_mute(Speaker* self, bool muted)
+{
+    if(!self || !self->valid || self->silent || self->muted == muted)
     {
         return;
     }
 
-    if(self->dev_id == 0)
+    // what was queued is stale by the time the sound comes back
+    if(muted && self->started)
+    {
+        SDL_PauseAudioDevice(self->dev_id, 1);
+        Ring_clear(&self->ring);
+        self->started = false;
+    }
+
+    self->muted = muted;
+}
+
+Speaker_Stats
+Speaker_stats(Speaker* self)
+{
+    Speaker_Stats stats = {};
+
+    if(!self || !self->valid)
+    {
+        return stats;
+    }
+
+    stats.wav_samples = self->wav_samples;
+    if(self->silent)
+    {
+        return stats;
+    }
+
+    stats.frames = self->frames;
+    stats.underruns = atomic_load(&self->underruns);
+    stats.missing = atomic_load(&self->missing);
+    stats.dropped = self->dropped;
+    stats.depth = Ring_count(&self->ring);
+    stats.depth_max = atomic_load(&self->depth_max);
+
+    return stats;
+}
+
+void
+Speaker_print_stats(Speaker* self, FILE* out)
+{
+    if(!self)
     {
-        fputs("Error: Audio: cannot stop a null device\n", stderr);
         return;
     }
 
-    self->is_playing = false;
-    SDL_PauseAudioDevice(self->dev_id, 1); /* stop! */
+    const Speaker_Stats stats = Speaker_stats(self);
+    if(stats.frames)
+    {
+        fprintf(out,
+            "audio: %llu frames, %llu underruns (%llu samples of silence), %llu samples dropped, queue %u samples, at most %u (%.1f ms)\n",
+            (unsigned long long)stats.frames,
+            (unsigned long long)stats.underruns,
+            (unsigned long long)stats.missing,
+            (unsigned long long)stats.dropped,
+            stats.depth,
+            stats.depth_max,
+            stats.depth_max * 1000.0 / AUDIO_RATE
+        );
+    }
+
+    if(self->wav)
+    {
+        fprintf(out, "wav: %llu samples (%.3f s)\n",
+            (unsigned long long)stats.wav_samples,
+            (f64)stats.wav_samples / AUDIO_RATE
+        );
+    }
 }
 
 void
@@ -103,23 +324,241 @@ Speaker_deinit(Speaker* self)
         return;
     }
 
+    if(self->warmup)
+    {
+        SDL_WaitThread(self->warmup, NULL);
+        self->warmup = NULL;
+    }
+
     if(self->dev_id != 0)
     {
         SDL_CloseAudioDevice(self->dev_id);
+        self->dev_id = 0;
     }
+
+    if(self->wav)
+    {
+        if(self->wav == stdout)
+        {
+            fflush(self->wav);
+            setvbuf(self->wav, NULL, _IOLBF, 0);
+        }
+        else
+        {
+            // past 4 GB the sizes stay unknown
+            const u64 data_size = self->wav_samples * sizeof(i16);
+            if(data_size <= UINT32_MAX - 36 && fseek(self->wav, 0, SEEK_SET) == 0)
+            {
+                Speaker__write_wav_header__(self, (u32)data_size);
+            }
+            fclose(self->wav);
+        }
+    }
+
+    Ring_deconstruct(&self->ring);
+    free(self->device.samples);
+    free(self->wav_track.samples);
+    free(self->wav_buffer);
+    self->device.samples = NULL;
+    self->wav_track.samples = NULL;
+    self->wav_buffer = NULL;
+    self->wav = NULL;
+    self->valid = false;
 }
 
+
+// Private functions
 void
 Speaker__callback__(void* userdata, u8* stream, int len)
 {
-    Speaker *speaker = (Speaker *)userdata;
+    Speaker* speaker = (Speaker*)userdata;
+
+    i16* samples = (i16*)stream;
+    const u32 count = (u32)len / sizeof(i16);
+
+    const u32 depth = Ring_count(&speaker->ring);
+    if(depth > atomic_load_explicit(&speaker->depth_max, memory_order_relaxed))
+    {
+        atomic_store_explicit(&speaker->depth_max, depth, memory_order_relaxed);
+    }
+
+    const u32 got = Ring_pop(&speaker->ring, samples, count);
+    if(got < count)
+    {
+        memset(&samples[got], 0, (count - got) * sizeof(i16));
+        atomic_fetch_add_explicit(&speaker->underruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&speaker->missing, count - got, memory_order_relaxed);
+    }
+}
+
+// the changes stay in order, and one that changes nothing isn't kept
+void
+Speaker__change__(Speaker* self, bool on, f32 at)
+{
+    const bool current = self->changes_count ? self->changes[self->changes_count - 1].on : self->is_playing;
+    if(on == current)
+    {
+        return;
+    }
+
+    if(at < 0) at = 0;
+    if(at > 1) at = 1;
+    if(self->changes_count && at < self->changes[self->changes_count - 1].at)
+    {
+        at = self->changes[self->changes_count - 1].at;
+    }
+
+    // too many in one frame: they alternate, so dropping the last one
+    // leaves the tone as asked, just earlier
+    if(self->changes_count == SPEAKER_MAX_CHANGES)
+    {
+        self->changes_count--;
+        return;
+    }
+
+    self->changes[self->changes_count++] = (Speaker__Change__){ .on = on, .at = at };
+}
+
+bool
+Speaker__track_resize__(Speaker__Track__* track, f64 frame_samples)
+{
+    const u32 capacity = (u32)frame_samples + 1;
+    if(capacity > track->capacity)
+    {
+        i16* samples = realloc(track->samples, capacity * sizeof(i16));
+        if(!samples)
+        {
+            return false;
+        }
+        track->samples = samples;
+        track->capacity = capacity;
+    }
 
-    i16 *buffer = (i16*)stream;
-    len = len / 2; // 2 bytes per sample for AUDIO_S16SYS
+    track->frame_samples = frame_samples;
+    track->remainder = 0;
+    return true;
+}
 
-    for(int iii = 0; iii < len; iii++, speaker->sample_pos++)
+// the frame from the tone at its start and its changes, the fractions of a
+// sample add up so the frames average frame_samples
+u32
+Speaker__render__(const Speaker* self, Speaker__Track__* track)
+{
+    const f64 length = track->frame_samples + track->remainder;
+    const u32 count = (u32)length;
+    track->remainder = length - count;
+
+    const f64 step = self->freq / AUDIO_RATE;
+    bool on = self->is_playing;
+    u32 change = 0;
+    for(u32 iii = 0; iii < count; iii++)
     {
-        double time = (f64)speaker->sample_pos / (f64)speaker->specs.freq;
-        ((i16*)stream)[iii] = (i16)(speaker->amplitude * sin(2.0f * M_PI * speaker->freq * time));
+        while(change < self->changes_count && self->changes[change].at * count <= iii)
+        {
+            on = self->changes[change++].on;
+        }
+
+        // every beep starts from a zero crossing
+        if(!on)
+        {
+            track->phase = 0;
+            track->samples[iii] = 0;
+            continue;
+        }
+
+        track->samples[iii] = (i16)(self->amplitude * sin(2.0 * M_PI * track->phase));
+        track->phase += step;
+        if(track->phase >= 1.0) track->phase -= 1.0;
+    }
+
+    return count;
+}
+
+// the audio subsystem and the device take a while to open, the emulation
+// doesn't wait for them
+int
+Speaker__warmup__(void* arg)
+{
+    Speaker* self = arg;
+
+    if(SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+    {
+        fputs(SDL_GetError(), stderr);
+        atomic_store(&self->failed, true);
+        return -1;
+    }
+
+    // opened paused. SDL converts to whatever the device wants, the queue is
+    // always AUDIO_RATE mono
+    self->specs.userdata = self;
+    self->dev_id = SDL_OpenAudioDevice(NULL, 0, &self->specs, NULL, 0);
+    if(self->dev_id == 0)
+    {
+        fputs(SDL_GetError(), stderr);
+        atomic_store(&self->failed, true);
+        return -1;
     }
-}
\ No newline at end of file
+
+    atomic_store(&self->ready_ns, Clock_now_ns());
+    return 0;
+}
+
+// a tone before the device is ready waits for it a frame at a time. Started
+// with a buffer of silence queued, so the first callbacks don't run short
+// before the next frame comes
+bool
+Speaker__open__(Speaker* self)
+{
+    if(atomic_load(&self->ready_ns) == 0)
+    {
+        if(atomic_load(&self->failed))
+        {
+            self->silent = true;
+        }
+        return false;
+    }
+
+    Speaker__Track__* track = &self->device;
+    Ring_clear(&self->ring);
+    memset(track->samples, 0, track->capacity * sizeof(i16));
+    for(u32 iii = 0; iii < self->buffer; iii += track->capacity)
+    {
+        const u32 left = self->buffer - iii;
+        Ring_push(&self->ring, track->samples, left < track->capacity ? left : track->capacity);
+    }
+
+    self->started = true;
+    SDL_PauseAudioDevice(self->dev_id, 0); /* play! */
+    return true;
+}
+
+// RIFF/WAVE, one PCM chunk, everything little endian
+void
+Speaker__write_wav_header__(Speaker* self, u32 data_size)
+{
+    u8 header[44];
+
+    memcpy(&header[0], "RIFF", 4);
+    Speaker__put__(&header[4], 36 + data_size, 4);  // after "RIFF" and this size
+    memcpy(&header[8], "WAVEfmt ", 8);
+    Speaker__put__(&header[16], 16, 4);             // size of "fmt "
+    Speaker__put__(&header[20], 1, 2);              // PCM
+    Speaker__put__(&header[22], 1, 2);              // mono
+    Speaker__put__(&header[24], AUDIO_RATE, 4);
+    Speaker__put__(&header[28], AUDIO_RATE * sizeof(i16), 4);  // bytes per second
+    Speaker__put__(&header[32], sizeof(i16), 2);    // bytes per sample
+    Speaker__put__(&header[34], 16, 2);             // bits per sample
+    memcpy(&header[36], "data", 4);
+    Speaker__put__(&header[40], data_size, 4);
+
+    fwrite(header, 1, sizeof(header), self->wav);
+}
+
+void
+Speaker__put__(u8* at, u32 value, u32 bytes)
+{
+    for(u32 iii = 0; iii < bytes; iii++)
+    {
+        at[iii] = (u8)(value >> (8 * iii));
+    }
+}
@@ -2,37 +2,145 @@
 #define SPEAKER_H
 
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdio.h>
 
 #include "utils/type_alias.h"
+#include "utils/ring.h"
 
 #include <SDL2/SDL.h>
 
 #define AUDIO_AMPLITUDE     INT16_MAX
 #define AUDIO_FREQ          441.0
+#define AUDIO_RATE          44100
+#define AUDIO_BUFFER        512     // samples asked by the device at once, by default
+#define AUDIO_FRAMES_QUEUED 3       // past that many frames ahead, samples are dropped
+#define SPEAKER_MAX_CHANGES 8       // tone switches within one frame, the last ones merge
+#define SPEAKER_WAV_BUFFER  (1 << 16)
 
+typedef struct {
+    bool on;
+    f32 at;                 // 0 to 1 into the frame
+} Speaker__Change__;
+
+// one rendering of the tone, with its own frame length and phase
+typedef struct {
+    i16* samples;           // the samples of one frame
+    u32 capacity;
+    f64 frame_samples;      // per emulated frame
+    f64 remainder;          // the fraction of a sample left by the last frame
+    f64 phase;              // of the tone, from 0 to 1
+} Speaker__Track__;
+
+typedef struct {
+    u64 frames;             // rendered into the queue
+    u64 wav_samples;        // written to the WAV file
+    u64 underruns;          // callbacks that found the queue short
+    u64 missing;            // samples played as silence because of them
+    u64 dropped;            // samples that didn't fit, the queue ran ahead
+    u32 depth;              // samples queued now
+    u32 depth_max;          // the most seen by a callback
+} Speaker_Stats;
+
+// The emulation thread renders the tone of every frame into a ring of
+// samples (Speaker_end_frame) and the audio callback only copies them out,
+// so the tone starts and stops on the sample where the sound timer did,
+// and the latency is the device buffer plus about one frame. The callback
+// reads nothing else from the speaker but the ring and its counters.
+//
+// Speaker_record also writes every frame to a WAV file, rendered apart with
+// exactly 1 / fps s per emulated frame whatever the speed, muted or not: the
+// same run always gives the same file, and headless it runs as fast as the
+// emulation.
 typedef struct {
     bool valid;
     u16 dev_id;
     SDL_AudioSpec specs;
-    u32 sample_pos;
+    u32 buffer;             // samples per callback
+    u32 fps;
+    Ring ring;              // producer: Speaker_end_frame, consumer: the callback
+    Speaker__Track__ device;    // more samples per frame when slowed down
     f64 freq;
     i32 amplitude;
-    bool is_playing;
+    bool is_playing;        // at the start of the frame being rendered
+    Speaker__Change__ changes[SPEAKER_MAX_CHANGES];
+    u32 changes_count;
+    void* warmup;           // SDL_Thread opening the device
+    _Atomic u64 ready_ns;   // Clock_now_ns once the device is open, paused, 0 before
+    atomic_bool failed;     // no device after all
+    bool started;           // the device is running
+    bool silent;            // no audio device
+    bool muted;             // the device is paused, the WAV file goes on
+
+    FILE* wav;              // NULL unless recorded
+    u8* wav_buffer;
+    Speaker__Track__ wav_track;
+    u64 wav_samples;        // written
+
+    u64 frames;
+    u64 dropped;
+    _Atomic u64 underruns;  // written by the callback
+    _Atomic u64 missing;
+    _Atomic u32 depth_max;
 } Speaker;
 
+/// nothing is opened before Speaker_start
+/// @param: buffer: samples the device asks for at once, 0 for AUDIO_BUFFER
+/// @param: fps: emulated frames per second
+Speaker
+Speaker_init(u32 buffer, u32 fps);
+
+/// opens the audio subsystem and the device on a thread, the first tone
+/// waits for it (a frame at a time) instead of the startup, `self` should
+/// not move after that
+bool
+Speaker_start(Speaker* self);
+
+/// a valid speaker that never touches the audio device (headless runs)
 Speaker
-Speaker_init();
+Speaker_init_silent();
 
+/// also writes the sound to a 16-bit mono AUDIO_RATE WAV file, "-" for
+/// stdout (the sizes in the header are left unknown then), with the frames
+/// of `fps` emulated frames per second
+/// @return: false if it can't be opened
+bool
+Speaker_record(Speaker* self, const char* path, u32 fps);
 
+/// starts the tone `at` (0 to 1) into the frame being rendered
 /// @param: freq: if zero, it will be AUDIO_FREQ
 /// @param: amplitude: if it less than 0, it will be AUDIO_AMPLITUDE
 void
-Speaker_play(Speaker* self, f64 freq, i32 amplitude);
+Speaker_play(Speaker* self, f64 freq, i32 amplitude, f32 at);
+
+/// stops the tone `at` (0 to 1) into the frame being rendered
+void
+Speaker_stop(Speaker* self, f32 at);
+
+/// queues the samples of the frame (and writes them to the WAV file), the
+/// tone goes on into the next one. The device only runs from the first tone
+void
+Speaker_end_frame(Speaker* self);
+
+/// an emulated frame lasts 1 / (fps * speed) s: slowed down, the frames
+/// get more samples
+void
+Speaker_set_speed(Speaker* self, f64 speed);
+
+/// pauses the device until unmuted (fast-forward, debugger console), the
+/// WAV file still gets every frame
+void
+Speaker_mute(Speaker* self, bool muted);
+
+Speaker_Stats
+Speaker_stats(Speaker* self);
 
+/// underruns, drops and queue depth if the device ever played, and
+/// the length of the WAV file
 void
-Speaker_stop(Speaker* self);
+Speaker_print_stats(Speaker* self, FILE* out);
 
 void
 Speaker_deinit(Speaker* self);
 
-#endif // SPEAKER_H
\ No newline at end of file
+#endif // SPEAKER_H
@@ -0,0 +1,204 @@
+#include "stateexport.h"
+#include "keyboard.h"
+#include "renderer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// the offsets documented in the header are the layout
+_Static_assert(offsetof(StateExport_Layout, lock) == 16, "StateExport_Layout.lock moved");
+_Static_assert(offsetof(StateExport_Layout, registers) == 44, "StateExport_Layout.registers moved");
+_Static_assert(offsetof(StateExport_Layout, stack) == 60, "StateExport_Layout.stack moved");
+_Static_assert(offsetof(StateExport_Layout, paused) == 92, "StateExport_Layout.paused moved");
+_Static_assert(offsetof(StateExport_Layout, display) == 104, "StateExport_Layout.display moved");
+_Static_assert(sizeof(StateExport_Layout) == 2152, "StateExport_Layout changed size");
+
+static char*
+StateExport__name__(const char* name);
+
+static StateExport
+StateExport__map__(const char* name, bool owner);
+
+StateExport
+StateExport_create(const char* name)
+{
+    return StateExport__map__(name, true);
+}
+
+StateExport
+StateExport_open(const char* name)
+{
+    return StateExport__map__(name, false);
+}
+
+void
+StateExport_publish(StateExport* self, const Cpu* cpu, u64 frame)
+{
+    if(!self || !self->valid || !self->owner)
+    {
+        return;
+    }
+
+    StateExport_Layout* layout = self->layout;
+    const Renderer* renderer = cpu->renderer;
+
+    SeqLock_write_begin(&layout->lock);
+
+    layout->frame = frame;
+    layout->pc = cpu->pc;
+    layout->i = cpu->i;
+    layout->delay_timer = cpu->delay_timer;
+    layout->sound_timer = cpu->sound_timer;
+    layout->keys = Keyboard_keys(cpu->keyboard);
+    layout->mode = (u8)cpu->mode;
+
+    const Stack* stack = &cpu->stack;
+    layout->stack_depth = (u8)(stack->data + stack->size - stack->stack_ptr);
+    for(u8 iii = 0; iii < CPU_STACK_SIZE; iii++)
+    {
+        layout->stack[iii] = iii < layout->stack_depth ? (u16)stack->stack_ptr[iii] : 0;
+    }
+
+    memcpy(layout->registers, cpu->registers, sizeof(layout->registers));
+    layout->paused = cpu->paused;
+    layout->exited = cpu->exited;
+    layout->halted = cpu->halted;
+    layout->hires = renderer->display->hires;
+    layout->planes = renderer->planes;
+    memcpy(layout->display, renderer->display->planes, sizeof(layout->display));
+
+    SeqLock_write_end(&layout->lock);
+}
+
+void
+StateExport_snapshot(const StateExport* self, StateExport_Layout* snapshot)
+{
+    u64 sequence;
+    do
+    {
+        sequence = SeqLock_read_begin(&self->layout->lock);
+        memcpy(snapshot, self->layout, sizeof(StateExport_Layout));
+    }
+    while(SeqLock_read_retry(&self->layout->lock, sequence));
+}
+
+void
+StateExport_deinit(StateExport* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    if(self->layout)
+    {
+        munmap(self->layout, sizeof(StateExport_Layout));
+    }
+
+    if(self->fd >= 0)
+    {
+        close(self->fd);
+    }
+
+    if(self->owner && self->name)
+    {
+        shm_unlink(self->name);
+    }
+
+    free(self->name);
+
+    self->name = NULL;
+    self->fd = -1;
+    self->layout = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+char*
+StateExport__name__(const char* name)
+{
+    // shm_open wants one leading slash
+    char* shm_name = malloc(strlen(name) + 2);
+    if(shm_name)
+    {
+        sprintf(shm_name, "%s%s", name[0] == '/' ? "" : "/", name);
+    }
+
+    return shm_name;
+}
+
+StateExport
+StateExport__map__(const char* name, bool owner)
+{
+    StateExport self = {};
+    self.fd = -1;
+    self.owner = owner;
+
+    self.name = StateExport__name__(name);
+    if(!self.name)
+    {
+        self.valid = false;
+        return self;
+    }
+
+    if(owner)
+    {
+        shm_unlink(self.name);
+        self.fd = shm_open(self.name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    else
+    {
+        self.fd = shm_open(self.name, O_RDONLY, 0);
+    }
+
+    if(self.fd < 0 || (owner && ftruncate(self.fd, sizeof(StateExport_Layout)) < 0))
+    {
+        fprintf(stderr, "Error: StateExport: couldn't %s %s: %s\n", owner ? "create" : "open", self.name, strerror(errno));
+        StateExport_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+
+    void* memory = mmap(
+        NULL,
+        sizeof(StateExport_Layout),
+        owner ? PROT_READ | PROT_WRITE : PROT_READ,
+        MAP_SHARED,
+        self.fd,
+        0
+    );
+
+    if(memory == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: StateExport: couldn't map %s: %s\n", self.name, strerror(errno));
+        StateExport_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+    self.layout = memory;
+
+    if(owner)
+    {
+        // ftruncate zeroed it, the sequence starts even
+        self.layout->magic = STATEEXPORT_MAGIC;
+        self.layout->version = STATEEXPORT_VERSION;
+        self.layout->size = sizeof(StateExport_Layout);
+    }
+    else if(self.layout->magic != STATEEXPORT_MAGIC || self.layout->version < STATEEXPORT_VERSION)
+    {
+        fprintf(stderr, "Error: StateExport: %s isn't a chip8 state export\n", self.name);
+        StateExport_deinit(&self);
+        self.valid = false;
+        return self;
+    }
+
+    self.valid = true;
+    return self;
+}
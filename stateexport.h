@@ -0,0 +1,79 @@
+#ifndef STATEEXPORT_H
+#define STATEEXPORT_H
+
+#include "utils/type_alias.h"
+#include "utils/seqlock.h"
+#include "cpu.h"
+
+#include <stdbool.h>
+
+#define STATEEXPORT_MAGIC       0x54533843  // "C8ST"
+#define STATEEXPORT_VERSION     1
+
+// The shared memory region, in the byte order of the host. A new version
+// only adds fields at the end.
+//
+// The emulator rewrites it at the end of every frame inside the seqlock, a
+// reader copies it between SeqLock_read_begin and SeqLock_read_retry (see
+// StateExport_snapshot) and tries again if the copy may be torn. The
+// emulator never waits for the readers.
+typedef struct {
+    u32 magic;                  //    0: STATEEXPORT_MAGIC
+    u32 version;                //    4: STATEEXPORT_VERSION
+    u32 size;                   //    8: of the layout
+    u32 reserved;               //   12
+    SeqLock lock;               //   16: odd while a frame is written
+    u64 frame;                  //   24: frames run
+    u16 pc;                     //   32
+    u16 i;                      //   34
+    u16 delay_timer;            //   36
+    u16 sound_timer;            //   38
+    u16 keys;                   //   40: held keys, bit n is the key n
+    u8 mode;                    //   42: Cpu_Mode
+    u8 stack_depth;             //   43
+    u8 registers[16];           //   44: V0 to VF
+    u16 stack[CPU_STACK_SIZE];  //   60: return addresses, the top first
+    u8 paused;                  //   92: waiting for a key (Fx0A)
+    u8 exited;                  //   93
+    u8 halted;                  //   94
+    u8 hires;                   //   95
+    u8 planes;                  //   96: selected planes (XO-CHIP)
+    u8 reserved2[7];            //   97
+    // 104: one bit per pixel, see Renderer_Frame: [plane][row][word], the
+    // most significant bit of the first word is column 0. Lores only uses
+    // the first 32 rows and the first word of each
+    u64 display[CANVAS_PLANES][CANVAS_HIRES_ROWS][CANVAS_WORDS];
+} StateExport_Layout;           // 2152 bytes
+
+// A POSIX shared memory object (shm_open) holding a StateExport_Layout,
+// created by the emulator and opened read-only by the readers.
+typedef struct {
+    char* name;
+    int fd;
+    StateExport_Layout* layout;     // mapped
+    bool owner;             // created it, removes it on deinit
+    bool valid;
+} StateExport;
+
+/// creates the shared memory object `name` ("/chip8" or "chip8"), an old one
+/// with the same name is replaced
+StateExport
+StateExport_create(const char* name);
+
+/// writes the state of `cpu` after `frame` frames, once per frame
+void
+StateExport_publish(StateExport* self, const Cpu* cpu, u64 frame);
+
+/// for the readers: maps the object created by StateExport_create, read-only
+StateExport
+StateExport_open(const char* name);
+
+/// copies a consistent snapshot of the state, waits only while a frame is
+/// being written
+void
+StateExport_snapshot(const StateExport* self, StateExport_Layout* snapshot);
+
+void
+StateExport_deinit(StateExport* self);
+
+#endif // STATEEXPORT_H
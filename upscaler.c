@@ -0,0 +1,438 @@
+#include "upscaler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UPSCALER_X86
+#include <immintrin.h>
+#endif
+
+// every line has room for one extra vector store past its last pixel
+#define UPSCALER_LINE_SLACK 8
+#define UPSCALER_ALIGN      32
+
+#define UPSCALER_SOURCE_WORDS   (UPSCALER_PLANES * UPSCALER_MAX_ROWS * UPSCALER_WORDS)
+#define UPSCALER_PLANE_WORDS    (UPSCALER_MAX_ROWS * UPSCALER_WORDS)
+
+// the filtered rows are twice as wide as the source
+#define UPSCALER_FILTERED_WORDS (2 * UPSCALER_WORDS)
+
+typedef void (*Upscaler__Expand__)(u32* out, const u64* plane0, const u64* plane1, i32 cols, i32 scale, const u32* palette);
+
+static void
+Upscaler__expand_scalar__(u32* out, const u64* plane0, const u64* plane1, i32 cols, i32 scale, const u32* palette);
+
+#ifdef UPSCALER_X86
+static void
+Upscaler__expand_sse2__(u32* out, const u64* plane0, const u64* plane1, i32 cols, i32 scale, const u32* palette);
+
+static void
+Upscaler__expand_avx2__(u32* out, const u64* plane0, const u64* plane1, i32 cols, i32 scale, const u32* palette);
+#endif
+
+static Upscaler_Kernel
+Upscaler__best_kernel__(void);
+
+static void
+Upscaler__scale2x_row__(const u64* planes, i32 row, i32 cols, i32 rows, u64* top, u64* bottom);
+
+static void
+Upscaler__draw_line__(Upscaler* self, i32 line, const u64* plane0, const u64* plane1, i32 cols, i32 scale);
+
+Upscaler
+Upscaler_init(i32 width, i32 height, Upscaler_Filter filter)
+{
+    Upscaler self = {};
+
+    if(width <= 0 || height <= 0)
+    {
+        fputs("Error: Upscaler: bad output size\n", stderr);
+        self.valid = false;
+        return self;
+    }
+
+    self.filter = filter;
+    self.width = width;
+    self.height = height;
+    self.pitch = (self.width + UPSCALER_LINE_SLACK) * sizeof(u32);
+
+    size_t pixels_size = (size_t)self.pitch * self.height;
+    pixels_size = (pixels_size + UPSCALER_ALIGN - 1) / UPSCALER_ALIGN * UPSCALER_ALIGN;
+
+    self.pixels = aligned_alloc(UPSCALER_ALIGN, pixels_size);
+    self.source = calloc(UPSCALER_SOURCE_WORDS, sizeof(u64));
+    // top and bottom rows, for every plane
+    self.filtered = calloc(2 * UPSCALER_PLANES * UPSCALER_FILTERED_WORDS, sizeof(u64));
+
+    if(!self.pixels || !self.source || !self.filtered)
+    {
+        self.valid = false;
+        return self;
+    }
+
+    self.kernel = Upscaler__best_kernel__();
+    self.palette[0] = 0xFFFFFFFF;   // white background
+    self.palette[1] = 0xFF000000;   // black pixels
+    self.palette[2] = 0xFFAAAAAA;   // XO-CHIP second plane
+    self.palette[3] = 0xFF555555;   // both planes
+    self.has_source = false;
+
+    self.valid = true;
+    return self;
+}
+
+void
+Upscaler_set_kernel(Upscaler* self, Upscaler_Kernel kernel)
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    Upscaler_Kernel best = Upscaler__best_kernel__();
+    self->kernel = kernel > best ? best : kernel;
+    Upscaler_invalidate(self);
+}
+
+void
+Upscaler_set_palette(Upscaler* self, const u32 palette[UPSCALER_COLORS])
+{
+    if(!self || !self->valid)
+    {
+        return;
+    }
+
+    memcpy(self->palette, palette, sizeof(self->palette));
+    Upscaler_invalidate(self);
+}
+
+void
+Upscaler_run(Upscaler* self, const u64* planes, i32 cols, i32 rows)
+{
+    if(!self || !self->valid || !planes)
+    {
+        return;
+    }
+
+    if(cols <= 0 || cols > UPSCALER_MAX_COLS || rows <= 0 || rows > UPSCALER_MAX_ROWS ||
+       self->width % cols != 0 || self->height % rows != 0 ||
+       self->width / cols != self->height / rows)
+    {
+        fputs("Error: Upscaler: the source doesn't fit the output\n", stderr);
+        return;
+    }
+
+    const i32 scale = self->width / cols;
+    const bool scale2x = self->filter == UPSCALER_FILTER_SCALE2X && scale % 2 == 0;
+
+    if(cols != self->cols || rows != self->rows)
+    {
+        self->cols = cols;
+        self->rows = rows;
+        self->has_source = false;
+    }
+
+    bool changed[UPSCALER_MAX_ROWS];
+    bool dirty[UPSCALER_MAX_ROWS];
+
+    for(i32 row = 0; row < rows; ++row)
+    {
+        changed[row] = !self->has_source;
+
+        for(i32 plane = 0; plane < UPSCALER_PLANES && !changed[row]; ++plane)
+        {
+            const size_t offset = plane * UPSCALER_PLANE_WORDS + row * UPSCALER_WORDS;
+            changed[row] = memcmp(&planes[offset], &self->source[offset], UPSCALER_WORDS * sizeof(u64)) != 0;
+        }
+    }
+
+    for(i32 row = 0; row < rows; ++row)
+    {
+        dirty[row] = changed[row];
+
+        // scale2x output depends on the rows above and below too
+        if(scale2x)
+        {
+            dirty[row] |= (row > 0 && changed[row - 1]) ||
+                          (row + 1 < rows && changed[row + 1]);
+        }
+    }
+
+    memcpy(self->source, planes, UPSCALER_SOURCE_WORDS * sizeof(u64));
+    self->has_source = true;
+
+    for(i32 row = 0; row < rows; ++row)
+    {
+        if(!dirty[row])
+        {
+            continue;
+        }
+
+        if(scale2x)
+        {
+            u64* top = self->filtered;
+            u64* bottom = &self->filtered[UPSCALER_PLANES * UPSCALER_FILTERED_WORDS];
+
+            Upscaler__scale2x_row__(planes, row, cols, rows, top, bottom);
+            Upscaler__draw_line__(self, row * 2, top, &top[UPSCALER_FILTERED_WORDS], cols * 2, scale / 2);
+            Upscaler__draw_line__(self, row * 2 + 1, bottom, &bottom[UPSCALER_FILTERED_WORDS], cols * 2, scale / 2);
+        }
+        else
+        {
+            Upscaler__draw_line__(
+                self,
+                row,
+                &planes[row * UPSCALER_WORDS],
+                &planes[UPSCALER_PLANE_WORDS + row * UPSCALER_WORDS],
+                cols,
+                scale
+            );
+        }
+    }
+}
+
+void
+Upscaler_invalidate(Upscaler* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    self->has_source = false;
+}
+
+const char*
+Upscaler_kernel_name(Upscaler_Kernel kernel)
+{
+    switch(kernel)
+    {
+        case UPSCALER_KERNEL_SCALAR: return "scalar";
+        case UPSCALER_KERNEL_SSE2:   return "sse2";
+        case UPSCALER_KERNEL_AVX2:   return "avx2";
+    }
+
+    return "unknown";
+}
+
+void
+Upscaler_deinit(Upscaler* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    free(self->pixels);
+    free(self->source);
+    free(self->filtered);
+
+    self->pixels = NULL;
+    self->source = NULL;
+    self->filtered = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+Upscaler_Kernel
+Upscaler__best_kernel__(void)
+{
+#ifdef UPSCALER_X86
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return UPSCALER_KERNEL_AVX2;
+    }
+
+    if(__builtin_cpu_supports("sse2"))
+    {
+        return UPSCALER_KERNEL_SSE2;
+    }
+#endif
+
+    return UPSCALER_KERNEL_SCALAR;
+}
+
+// draws one source line into `scale` output lines: the first one is expanded
+// by the kernel, the others are plain copies of it
+void
+Upscaler__draw_line__(Upscaler* self, i32 line, const u64* plane0, const u64* plane1, i32 cols, i32 scale)
+{
+    Upscaler__Expand__ expand = Upscaler__expand_scalar__;
+
+#ifdef UPSCALER_X86
+    if(self->kernel == UPSCALER_KERNEL_AVX2) expand = Upscaler__expand_avx2__;
+    if(self->kernel == UPSCALER_KERNEL_SSE2) expand = Upscaler__expand_sse2__;
+#endif
+
+    const i32 pitch = self->pitch / sizeof(u32);
+    u32* first = &self->pixels[line * scale * pitch];
+
+    expand(first, plane0, plane1, cols, scale, self->palette);
+
+    for(i32 copy = 1; copy < scale; ++copy)
+    {
+        memcpy(&first[copy * pitch], first, self->width * sizeof(u32));
+    }
+}
+
+void
+Upscaler__expand_scalar__(u32* out, const u64* plane0, const u64* plane1, i32 cols, i32 scale, const u32* palette)
+{
+    for(i32 col = 0; col < cols; ++col)
+    {
+        const i32 word = col / UPSCALER_WORD_BITS;
+        const i32 shift = UPSCALER_WORD_BITS - 1 - col % UPSCALER_WORD_BITS;
+        u32 color = palette[((plane0[word] >> shift) & 1) | (((plane1[word] >> shift) & 1) << 1)];
+
+        for(i32 iii = 0; iii < scale; ++iii)
+        {
+            *out++ = color;
+        }
+    }
+}
+
+#ifdef UPSCALER_X86
+// every pixel is written with whole vector stores, the part that spills past
+// the pixel is overwritten by the next one (or lands in the line slack)
+__attribute__((target("sse2")))
+void
+Upscaler__expand_sse2__(u32* out, const u64* plane0, const u64* plane1, i32 cols, i32 scale, const u32* palette)
+{
+    const __m128i colors[UPSCALER_COLORS] = {
+        _mm_set1_epi32((i32)palette[0]),
+        _mm_set1_epi32((i32)palette[1]),
+        _mm_set1_epi32((i32)palette[2]),
+        _mm_set1_epi32((i32)palette[3]),
+    };
+
+    for(i32 word = 0; word < cols / UPSCALER_WORD_BITS; ++word)
+    {
+        u64 bits0 = plane0[word];
+        u64 bits1 = plane1[word];
+
+        for(i32 col = 0; col < UPSCALER_WORD_BITS; ++col, bits0 <<= 1, bits1 <<= 1)
+        {
+            __m128i color = colors[(bits0 >> (UPSCALER_WORD_BITS - 1)) | ((bits1 >> (UPSCALER_WORD_BITS - 1)) << 1)];
+
+            for(i32 iii = 0; iii < scale; iii += 4)
+            {
+                _mm_storeu_si128((__m128i*)&out[iii], color);
+            }
+
+            out += scale;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void
+Upscaler__expand_avx2__(u32* out, const u64* plane0, const u64* plane1, i32 cols, i32 scale, const u32* palette)
+{
+    const __m256i colors[UPSCALER_COLORS] = {
+        _mm256_set1_epi32((i32)palette[0]),
+        _mm256_set1_epi32((i32)palette[1]),
+        _mm256_set1_epi32((i32)palette[2]),
+        _mm256_set1_epi32((i32)palette[3]),
+    };
+
+    for(i32 word = 0; word < cols / UPSCALER_WORD_BITS; ++word)
+    {
+        u64 bits0 = plane0[word];
+        u64 bits1 = plane1[word];
+
+        for(i32 col = 0; col < UPSCALER_WORD_BITS; ++col, bits0 <<= 1, bits1 <<= 1)
+        {
+            __m256i color = colors[(bits0 >> (UPSCALER_WORD_BITS - 1)) | ((bits1 >> (UPSCALER_WORD_BITS - 1)) << 1)];
+
+            for(i32 iii = 0; iii < scale; iii += 8)
+            {
+                _mm256_storeu_si256((__m256i*)&out[iii], color);
+            }
+
+            out += scale;
+        }
+    }
+}
+#endif
+
+// spreads the 32 bits of `x` to the even bits of the result
+static inline u64
+Upscaler__spread__(u64 x)
+{
+    x &= 0xFFFFFFFFULL;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x << 2))  & 0x3333333333333333ULL;
+    x = (x | (x << 1))  & 0x5555555555555555ULL;
+    return x;
+}
+
+// Scale2x (EPX) on bit planes, 64 pixels per operation.
+// For every pixel E with B above, H below, D on the left and F on the right:
+//   E0 = D == B && B != F && D != H ? D : E   (top left)
+//   E1 = B == F && B != D && F != H ? F : E   (top right)
+//   E2 = D == H && D != B && H != F ? D : E   (bottom left)
+//   E3 = H == F && H != D && B != F ? F : E   (bottom right)
+// two pixels are equal when they are equal in every plane, the edges repeat
+// the border pixels.
+void
+Upscaler__scale2x_row__(const u64* planes, i32 row, i32 cols, i32 rows, u64* top, u64* bottom)
+{
+    const i32 words = cols / UPSCALER_WORD_BITS;
+    const i32 above = row > 0 ? row - 1 : row;
+    const i32 below = row + 1 < rows ? row + 1 : row;
+
+    for(i32 word = 0; word < words; ++word)
+    {
+        u64 E[UPSCALER_PLANES], B[UPSCALER_PLANES], H[UPSCALER_PLANES];
+        u64 D[UPSCALER_PLANES], F[UPSCALER_PLANES];
+        u64 db = ~0ULL, bf = ~0ULL, dh = ~0ULL, hf = ~0ULL;
+
+        for(i32 plane = 0; plane < UPSCALER_PLANES; ++plane)
+        {
+            const u64* e = &planes[plane * UPSCALER_PLANE_WORDS + row * UPSCALER_WORDS];
+
+            u64 left_carry  = word > 0 ? e[word - 1] << 63 : e[0] & (1ULL << 63);
+            u64 right_carry = word + 1 < words ? e[word + 1] >> 63 : e[words - 1] & 1;
+
+            E[plane] = e[word];
+            B[plane] = planes[plane * UPSCALER_PLANE_WORDS + above * UPSCALER_WORDS + word];
+            H[plane] = planes[plane * UPSCALER_PLANE_WORDS + below * UPSCALER_WORDS + word];
+            D[plane] = (E[plane] >> 1) | left_carry;
+            F[plane] = (E[plane] << 1) | right_carry;
+
+            db &= ~(D[plane] ^ B[plane]);
+            bf &= ~(B[plane] ^ F[plane]);
+            dh &= ~(D[plane] ^ H[plane]);
+            hf &= ~(H[plane] ^ F[plane]);
+        }
+
+        u64 s0 = db & ~bf & ~dh;
+        u64 s1 = bf & ~db & ~hf;
+        u64 s2 = dh & ~db & ~hf;
+        u64 s3 = hf & ~dh & ~bf;
+
+        for(i32 plane = 0; plane < UPSCALER_PLANES; ++plane)
+        {
+            u64 e0 = (s0 & D[plane]) | (~s0 & E[plane]);
+            u64 e1 = (s1 & F[plane]) | (~s1 & E[plane]);
+            u64 e2 = (s2 & D[plane]) | (~s2 & E[plane]);
+            u64 e3 = (s3 & F[plane]) | (~s3 & E[plane]);
+
+            u64* t = &top[plane * UPSCALER_FILTERED_WORDS];
+            u64* b = &bottom[plane * UPSCALER_FILTERED_WORDS];
+
+            // interleave: the left pixel of each pair goes to the odd (higher) bit
+            t[word * 2]     = (Upscaler__spread__(e0 >> 32) << 1) | Upscaler__spread__(e1 >> 32);
+            t[word * 2 + 1] = (Upscaler__spread__(e0) << 1)       | Upscaler__spread__(e1);
+            b[word * 2]     = (Upscaler__spread__(e2 >> 32) << 1) | Upscaler__spread__(e3 >> 32);
+            b[word * 2 + 1] = (Upscaler__spread__(e2) << 1)       | Upscaler__spread__(e3);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef UPSCALER_H
+#define UPSCALER_H
+
+#include "utils/type_alias.h"
+
+#include <stdbool.h>
+
+// the biggest source the upscaler accepts, in pixels
+#define UPSCALER_MAX_COLS   128
+#define UPSCALER_MAX_ROWS   64
+#define UPSCALER_PLANES     2
+#define UPSCALER_WORD_BITS  64
+#define UPSCALER_WORDS      (UPSCALER_MAX_COLS / UPSCALER_WORD_BITS)   // source row stride
+#define UPSCALER_COLORS     (1 << UPSCALER_PLANES)
+
+typedef enum {
+    UPSCALER_FILTER_NONE,       // nearest neighbor
+    UPSCALER_FILTER_SCALE2X,    // EPX/Scale2x, then nearest neighbor by scale / 2
+} Upscaler_Filter;
+
+typedef enum {
+    UPSCALER_KERNEL_SCALAR,
+    UPSCALER_KERNEL_SSE2,
+    UPSCALER_KERNEL_AVX2,
+} Upscaler_Kernel;
+
+// Turns bit planes (u64 words, the most significant bit is the leftmost
+// pixel) into an ARGB8888 pixel buffer of a fixed size, scaled by an
+// integer factor. The color of a pixel is palette[plane0 | plane1 << 1].
+// Only the source rows that changed since the last call are redrawn.
+typedef struct {
+    u32* pixels;
+    i32 width;          // in pixels
+    i32 height;
+    i32 pitch;          // in bytes
+    i32 cols;           // size of the last source
+    i32 rows;
+    Upscaler_Filter filter;
+    Upscaler_Kernel kernel;
+    u32 palette[UPSCALER_COLORS];
+    u64* source;        // last drawn source, to find the rows that changed
+    u64* filtered;      // scratch for the filtered (2x) source
+    bool has_source;
+    bool valid;
+} Upscaler;
+
+/// @param: width, height: size of the output in pixels
+/// @param: filter: UPSCALER_FILTER_SCALE2X is only applied when the source
+///                 is scaled by an even factor, nearest neighbor otherwise
+Upscaler
+Upscaler_init(i32 width, i32 height, Upscaler_Filter filter);
+
+/// picks the kernel, the best one the cpu supports is chosen by Upscaler_init
+void
+Upscaler_set_kernel(Upscaler* self, Upscaler_Kernel kernel);
+
+void
+Upscaler_set_palette(Upscaler* self, const u32 palette[UPSCALER_COLORS]);
+
+/// @param: planes: [UPSCALER_PLANES][UPSCALER_MAX_ROWS][UPSCALER_WORDS] words
+/// @param: cols, rows: size of the source, it should divide the output size
+///                     by the same integer in both directions
+void
+Upscaler_run(Upscaler* self, const u64* planes, i32 cols, i32 rows);
+
+/// forces the next Upscaler_run to redraw everything
+void
+Upscaler_invalidate(Upscaler* self);
+
+const char*
+Upscaler_kernel_name(Upscaler_Kernel kernel);
+
+void
+Upscaler_deinit(Upscaler* self);
+
+#endif // UPSCALER_H
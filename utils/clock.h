@@ -0,0 +1,35 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "type_alias.h"
+
+#include <time.h>
+#include <errno.h>
+
+#define CLOCK_NS_PER_SEC    1000000000ULL
+#define CLOCK_NS_PER_MS     1000000ULL
+#define CLOCK_NS_PER_US     1000ULL
+
+// monotonic time in nanoseconds, not affected by wall clock changes
+static u64
+Clock_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((u64)ts.tv_sec * CLOCK_NS_PER_SEC) + (u64)ts.tv_nsec;
+}
+
+// sleep until the absolute monotonic time `deadline_ns`
+static void
+Clock_sleep_until_ns(u64 deadline_ns)
+{
+    struct timespec ts = {
+        .tv_sec  = (time_t)(deadline_ns / CLOCK_NS_PER_SEC),
+        .tv_nsec = (long)(deadline_ns % CLOCK_NS_PER_SEC),
+    };
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+#endif // CLOCK_H
@@ -0,0 +1,46 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "type_alias.h"
+
+#include <stddef.h>
+
+// Zobrist style hashing: the hash of a state is the XOR of one key per
+// (position, value), so a store only swaps the key of the old value for the
+// key of the new one, whatever the size of the state. A zero value has no
+// key, an all zero state hashes to 0.
+
+// splitmix64 finalizer, a bijection on u64
+static inline u64
+Hash_mix(u64 x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// key of `value` at `position`
+static inline u64
+Hash_key(u64 position, u64 value)
+{
+    return value ? Hash_mix((position * 0x9E3779B97F4A7C15ULL) ^ value) : 0;
+}
+
+// folds `size` bytes into `hash`, for the small parts of a state that are
+// cheaper to hash whole than to track
+static inline u64
+Hash_bytes(u64 hash, const void* data, size_t size)
+{
+    const u8* bytes = data;
+    for(size_t offset = 0; offset < size; offset++)
+    {
+        hash = (hash ^ bytes[offset]) * 0x100000001B3ULL;    // FNV-1a
+    }
+
+    return Hash_mix(hash);
+}
+
+#endif // HASH_H
@@ -0,0 +1,121 @@
+#ifndef RING_H
+#define RING_H
+
+#include "type_alias.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lock-free single producer / single consumer ring of audio samples.
+// Both indices only grow (wrapping at 2^32), the producer owns `head` and the
+// consumer `tail`; the capacity is a power of two so they are masked, and a
+// full ring refuses the samples instead of overwriting unread ones.
+
+typedef struct {
+    i16* samples;
+    u32 mask;               // capacity - 1
+    _Atomic u32 head;       // next sample written
+    _Atomic u32 tail;       // next sample read
+    bool valid;
+} Ring;
+
+// `capacity` is rounded up to a power of two
+static Ring
+Ring_construct(u32 capacity)
+{
+    Ring ring = {};
+
+    u32 size = 1;
+    while(size < capacity)
+    {
+        size <<= 1;
+    }
+
+    ring.samples = calloc(size, sizeof(i16));
+    if(!ring.samples)
+    {
+        ring.valid = false;
+        return ring;
+    }
+
+    ring.mask = size - 1;
+    atomic_init(&ring.head, 0);
+    atomic_init(&ring.tail, 0);
+
+    ring.valid = true;
+    return ring;
+}
+
+// samples waiting, from either side
+static u32
+Ring_count(Ring* self)
+{
+    return atomic_load_explicit(&self->head, memory_order_acquire) -
+           atomic_load_explicit(&self->tail, memory_order_acquire);
+}
+
+// producer: returns how many of `count` samples fitted
+static u32
+Ring_push(Ring* self, const i16* samples, u32 count)
+{
+    const u32 head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    const u32 tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+    const u32 room = self->mask + 1 - (head - tail);
+    if(count > room)
+    {
+        count = room;
+    }
+
+    // in at most two pieces, around the end of the buffer
+    const u32 start = head & self->mask;
+    const u32 first = count < self->mask + 1 - start ? count : self->mask + 1 - start;
+    memcpy(&self->samples[start], samples, first * sizeof(i16));
+    memcpy(self->samples, &samples[first], (count - first) * sizeof(i16));
+
+    atomic_store_explicit(&self->head, head + count, memory_order_release);
+    return count;
+}
+
+// consumer: returns how many of `count` samples were there
+static u32
+Ring_pop(Ring* self, i16* samples, u32 count)
+{
+    const u32 tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    const u32 head = atomic_load_explicit(&self->head, memory_order_acquire);
+    if(count > head - tail)
+    {
+        count = head - tail;
+    }
+
+    const u32 start = tail & self->mask;
+    const u32 first = count < self->mask + 1 - start ? count : self->mask + 1 - start;
+    memcpy(samples, &self->samples[start], first * sizeof(i16));
+    memcpy(&samples[first], self->samples, (count - first) * sizeof(i16));
+
+    atomic_store_explicit(&self->tail, tail + count, memory_order_release);
+    return count;
+}
+
+// empties the ring, only while the consumer is stopped
+static void
+Ring_clear(Ring* self)
+{
+    atomic_store_explicit(&self->tail, atomic_load_explicit(&self->head, memory_order_relaxed), memory_order_release);
+}
+
+static void
+Ring_deconstruct(Ring* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    free(self->samples);
+    self->samples = NULL;
+    self->valid = false;
+}
+
+#endif // RING_H
@@ -0,0 +1,52 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include "type_alias.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Sequence lock: one writer that never waits, readers that retry.
+// The sequence is odd while the writer is updating the data, a reader copies
+// the data and keeps the copy only if the sequence was even and didn't move.
+// It only holds an atomic counter, so it can live in shared memory.
+
+typedef struct {
+    _Atomic u64 sequence;
+} SeqLock;
+
+static void
+SeqLock_write_begin(SeqLock* self)
+{
+    u64 sequence = atomic_load_explicit(&self->sequence, memory_order_relaxed);
+    atomic_store_explicit(&self->sequence, sequence + 1, memory_order_relaxed);
+    // the data written next can't be seen before the odd sequence
+    atomic_thread_fence(memory_order_release);
+}
+
+static void
+SeqLock_write_end(SeqLock* self)
+{
+    u64 sequence = atomic_load_explicit(&self->sequence, memory_order_relaxed);
+    atomic_store_explicit(&self->sequence, sequence + 1, memory_order_release);
+}
+
+// the sequence to give to SeqLock_read_retry, waits while a write is going on
+static u64
+SeqLock_read_begin(const SeqLock* self)
+{
+    u64 sequence;
+    while((sequence = atomic_load_explicit((_Atomic u64*)&self->sequence, memory_order_acquire)) & 1);
+
+    return sequence;
+}
+
+// true if the data read since SeqLock_read_begin may be torn
+static bool
+SeqLock_read_retry(const SeqLock* self, u64 sequence)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit((_Atomic u64*)&self->sequence, memory_order_relaxed) != sequence;
+}
+
+#endif // SEQLOCK_H
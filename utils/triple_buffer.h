@@ -0,0 +1,99 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include "type_alias.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// Lock-free single producer / single consumer triple buffer.
+// The producer always has a slot to write into and never waits, the consumer
+// always gets the newest published slot. Slots that were never read are dropped.
+
+#define TRIPLE_BUFFER_FRESH 0x4 // set in `middle` when it holds an unread slot
+
+typedef struct {
+    u8* slots;
+    size_t slot_size;
+    u8 back;            // owned by the producer
+    u8 front;           // owned by the consumer
+    _Atomic u8 middle;  // slot index | TRIPLE_BUFFER_FRESH
+    bool valid;
+} TripleBuffer;
+
+static TripleBuffer
+TripleBuffer_construct(size_t slot_size)
+{
+    TripleBuffer buffer = {};
+
+    buffer.slots = calloc(3, slot_size);
+    if(!buffer.slots)
+    {
+        buffer.valid = false;
+        return buffer;
+    }
+
+    buffer.slot_size = slot_size;
+    buffer.back = 0;
+    buffer.front = 1;
+    atomic_init(&buffer.middle, 2);
+
+    buffer.valid = true;
+    return buffer;
+}
+
+// the slot the producer should fill before calling TripleBuffer_publish
+static void*
+TripleBuffer_back(TripleBuffer* self)
+{
+    return &self->slots[self->back * self->slot_size];
+}
+
+static void
+TripleBuffer_publish(TripleBuffer* self)
+{
+    u8 old = atomic_exchange_explicit(
+        &self->middle,
+        self->back | TRIPLE_BUFFER_FRESH,
+        memory_order_acq_rel
+    );
+    self->back = old & ~TRIPLE_BUFFER_FRESH;
+}
+
+// returns true if a newer slot than the current front was taken
+static bool
+TripleBuffer_acquire(TripleBuffer* self)
+{
+    if(!(atomic_load_explicit(&self->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH))
+    {
+        return false;
+    }
+
+    u8 old = atomic_exchange_explicit(&self->middle, self->front, memory_order_acq_rel);
+    self->front = old & ~TRIPLE_BUFFER_FRESH;
+    return true;
+}
+
+// the slot the consumer reads, valid until the next TripleBuffer_acquire
+static const void*
+TripleBuffer_front(TripleBuffer* self)
+{
+    return &self->slots[self->front * self->slot_size];
+}
+
+static void
+TripleBuffer_deconstruct(TripleBuffer* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    free(self->slots);
+    self->slots = NULL;
+    self->valid = false;
+}
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,272 @@
+#include "wall.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#define WALL_POLL_MS    16      // the main thread looks at the events and the instances that often
+
+static int
+Wall__thread__(void* arg);
+
+static bool
+Wall__running__(const Wall* self);
+
+Wall
+Wall_init(const u8* program, size_t program_size, Wall_Options options)
+{
+    Wall wall = {};
+
+    if(options.count < 2 || options.count > WALL_MAX_INSTANCES)
+    {
+        fprintf(stderr, "Error: Wall: 2 to %d instances\n", WALL_MAX_INSTANCES);
+        wall.valid = false;
+        return wall;
+    }
+
+    if(!program || program_size == 0 || program_size > Cpu_max_program_size(options.mode))
+    {
+        fprintf(stderr, "Error: Wall: the program is empty or doesn't fit in %zu bytes\n", Cpu_max_program_size(options.mode));
+        wall.valid = false;
+        return wall;
+    }
+    wall.options = options;
+
+    wall.display = Display_init(options.count, options.scale, options.vsync, options.filter);
+    wall.keyboard = Keyboard_init();
+    wall.instances = calloc(options.count, sizeof(Wall__Instance__));
+    if(!wall.display.valid || !wall.keyboard.valid || !wall.instances)
+    {
+        Wall_deinit(&wall);
+        wall.valid = false;
+        return wall;
+    }
+
+    // the same ROM everywhere, the seeds tell the instances apart
+    const u32 seed = options.seed ? options.seed : (u32)time(NULL);
+    for(u32 iii = 0; iii < options.count; iii++)
+    {
+        Wall__Instance__* instance = &wall.instances[iii];
+
+        instance->keyboard = Keyboard_init();
+        instance->speaker = Speaker_init_silent();
+        instance->renderer = Renderer_init();
+        instance->cpu = Cpu_init(&instance->renderer, &instance->keyboard, &instance->speaker, options.speed, options.mode, options.quirks);
+        if(!instance->keyboard.valid || !instance->renderer.valid || !instance->cpu.valid)
+        {
+            Wall_deinit(&wall);
+            wall.valid = false;
+            return wall;
+        }
+
+        Cpu_load_program(&instance->cpu, (u8*)program, program_size);
+        if(instance->cpu.error != CPU_NO_ERROR)
+        {
+            Wall_deinit(&wall);
+            wall.valid = false;
+            return wall;
+        }
+        Cpu_seed(&instance->cpu, seed + iii);
+
+        if(options.no_fusion)
+        {
+            Cpu_set_fusion(&instance->cpu, false);
+        }
+
+        if(options.compiled)
+        {
+            Cpu_attach_compiled(&instance->cpu, options.compiled);
+        }
+
+        instance->index = iii;
+        atomic_init(&instance->stopped, false);
+    }
+
+    atomic_init(&wall.keys, 0);
+    atomic_init(&wall.quit, false);
+
+    wall.valid = true;
+    return wall;
+}
+
+bool
+Wall_run(Wall* self)
+{
+    if(!self || !self->valid)
+    {
+        return false;
+    }
+
+    // the tiles point into the instances' renderers, they can't move anymore
+    for(u32 iii = 0; iii < self->options.count; iii++)
+    {
+        Wall__Instance__* instance = &self->instances[iii];
+        instance->wall = self;
+        if(!Renderer_set_display(&instance->renderer, &self->display, iii))
+        {
+            return false;
+        }
+    }
+
+    if(!Display_start(&self->display))
+    {
+        return false;
+    }
+
+    char title[64];
+    snprintf(title, sizeof(title), "Chip 8 - wall of %u", self->options.count);
+    Display_set_title(&self->display, title);
+
+    for(u32 iii = 0; iii < self->options.count; iii++)
+    {
+        Wall__Instance__* instance = &self->instances[iii];
+        instance->thread = SDL_CreateThread(Wall__thread__, "wall", instance);
+        if(!instance->thread)
+        {
+            fputs(SDL_GetError(), stderr);
+            return false;
+        }
+    }
+
+    // the keys go to every instance, they read them at the start of their frames
+    while(!self->keyboard.quit_pressed && Wall__running__(self))
+    {
+        Keyboard_wait(&self->keyboard, WALL_POLL_MS);
+        Keyboard_run(&self->keyboard);
+        atomic_store(&self->keys, Keyboard_keys(&self->keyboard));
+    }
+
+    atomic_store(&self->quit, true);
+
+    bool ok = true;
+    u64 frames = 0;
+    for(u32 iii = 0; iii < self->options.count; iii++)
+    {
+        Wall__Instance__* instance = &self->instances[iii];
+        SDL_WaitThread(instance->thread, NULL);
+        instance->thread = NULL;
+
+        ok &= instance->cpu.error == CPU_NO_ERROR;
+        frames += instance->frames;
+    }
+
+    fprintf(stderr, "wall: %u instances, %llu frames\n", self->options.count, (unsigned long long)frames);
+    return ok;
+}
+
+void
+Wall_deinit(Wall* self)
+{
+    if(!self)
+    {
+        return;
+    }
+
+    atomic_store(&self->quit, true);
+    for(u32 iii = 0; self->instances && iii < self->options.count; iii++)
+    {
+        if(self->instances[iii].thread)
+        {
+            SDL_WaitThread(self->instances[iii].thread, NULL);
+            self->instances[iii].thread = NULL;
+        }
+    }
+
+    // the render thread reads the renderers' frames until it's gone
+    Display_deinit(&self->display);
+
+    if(self->instances)
+    {
+        for(u32 iii = 0; iii < self->options.count; iii++)
+        {
+            Wall__Instance__* instance = &self->instances[iii];
+            if(instance->cpu.valid)
+            {
+                Cpu_deinit(&instance->cpu);
+            }
+            if(instance->renderer.valid)
+            {
+                Renderer_deinit(&instance->renderer);
+            }
+            if(instance->keyboard.valid)
+            {
+                Keyboard_deinit(&instance->keyboard);
+            }
+            Speaker_deinit(&instance->speaker);
+            Pacer_deinit(&instance->pacer);
+        }
+    }
+
+    if(self->keyboard.valid)
+    {
+        Keyboard_deinit(&self->keyboard);
+    }
+
+    free(self->instances);
+    self->instances = NULL;
+    self->valid = false;
+}
+
+
+// Private functions
+int
+Wall__thread__(void* arg)
+{
+    Wall__Instance__* self = arg;
+    Wall* wall = self->wall;
+
+    // the schedule starts with the thread, and with hundreds of threads on a
+    // few cpus the pacers sleep instead of spinning
+    self->pacer = Pacer_init(wall->options.fps);
+    Pacer_set_spin(&self->pacer, false);
+
+    while(!atomic_load(&wall->quit))
+    {
+        Keyboard_set_keys(&self->keyboard, atomic_load(&wall->keys));
+
+        if(!Cpu_run_frame(&self->cpu))
+        {
+            fprintf(
+                stderr,
+                "Error: Wall: instance %u: %s at 0x%03X (opcode %04X) after %llu frames\n",
+                self->index,
+                Cpu_error_name(self->cpu.error),
+                self->cpu.fault_pc,
+                self->cpu.fault_opcode,
+                (unsigned long long)self->frames
+            );
+            break;
+        }
+
+        Cpu_present(&self->cpu);
+        self->frames++;
+
+        if(self->cpu.exited || (wall->options.max_frames && self->frames >= wall->options.max_frames))
+        {
+            break;
+        }
+
+        Pacer_wait(&self->pacer);
+    }
+
+    // the last frame stays on its tile
+    atomic_store(&self->stopped, true);
+    return 0;
+}
+
+// some instance still runs
+bool
+Wall__running__(const Wall* self)
+{
+    for(u32 iii = 0; iii < self->options.count; iii++)
+    {
+        if(!atomic_load(&self->instances[iii].stopped))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
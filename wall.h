@@ -0,0 +1,77 @@
+#ifndef WALL_H
+#define WALL_H
+
+#include "utils/type_alias.h"
+#include "cpu.h"
+#include "display.h"
+#include "keyboard.h"
+#include "pacer.h"
+#include "renderer.h"
+#include "speaker.h"
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define WALL_MAX_INSTANCES  256
+
+typedef struct {
+    u32 count;              // instances, 2 to WALL_MAX_INSTANCES
+    u32 speed;              // instructions per frame
+    Cpu_Mode mode;
+    Cpu_Quirks quirks;
+    u32 seed;               // instance n gets seed + n, 0 for a different run every time
+    i32 scale;              // window pixels per lores pixel of a tile
+    bool vsync;
+    Upscaler_Filter filter;
+    u32 fps;
+    u64 max_frames;         // per instance, 0 runs until quit
+    const Cpu_Compiled* compiled;   // NULL to interpret the ROM
+    bool no_fusion;
+} Wall_Options;
+
+typedef struct Wall Wall;
+
+// one machine of the wall, on its own thread with its own pacer
+typedef struct {
+    Keyboard keyboard;      // the keys of the wall, set every frame
+    Speaker speaker;        // silent, a wall has no sound
+    Renderer renderer;      // publishes into its tile of the display
+    Cpu cpu;
+    Pacer pacer;
+    void* thread;           // SDL_Thread
+    Wall* wall;
+    u32 index;
+    u64 frames;
+    atomic_bool stopped;    // exited, faulted or ran max_frames
+} Wall__Instance__;
+
+// Many copies of the same ROM side by side in one window, for watching
+// batch runs or demos. Every instance runs on its own thread at its own
+// pace and publishes into its tile of one Display, which shows the last
+// frame of every tile with a single upload and a single draw. The keys
+// pressed go to all of them.
+struct Wall {
+    Wall_Options options;
+    Display display;
+    Keyboard keyboard;      // polled by the main thread
+    Wall__Instance__* instances;
+    _Atomic u16 keys;       // held on the keyboard, bit n is the key n
+    atomic_bool quit;
+    bool valid;
+};
+
+/// loads the program into every instance, nothing runs before Wall_run
+Wall
+Wall_init(const u8* program, size_t program_size, Wall_Options options);
+
+/// opens the window and runs the instances until quit, or until all of
+/// them stopped, `self` should not move after that. Call it from the main
+/// thread, SDL wants the video and the events there
+/// @return: false if the window can't be opened or an instance faulted
+bool
+Wall_run(Wall* self);
+
+void
+Wall_deinit(Wall* self);
+
+#endif // WALL_H